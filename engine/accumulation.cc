@@ -0,0 +1,49 @@
+#include "accumulation.h"
+#include <stdio.h>
+#include <type_traits>
+
+static_assert(sizeof(Color) == 3 * sizeof(float), "accumulation dumps store Colors as is");
+static_assert(sizeof(AccumulationHeader) == 32, "AccumulationHeader layout changed, bump the version");
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SaveAccumulation(const char* path, const AccumulationHeader& header, const Color* sum)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    size_t count = size_t(header.width) * header.height;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(sum, sizeof(Color), count, file) == count;
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadAccumulation(const char* path, AccumulationHeader& header, std::vector<Color>& sum)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == ACCUMULATION_MAGIC &&
+        header.version == ACCUMULATION_VERSION;
+
+    if (ok)
+    {
+        size_t count = size_t(header.width) * header.height;
+        sum.resize(count);
+        ok = fread(sum.data(), sizeof(Color), count, file) == count;
+    }
+
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "color.h"
+
+#define ACCUMULATION_MAGIC 0x43414252 // "RBAC"
+#define ACCUMULATION_VERSION 1
+
+//------------------------------------------------------------------------------
+/**
+    Header of a raw accumulation dump, followed by width * height Colors in
+    framebuffer order (rows bottom up).
+
+    The Raytracer adds the mean of raysPerPixel samples to every pixel each
+    frame, so the stored sum divided by frameCount is the image and every
+    pixel holds frameCount * raysPerPixel samples.
+*/
+struct AccumulationHeader
+{
+    uint32_t magic = ACCUMULATION_MAGIC;
+    uint32_t version = ACCUMULATION_VERSION;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t frameCount = 0;
+    uint32_t raysPerPixel = 0;
+    uint32_t reserved = 0;
+};
+
+// store the raw sum buffer
+bool SaveAccumulation(const char* path, const AccumulationHeader& header, const Color* sum);
+
+// load a raw sum buffer, fails on a bad header or a truncated file
+bool LoadAccumulation(const char* path, AccumulationHeader& header, std::vector<Color>& sum);
@@ -0,0 +1,170 @@
+#include "bscache.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <filesystem>
+#ifdef _WIN32
+#include <process.h>
+#define CurrentProcessId _getpid
+#else
+#include <unistd.h>
+#define CurrentProcessId getpid
+#endif
+
+//------------------------------------------------------------------------------
+/**
+    FNV-1a style hash over 64 bit words with a final avalanche, fast enough to
+    hash multi-million sphere scenes on every start
+*/
+static uint64_t
+HashBytes(const void* data, size_t size, uint64_t hash)
+{
+    constexpr uint64_t prime = 0x100000001b3ull;
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    size_t words = size / sizeof(uint64_t);
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+
+    for (size_t i = words * sizeof(uint64_t); i < size; i++)
+        hash = (hash ^ bytes[i]) * prime;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+HashSceneSpheres(const SceneView& scene)
+{
+    const float constants[] = { MAX_RADIUS, RADIUS_MARGIN, float(MAX_SPHERES), float(sizeof(BoundingSphere)) };
+    uint64_t count = scene.sphereCount;
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HashBytes(constants, sizeof(constants), hash);
+    hash = HashBytes(&count, sizeof(count), hash);
+    hash = HashBytes(scene.spheres, scene.sphereCount * sizeof(PackedSphere), hash);
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::string
+BoundingSphereCachePath(const std::string& directory, uint64_t sceneHash)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.rbbs", (unsigned long long)sceneHash);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+//------------------------------------------------------------------------------
+/**
+    The process id tells concurrent runs apart, the counter concurrent
+    writers within one run
+*/
+std::string
+UniqueTempPath(const std::string& path)
+{
+    static std::atomic<uint64_t> counter(0);
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%lld.%llu.tmp", (long long)CurrentProcessId(), (unsigned long long)counter++);
+    return path + suffix;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadBoundingSphereCache(const std::string& directory, uint64_t sceneHash, size_t sphereCount, MemoryPool<BoundingSphere>& pool)
+{
+    FILE* file = fopen(BoundingSphereCachePath(directory, sceneHash).c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    BoundingSphereCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == BS_CACHE_MAGIC &&
+        header.version == BS_CACHE_VERSION &&
+        header.headerSize == sizeof(BoundingSphereCacheHeader) &&
+        header.boundingSphereSize == sizeof(BoundingSphere) &&
+        header.sceneHash == sceneHash &&
+        header.sphereCount == sphereCount &&
+        header.boundingSphereCount <= sphereCount;
+
+    BoundingSphere* records = nullptr;
+    if (ok)
+    {
+        pool.Clear();
+        records = pool.GetNew(int(header.boundingSphereCount));
+        ok = records != nullptr &&
+            fread(records, sizeof(BoundingSphere), size_t(header.boundingSphereCount), file) == header.boundingSphereCount &&
+            HashBytes(records, size_t(header.boundingSphereCount) * sizeof(BoundingSphere), 0) == header.payloadHash;
+    }
+    fclose(file);
+
+    // never trust indices from disk, a stale file would otherwise read out of bounds
+    for (uint64_t i = 0; ok && i < header.boundingSphereCount; i++)
+    {
+        ok = records[i].count >= 0 && records[i].count <= MAX_SPHERES;
+        for (int j = 0; ok && j < records[i].count; j++)
+            ok = records[i].containedSphereIndices[j] >= 0 && size_t(records[i].containedSphereIndices[j]) < sphereCount;
+    }
+
+    if (!ok)
+        pool.Clear();
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+StoreBoundingSphereCache(const std::string& directory, uint64_t sceneHash, size_t sphereCount, const BoundingSphere* boundingSpheres, size_t count)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    BoundingSphereCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BS_CACHE_MAGIC;
+    header.version = BS_CACHE_VERSION;
+    header.headerSize = sizeof(BoundingSphereCacheHeader);
+    header.boundingSphereSize = sizeof(BoundingSphere);
+    header.sceneHash = sceneHash;
+    header.sphereCount = sphereCount;
+    header.boundingSphereCount = count;
+    header.payloadHash = HashBytes(boundingSpheres, count * sizeof(BoundingSphere), 0);
+
+    // write to a temporary file of our own first, so concurrent runs never see or write into a partial cache
+    std::string path = BoundingSphereCachePath(directory, sceneHash);
+    std::string tempPath = UniqueTempPath(path);
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(boundingSpheres, sizeof(BoundingSphere), count, file) == count;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok)
+    {
+        std::filesystem::rename(tempPath, path, error);
+        ok = !error;
+    }
+
+    if (!ok)
+        std::filesystem::remove(tempPath, error);
+
+    return ok;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "raytracer.h"
+
+#define BS_CACHE_MAGIC 0x53424252 // "RBBS"
+#define BS_CACHE_VERSION 1
+
+//------------------------------------------------------------------------------
+/**
+    Header of a cached bounding sphere file. The file is named after the scene
+    hash and followed by boundingSphereCount BoundingSphere records.
+*/
+struct BoundingSphereCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t boundingSphereSize;
+    uint64_t sceneHash;
+    uint64_t sphereCount;
+    uint64_t boundingSphereCount;
+    // hash of the records, catches truncated or corrupted files
+    uint64_t payloadHash;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Hash of everything the bounding sphere build depends on: sphere centers and
+    radii, their order and the grouping constants. Materials are not included,
+    so editing them keeps the cache valid.
+*/
+uint64_t HashSceneSpheres(const SceneView& scene);
+
+// path of the cache file for a scene hash inside directory
+std::string BoundingSphereCachePath(const std::string& directory, uint64_t sceneHash);
+// temporary file next to path that no other process or call uses, to write a file that is then renamed to path
+std::string UniqueTempPath(const std::string& path);
+
+// load cached bounding spheres into pool, returns false if missing, stale or invalid
+bool LoadBoundingSphereCache(const std::string& directory, uint64_t sceneHash, size_t sphereCount, MemoryPool<BoundingSphere>& pool);
+
+// store bounding spheres for a scene hash, the directory is created if needed
+bool StoreBoundingSphereCache(const std::string& directory, uint64_t sceneHash, size_t sphereCount, const BoundingSphere* boundingSpheres, size_t count);
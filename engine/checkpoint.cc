@@ -0,0 +1,212 @@
+#include "checkpoint.h"
+#include "bscache.h"
+#include "timeline.h"
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+
+static_assert(std::is_trivially_copyable<CheckpointHeader>::value, "CheckpointHeader is written as is");
+static_assert(sizeof(CheckpointHeader) == 104, "CheckpointHeader layout changed, bump the version");
+
+//------------------------------------------------------------------------------
+/**
+*/
+CheckpointHeader
+MakeCheckpointHeader(const Raytracer& rt)
+{
+    CheckpointHeader header;
+    header.width = uint32_t(rt.width);
+    header.height = uint32_t(rt.height);
+    header.raysPerPixel = uint32_t(rt.rpp);
+    header.bounces = uint32_t(rt.bounces);
+    header.frameIndex = uint32_t(rt.frameIndex);
+    header.sceneHash = HashSceneSpheres(rt.scene);
+    header.view = rt.view;
+    return header;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+CheckpointMatches(const CheckpointHeader& header, const Raytracer& rt)
+{
+    return header.width == rt.width &&
+        header.height == rt.height &&
+        header.raysPerPixel == rt.rpp &&
+        header.bounces == rt.bounces &&
+        header.sceneHash == HashSceneSpheres(rt.scene) &&
+        memcmp(&header.view, &rt.view, sizeof(mat4)) == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SaveCheckpoint(const std::string& path, const CheckpointHeader& header, const Color* sum)
+{
+    // the old checkpoint stays intact until the new one is complete, other writers use temporary files of their own
+    std::string tempPath = UniqueTempPath(path);
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    size_t count = size_t(header.width) * header.height;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(sum, sizeof(Color), count, file) == count;
+    ok = fclose(file) == 0 && ok;
+
+    std::error_code error;
+    if (ok)
+    {
+        std::filesystem::rename(tempPath, path, error);
+        ok = !error;
+    }
+
+    if (!ok)
+        std::filesystem::remove(tempPath, error);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadCheckpoint(const std::string& path, CheckpointHeader& header, std::vector<Color>& sum)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == CHECKPOINT_MAGIC &&
+        header.version == CHECKPOINT_VERSION &&
+        header.frameIndex > 0;
+
+    if (ok)
+    {
+        size_t count = size_t(header.width) * header.height;
+        sum.resize(count);
+        ok = fread(sum.data(), sizeof(Color), count, file) == count;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+CheckpointWriter::CheckpointWriter(const std::string& path) :
+    path(path),
+    pending(-1),
+    writing(-1),
+    writtenCount(0),
+    failedCount(0),
+    stop(false)
+{
+    thread = std::thread(&CheckpointWriter::Run, this);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CheckpointWriter::Submit(const CheckpointHeader& header, const Color* sum)
+{
+    int index;
+    {
+        // take over the buffer that isn't being written, dropping a checkpoint still waiting in it
+        std::lock_guard<std::mutex> lock(mutex);
+        index = writing == 0 ? 1 : 0;
+        if (pending == index)
+            pending = -1;
+    }
+
+    // copy without the lock, the writer thread never picks a buffer that isn't pending
+    Buffer& buffer = buffers[index];
+    buffer.header = header;
+    buffer.sum.assign(sum, sum + size_t(header.width) * header.height);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = index;
+    }
+    wake.notify_one();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CheckpointWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == -1 && writing == -1; });
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+CheckpointWriter::WrittenCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return writtenCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+CheckpointWriter::FailedCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failedCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CheckpointWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return pending != -1 || stop; });
+        if (pending == -1)
+            break;
+
+        writing = pending;
+        pending = -1;
+        lock.unlock();
+
+        const Buffer& buffer = buffers[writing];
+        bool ok;
+        {
+            Timeline::SetThreadName("checkpoint writer");
+            TIMELINE_SCOPE("SaveCheckpoint");
+            ok = SaveCheckpoint(path, buffer.header, buffer.sum.data());
+        }
+
+        lock.lock();
+        writing = -1;
+        ok ? writtenCount++ : failedCount++;
+        done.notify_all();
+    }
+}
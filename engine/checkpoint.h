@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "raytracer.h"
+
+#define CHECKPOINT_MAGIC 0x50434252 // "RBCP"
+#define CHECKPOINT_VERSION 3
+
+//------------------------------------------------------------------------------
+/**
+    Header of a progressive render checkpoint, followed by width * height
+    Colors of the accumulation buffer in framebuffer order.
+
+    Every sample is seeded from its pixel and its index over the whole
+    render, so frameIndex is the complete RNG state and a render can be
+    resumed with any number of threads.
+*/
+struct CheckpointHeader
+{
+    uint32_t magic = CHECKPOINT_MAGIC;
+    uint32_t version = CHECKPOINT_VERSION;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t raysPerPixel = 0;
+    uint32_t bounces = 0;
+    uint32_t reserved = 0;
+    // frames accumulated so far
+    uint32_t frameIndex = 0;
+    // sphere hash of the scene, see HashSceneSpheres
+    uint64_t sceneHash = 0;
+    mat4 view = {};
+};
+
+// capture the Raytracer's current render settings and frame index
+CheckpointHeader MakeCheckpointHeader(const Raytracer& rt);
+
+// true if rt renders the same image the checkpoint was taken from
+bool CheckpointMatches(const CheckpointHeader& header, const Raytracer& rt);
+
+// store a checkpoint through a temporary file, so a kill never leaves a partial one behind
+bool SaveCheckpoint(const std::string& path, const CheckpointHeader& header, const Color* sum);
+
+// load a checkpoint, fails on a bad header or a truncated file
+bool LoadCheckpoint(const std::string& path, CheckpointHeader& header, std::vector<Color>& sum);
+
+//------------------------------------------------------------------------------
+/**
+    Writes checkpoints on a background thread while rendering continues.
+
+    Two buffers are used: the writer thread stores one while Submit fills the
+    other. A checkpoint that is still waiting when the next one is submitted
+    is replaced by it, so a slow disk drops checkpoints instead of stalling
+    the render. Submit only copies the accumulation buffer.
+*/
+class CheckpointWriter
+{
+public:
+    CheckpointWriter(const std::string& path);
+    // stores whatever is still pending
+    ~CheckpointWriter();
+
+    // hand a copy of the current state to the writer thread
+    void Submit(const CheckpointHeader& header, const Color* sum);
+
+    // wait until everything submitted so far is on disk
+    void Flush();
+
+    // number of checkpoints stored and failed so far
+    size_t WrittenCount();
+    size_t FailedCount();
+
+private:
+    struct Buffer
+    {
+        CheckpointHeader header;
+        std::vector<Color> sum;
+    };
+
+    void Run();
+
+    std::string path;
+    Buffer buffers[2];
+    // buffer waiting to be written and buffer being written, -1 if none
+    int pending;
+    int writing;
+    size_t writtenCount;
+    size_t failedCount;
+    bool stop;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::thread thread;
+};
@@ -0,0 +1,404 @@
+#include "cpudispatch.h"
+#include <math.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// msvc compiles intrinsics of any instruction set as is, gcc and clang need them enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,popcnt")))
+#endif
+
+// same as IntersectSphere's minimum distance
+#define CULL_MIN_DISTANCE 0.001f
+
+//------------------------------------------------------------------------------
+/**
+    Early outs like IntersectSphere, a branch per sphere is cheaper than the
+    square root without vectors. Also finishes the lanes the wide kernels leave over
+*/
+static size_t
+CullRange(const float* x, const float* y, const float* z, const float* radius, size_t first, size_t end,
+    const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits, size_t hitCount)
+{
+    float invA = 1.f / dirDot;
+    for (size_t i = first; i < end; i++)
+    {
+        float ocx = origin[0] - x[i];
+        float ocy = origin[1] - y[i];
+        float ocz = origin[2] - z[i];
+        float ocDot = ocx * ocx + ocy * ocy + ocz * ocz;
+        float r2 = radius[i] * radius[i];
+        if (ocDot < r2)
+        {
+            hits[hitCount++] = uint32_t(i);
+            continue;
+        }
+
+        float b = ocx * dir[0] + ocy * dir[1] + ocz * dir[2];
+        if (b > 0.f)
+            continue;
+
+        float disc = b * b - dirDot * (ocDot - r2);
+        if (disc <= 0.f)
+            continue;
+
+        float s = sqrtf(disc);
+        float d = (-b - s) * invA;
+        if (d < CULL_MIN_DISTANCE)
+            d = (-b + s) * invA;
+        if (d <= maxDistance)
+            hits[hitCount++] = uint32_t(i);
+    }
+    return hitCount;
+}
+
+static size_t
+CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius, size_t count,
+    const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits)
+{
+    return CullRange(x, y, z, radius, 0, count, origin, dir, dirDot, maxDistance, hits, 0);
+}
+
+static void
+QuantizeScalar(const float* in, size_t count, uint8_t* out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float v = in[i];
+        v = v > 0.f ? v : 0.f;
+        v = v < 1.f ? v : 1.f;
+        out[i] = uint8_t(255.99f * v);
+    }
+}
+
+#ifdef CPU_X86
+
+// branch free append of the lanes set in mask
+static inline size_t
+EmitHits(uint32_t mask, int lanes, size_t first, uint32_t* hits, size_t hitCount)
+{
+    for (int j = 0; j < lanes; j++)
+    {
+        hits[hitCount] = uint32_t(first + j);
+        hitCount += (mask >> j) & 1;
+    }
+    return hitCount;
+}
+
+TARGET_SSE41 static size_t
+CullSpheresSSE41(const float* x, const float* y, const float* z, const float* radius, size_t count,
+    const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits)
+{
+    const __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+    const __m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+    const __m128 a = _mm_set1_ps(dirDot), invA = _mm_set1_ps(1.f / dirDot);
+    const __m128 maxD = _mm_set1_ps(maxDistance), minD = _mm_set1_ps(CULL_MIN_DISTANCE), zero = _mm_setzero_ps();
+
+    size_t i = 0;
+    size_t hitCount = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(x + i));
+        __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(y + i));
+        __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(z + i));
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        __m128 ocDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+        __m128 r = _mm_loadu_ps(radius + i);
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, _mm_sub_ps(ocDot, r2)));
+        __m128 s = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+        __m128 nb = _mm_sub_ps(zero, b);
+        __m128 d1 = _mm_mul_ps(_mm_sub_ps(nb, s), invA);
+        __m128 d2 = _mm_mul_ps(_mm_add_ps(nb, s), invA);
+        __m128 d = _mm_blendv_ps(d1, d2, _mm_cmplt_ps(d1, minD));
+
+        __m128 ahead = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(b, zero), _mm_cmpgt_ps(disc, zero)), _mm_cmple_ps(d, maxD));
+        __m128 hit = _mm_or_ps(_mm_cmplt_ps(ocDot, r2), ahead);
+        hitCount = EmitHits(uint32_t(_mm_movemask_ps(hit)), 4, i, hits, hitCount);
+    }
+    return CullRange(x, y, z, radius, i, count, origin, dir, dirDot, maxDistance, hits, hitCount);
+}
+
+TARGET_AVX2 static size_t
+CullSpheresAVX2(const float* x, const float* y, const float* z, const float* radius, size_t count,
+    const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits)
+{
+    const __m256 ox = _mm256_set1_ps(origin[0]), oy = _mm256_set1_ps(origin[1]), oz = _mm256_set1_ps(origin[2]);
+    const __m256 dx = _mm256_set1_ps(dir[0]), dy = _mm256_set1_ps(dir[1]), dz = _mm256_set1_ps(dir[2]);
+    const __m256 a = _mm256_set1_ps(dirDot), invA = _mm256_set1_ps(1.f / dirDot);
+    const __m256 maxD = _mm256_set1_ps(maxDistance), minD = _mm256_set1_ps(CULL_MIN_DISTANCE), zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    size_t hitCount = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(x + i));
+        __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(y + i));
+        __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(z + i));
+        __m256 b = _mm256_fmadd_ps(ocz, dz, _mm256_fmadd_ps(ocy, dy, _mm256_mul_ps(ocx, dx)));
+        __m256 ocDot = _mm256_fmadd_ps(ocz, ocz, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocx, ocx)));
+        __m256 r = _mm256_loadu_ps(radius + i);
+        __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 disc = _mm256_fmsub_ps(b, b, _mm256_mul_ps(a, _mm256_sub_ps(ocDot, r2)));
+        __m256 s = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+        __m256 nb = _mm256_sub_ps(zero, b);
+        __m256 d1 = _mm256_mul_ps(_mm256_sub_ps(nb, s), invA);
+        __m256 d2 = _mm256_mul_ps(_mm256_add_ps(nb, s), invA);
+        __m256 d = _mm256_blendv_ps(d1, d2, _mm256_cmp_ps(d1, minD, _CMP_LT_OQ));
+
+        __m256 ahead = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b, zero, _CMP_LE_OQ), _mm256_cmp_ps(disc, zero, _CMP_GT_OQ)), _mm256_cmp_ps(d, maxD, _CMP_LE_OQ));
+        __m256 hit = _mm256_or_ps(_mm256_cmp_ps(ocDot, r2, _CMP_LT_OQ), ahead);
+        hitCount = EmitHits(uint32_t(_mm256_movemask_ps(hit)), 8, i, hits, hitCount);
+    }
+    return CullRange(x, y, z, radius, i, count, origin, dir, dirDot, maxDistance, hits, hitCount);
+}
+
+TARGET_AVX512 static size_t
+CullSpheresAVX512(const float* x, const float* y, const float* z, const float* radius, size_t count,
+    const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits)
+{
+    const __m512 ox = _mm512_set1_ps(origin[0]), oy = _mm512_set1_ps(origin[1]), oz = _mm512_set1_ps(origin[2]);
+    const __m512 dx = _mm512_set1_ps(dir[0]), dy = _mm512_set1_ps(dir[1]), dz = _mm512_set1_ps(dir[2]);
+    const __m512 a = _mm512_set1_ps(dirDot), invA = _mm512_set1_ps(1.f / dirDot);
+    const __m512 maxD = _mm512_set1_ps(maxDistance), minD = _mm512_set1_ps(CULL_MIN_DISTANCE), zero = _mm512_setzero_ps();
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    size_t i = 0;
+    size_t hitCount = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(x + i));
+        __m512 ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(y + i));
+        __m512 ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(z + i));
+        __m512 b = _mm512_fmadd_ps(ocz, dz, _mm512_fmadd_ps(ocy, dy, _mm512_mul_ps(ocx, dx)));
+        __m512 ocDot = _mm512_fmadd_ps(ocz, ocz, _mm512_fmadd_ps(ocy, ocy, _mm512_mul_ps(ocx, ocx)));
+        __m512 r = _mm512_loadu_ps(radius + i);
+        __m512 r2 = _mm512_mul_ps(r, r);
+        __m512 disc = _mm512_fmsub_ps(b, b, _mm512_mul_ps(a, _mm512_sub_ps(ocDot, r2)));
+        __m512 s = _mm512_sqrt_ps(_mm512_max_ps(disc, zero));
+        __m512 nb = _mm512_sub_ps(zero, b);
+        __m512 d1 = _mm512_mul_ps(_mm512_sub_ps(nb, s), invA);
+        __m512 d2 = _mm512_mul_ps(_mm512_add_ps(nb, s), invA);
+        __m512 d = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(d1, minD, _CMP_LT_OQ), d1, d2);
+
+        __mmask16 ahead = _mm512_cmp_ps_mask(b, zero, _CMP_LE_OQ) & _mm512_cmp_ps_mask(disc, zero, _CMP_GT_OQ) & _mm512_cmp_ps_mask(d, maxD, _CMP_LE_OQ);
+        __mmask16 hit = _mm512_cmp_ps_mask(ocDot, r2, _CMP_LT_OQ) | ahead;
+
+        // packs the indices of the hit lanes to the front
+        _mm512_mask_compressstoreu_epi32(hits + hitCount, hit, _mm512_add_epi32(_mm512_set1_epi32(int(i)), lanes));
+        hitCount += _mm_popcnt_u32(hit);
+    }
+    return CullRange(x, y, z, radius, i, count, origin, dir, dirDot, maxDistance, hits, hitCount);
+}
+
+//------------------------------------------------------------------------------
+/**
+    max before min, so NaN takes the zero like the scalar version
+*/
+TARGET_SSE41 static void
+QuantizeSSE41(const float* in, size_t count, uint8_t* out)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), scale = _mm_set1_ps(255.99f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i q[4];
+        for (int j = 0; j < 4; j++)
+        {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + j * 4), zero), one);
+            q[j] = _mm_cvttps_epi32(_mm_mul_ps(v, scale));
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        _mm_storeu_si128((__m128i*)(out + i), bytes);
+    }
+    QuantizeScalar(in + i, count - i, out + i);
+}
+
+TARGET_AVX2 static void
+QuantizeAVX2(const float* in, size_t count, uint8_t* out)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), scale = _mm256_set1_ps(255.99f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 v0 = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), zero), one);
+        __m256 v1 = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i + 8), zero), one);
+        __m256i q0 = _mm256_cvttps_epi32(_mm256_mul_ps(v0, scale));
+        __m256i q1 = _mm256_cvttps_epi32(_mm256_mul_ps(v1, scale));
+        // packs work within 128 bit lanes, the permute puts the words of q0 and q1 back in order
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1), 0xD8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128((__m128i*)(out + i), bytes);
+    }
+    QuantizeScalar(in + i, count - i, out + i);
+}
+
+TARGET_AVX512 static void
+QuantizeAVX512(const float* in, size_t count, uint8_t* out)
+{
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.f), scale = _mm512_set1_ps(255.99f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(in + i), zero), one);
+        _mm_storeu_si128((__m128i*)(out + i), _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(_mm512_mul_ps(v, scale))));
+    }
+    QuantizeScalar(in + i, count - i, out + i);
+}
+
+static void
+CpuId(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = unsigned(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state the OS saves on context switches
+static uint64_t
+ReadXcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (uint64_t(hi) << 32) | lo;
+#endif
+}
+
+#endif
+
+static const CpuKernels kernelTable[int(CpuLevel::Count)] =
+{
+    { CpuLevel::Scalar, CullSpheresScalar, QuantizeScalar },
+#ifdef CPU_X86
+    { CpuLevel::SSE41, CullSpheresSSE41, QuantizeSSE41 },
+    { CpuLevel::AVX2, CullSpheresAVX2, QuantizeAVX2 },
+    { CpuLevel::AVX512, CullSpheresAVX512, QuantizeAVX512 },
+#else
+    // never selected, DetectCpuLevel stays at scalar
+    { CpuLevel::SSE41, CullSpheresScalar, QuantizeScalar },
+    { CpuLevel::AVX2, CullSpheresScalar, QuantizeScalar },
+    { CpuLevel::AVX512, CullSpheresScalar, QuantizeScalar },
+#endif
+};
+
+static std::atomic<const CpuKernels*> currentKernels(nullptr);
+
+//------------------------------------------------------------------------------
+/**
+    Wide registers only count if the OS saves them, which xgetbv tells
+*/
+CpuLevel
+DetectCpuLevel()
+{
+#ifdef CPU_X86
+    unsigned int regs[4];
+    CpuId(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    bool sse41 = (regs[2] & (1u << 19)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    bool fma = (regs[2] & (1u << 12)) != 0;
+    if (!sse41)
+        return CpuLevel::Scalar;
+
+    uint64_t xcr0 = osxsave ? ReadXcr0() : 0;
+    bool avxState = (xcr0 & 0x6) == 0x6;
+    bool avx512State = (xcr0 & 0xE6) == 0xE6;
+
+    bool avx2 = false;
+    bool avx512f = false;
+    if (maxLeaf >= 7)
+    {
+        CpuId(7, 0, regs);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+        avx512f = (regs[1] & (1u << 16)) != 0;
+    }
+
+    if (avx && avx2 && fma && avxState)
+        return avx512f && avx512State ? CpuLevel::AVX512 : CpuLevel::AVX2;
+    return CpuLevel::SSE41;
+#else
+    return CpuLevel::Scalar;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const CpuKernels&
+GetCpuKernels()
+{
+    const CpuKernels* kernels = currentKernels.load(std::memory_order_acquire);
+    if (kernels == nullptr)
+    {
+        kernels = &kernelTable[int(DetectCpuLevel())];
+        currentKernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SetCpuLevel(CpuLevel level)
+{
+    if (int(level) > int(DetectCpuLevel()))
+        return false;
+
+    currentKernels.store(&kernelTable[int(level)], std::memory_order_release);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const char*
+GetCpuLevelName(CpuLevel level)
+{
+    static const char* names[] = { "scalar", "sse4.1", "avx2", "avx512" };
+    return names[int(level)];
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+CpuLevelFromName(const char* name, CpuLevel& level)
+{
+    for (int i = 0; i < int(CpuLevel::Count); i++)
+    {
+        if (strcmp(name, GetCpuLevelName(CpuLevel(i))) == 0)
+        {
+            level = CpuLevel(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+enum class CpuLevel
+{
+    // plain C++, any cpu
+    Scalar,
+    // 4 lanes
+    SSE41,
+    // 8 lanes with fma
+    AVX2,
+    // 16 lanes with mask registers
+    AVX512,
+    Count
+};
+
+//------------------------------------------------------------------------------
+/**
+    Hot kernels compiled once per instruction set. The build has no ISA
+    flags, every variant is compiled for its own target inside the one
+    translation unit and the best one this cpu and OS support is picked on
+    first use.
+*/
+struct CpuKernels
+{
+    CpuLevel level;
+
+    // indices below count of the spheres a ray may hit closer than maxDistance, or that contain its origin.
+    // dirDot is dot(dir, dir). writes to hits, which has room for count, and returns how many there are.
+    // conservative, same decisions as IntersectSphere up to rounding
+    size_t (*cullSpheres)(const float* x, const float* y, const float* z, const float* radius, size_t count,
+        const float origin[3], const float dir[3], float dirDot, float maxDistance, uint32_t* hits);
+
+    // clamp to [0,1] and map to 0-255, NaN ends up as 0
+    void (*quantize)(const float* in, size_t count, uint8_t* out);
+};
+
+// best level this cpu and OS support
+CpuLevel DetectCpuLevel();
+
+// kernels in use, the detected level unless overridden
+const CpuKernels& GetCpuKernels();
+
+// use the kernels of a lower level, e.g. to benchmark each. false if the cpu can't run level
+bool SetCpuLevel(CpuLevel level);
+
+const char* GetCpuLevelName(CpuLevel level);
+
+// level from its name, "scalar", "sse4.1", "avx2" or "avx512". false if it isn't known
+bool CpuLevelFromName(const char* name, CpuLevel& level);
@@ -0,0 +1,355 @@
+#include "deflate.h"
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/**
+    Fixed huffman codes from RFC 1951 3.2.6, stored bit reversed so they can be
+    written least significant bit first like everything else in the stream
+*/
+struct FixedCodes
+{
+    uint16_t literalCode[288];
+    uint8_t literalLength[288];
+    uint16_t distanceCode[30];
+
+    // match length 3..258 to length symbol index 0..28
+    uint8_t lengthIndex[DEFLATE_MAX_MATCH + 1];
+    // distance-1 to distance symbol, direct below 256 and by distance >> 7 above
+    uint8_t distanceIndex[512];
+
+    static const uint16_t lengthBase[29];
+    static const uint8_t lengthExtra[29];
+    static const uint16_t distanceBase[30];
+    static const uint8_t distanceExtra[30];
+
+    FixedCodes();
+};
+
+const uint16_t FixedCodes::lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t FixedCodes::lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t FixedCodes::distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t FixedCodes::distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint16_t
+ReverseBits(uint32_t code, int length)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < length; i++)
+        result |= ((code >> i) & 1) << (length - 1 - i);
+    return uint16_t(result);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FixedCodes::FixedCodes()
+{
+    for (int symbol = 0; symbol < 288; symbol++)
+    {
+        uint32_t code;
+        int length;
+        if (symbol < 144)
+            code = 0x30 + symbol, length = 8;
+        else if (symbol < 256)
+            code = 0x190 + symbol - 144, length = 9;
+        else if (symbol < 280)
+            code = symbol - 256, length = 7;
+        else
+            code = 0xc0 + symbol - 280, length = 8;
+
+        literalCode[symbol] = ReverseBits(code, length);
+        literalLength[symbol] = uint8_t(length);
+    }
+
+    for (int symbol = 0; symbol < 30; symbol++)
+        distanceCode[symbol] = ReverseBits(symbol, 5);
+
+    for (int index = 0; index < 29; index++)
+    {
+        int end = index == 28 ? DEFLATE_MAX_MATCH + 1 : lengthBase[index + 1];
+        for (int length = lengthBase[index]; length < end; length++)
+            lengthIndex[length] = uint8_t(index);
+    }
+
+    for (int index = 0; index < 30; index++)
+    {
+        int end = index == 29 ? DEFLATE_WINDOW + 1 : distanceBase[index + 1];
+        for (int distance = distanceBase[index]; distance < end; distance++)
+        {
+            int slot = distance - 1 < 256 ? distance - 1 : 256 + ((distance - 1) >> 7);
+            distanceIndex[slot] = uint8_t(index);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const FixedCodes&
+GetFixedCodes()
+{
+    static const FixedCodes codes;
+    return codes;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Accumulates bits least significant first and appends whole bytes
+*/
+struct BitWriter
+{
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    BitWriter(std::vector<uint8_t>& out) : out(out)
+    {}
+
+    void Write(uint32_t value, int length)
+    {
+        bits |= uint64_t(value) << count;
+        count += length;
+        if (count >= 32)
+        {
+            uint8_t bytes[4] = { uint8_t(bits), uint8_t(bits >> 8), uint8_t(bits >> 16), uint8_t(bits >> 24) };
+            out.insert(out.end(), bytes, bytes + 4);
+            bits >>= 32;
+            count -= 32;
+        }
+    }
+
+    // pad to a byte boundary and write out everything
+    void Flush()
+    {
+        while (count > 0)
+        {
+            out.push_back(uint8_t(bits));
+            bits >>= 8;
+            count = count > 8 ? count - 8 : 0;
+        }
+        bits = 0;
+    }
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline uint32_t
+Hash3(const uint8_t* p)
+{
+    uint32_t value = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DeflatePiece(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    const FixedCodes& codes = GetFixedCodes();
+    size_t start = out.size();
+    BitWriter writer(out);
+    out.reserve(out.size() + size / 2 + 64);
+
+    // one fixed huffman block: BFINAL = 0, BTYPE = 01
+    writer.Write(0x2, 3);
+
+    std::vector<int32_t> head(size_t(1) << DEFLATE_HASH_BITS, -1);
+    size_t i = 0;
+
+    while (i + DEFLATE_MIN_MATCH <= size)
+    {
+        uint32_t hash = Hash3(data + i);
+        int32_t candidate = head[hash];
+        head[hash] = int32_t(i);
+
+        size_t matchLength = 0;
+        if (candidate >= 0 && i - size_t(candidate) <= DEFLATE_WINDOW)
+        {
+            const uint8_t* a = data + candidate;
+            const uint8_t* b = data + i;
+            size_t maxLength = size - i < DEFLATE_MAX_MATCH ? size - i : DEFLATE_MAX_MATCH;
+            while (matchLength < maxLength && a[matchLength] == b[matchLength])
+                matchLength++;
+        }
+
+        if (matchLength >= DEFLATE_MIN_MATCH)
+        {
+            size_t distance = i - size_t(candidate);
+            int lengthIndex = codes.lengthIndex[matchLength];
+            int symbol = 257 + lengthIndex;
+            writer.Write(codes.literalCode[symbol], codes.literalLength[symbol]);
+            writer.Write(uint32_t(matchLength - FixedCodes::lengthBase[lengthIndex]), FixedCodes::lengthExtra[lengthIndex]);
+
+            int distanceIndex = codes.distanceIndex[distance - 1 < 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+            writer.Write(codes.distanceCode[distanceIndex], 5);
+            writer.Write(uint32_t(distance - FixedCodes::distanceBase[distanceIndex]), FixedCodes::distanceExtra[distanceIndex]);
+
+            // keep the hash table fresh inside the match, cheap and helps runs a lot
+            size_t end = i + matchLength;
+            for (i++; i < end && i + DEFLATE_MIN_MATCH <= size; i++)
+                head[Hash3(data + i)] = int32_t(i);
+            i = end;
+        }
+        else
+        {
+            writer.Write(codes.literalCode[data[i]], codes.literalLength[data[i]]);
+            i++;
+        }
+    }
+
+    for (; i < size; i++)
+        writer.Write(codes.literalCode[data[i]], codes.literalLength[data[i]]);
+
+    // end of block
+    writer.Write(codes.literalCode[256], codes.literalLength[256]);
+
+    // sync flush: empty stored block, leaves the stream byte aligned
+    writer.Write(0x0, 3);
+    writer.Flush();
+    const uint8_t storedLength[4] = { 0x00, 0x00, 0xff, 0xff };
+    out.insert(out.end(), storedLength, storedLength + 4);
+
+    // incompressible data, store it instead. every stored block is byte aligned already
+    size_t storedSize = size + (size / 65535 + 1) * 5;
+    if (out.size() - start > storedSize)
+    {
+        out.resize(start);
+        size_t offset = 0;
+        do
+        {
+            size_t length = size - offset < 65535 ? size - offset : 65535;
+            const uint8_t header[5] = { 0x00, uint8_t(length), uint8_t(length >> 8), uint8_t(~length), uint8_t(~length >> 8) };
+            out.insert(out.end(), header, header + 5);
+            out.insert(out.end(), data + offset, data + offset + length);
+            offset += length;
+        } while (offset < size);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DeflateFinish(std::vector<uint8_t>& out)
+{
+    // BFINAL = 1, BTYPE = 01, followed by the 7 bit end of block code
+    out.push_back(0x03);
+    out.push_back(0x00);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+ZlibCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    // deflate with a 32k window, fastest compression level
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    DeflatePiece(data, size, out);
+    DeflateFinish(out);
+
+    uint32_t adler = Adler32(data, size);
+    const uint8_t trailer[4] = { uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler) };
+    out.insert(out.end(), trailer, trailer + 4);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+Adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+    constexpr uint32_t base = 65521;
+    // largest block that can't overflow the 32 bit sums
+    constexpr size_t blockSize = 5552;
+
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+
+    while (size > 0)
+    {
+        size_t count = size < blockSize ? size : blockSize;
+        size -= count;
+        for (size_t i = 0; i < count; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        data += count;
+        a %= base;
+        b %= base;
+    }
+
+    return a | (b << 16);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Same as adler32_combine in zlib
+*/
+uint32_t
+Adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2)
+{
+    constexpr uint32_t base = 65521;
+
+    uint32_t remainder = uint32_t(length2 % base);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = uint32_t((uint64_t(remainder) * sum1) % base);
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - remainder;
+
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= (base << 1)) sum2 -= (base << 1);
+    if (sum2 >= base) sum2 -= base;
+
+    return sum1 | (sum2 << 16);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+Crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    struct Table
+    {
+        uint32_t entries[256];
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+        }
+    };
+    static const Table table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
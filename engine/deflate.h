@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//------------------------------------------------------------------------------
+/**
+    Fast single pass deflate with fixed huffman codes and a one-probe LZ77
+    match finder. Trades some compression ratio for speed.
+
+    Every call produces raw deflate blocks that end byte aligned with a sync
+    flush and never reference data from earlier calls, so pieces compressed
+    independently on different threads can simply be concatenated into one
+    stream, which is then terminated with DeflateFinish.
+*/
+void DeflatePiece(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// append the empty final block that terminates a stream of pieces
+void DeflateFinish(std::vector<uint8_t>& out);
+
+// complete zlib stream (header, deflate data, adler32) of a single buffer
+void ZlibCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// adler32 checksum, start with 1
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+
+// adler32 of two concatenated buffers from their separate checksums
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2);
+
+// crc32 as used by png and gzip, start with 0
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
@@ -0,0 +1,114 @@
+#pragma once
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <cmath>
+#include "float4.h"
+#include "vec3.h"
+
+//------------------------------------------------------------------------------
+/**
+    Approximations for the shading code. Largest errors against double
+    precision, as measured by "bench -filter accuracy" on SSE builds with and
+    without FMA:
+
+    ApproxExp2      relative 1.7e-7, x in [-126, 127] in steps of 1e-4
+    ApproxSinCos    absolute 9.4e-8 for sin and cos, x in [-8192, 8192] in steps of 1e-3
+    ApproxRsqrt     relative 2.8e-7, every 97th normal positive float
+
+    Without SSE ApproxRsqrt is 1 / sqrt, measured at 8.9e-8 the same way.
+
+    Exp2, SinCos, Rsqrt and Normalize are what pbr.h and material.cc call.
+    They use the approximations when built with FAST_MATH and the C library
+    otherwise.
+*/
+
+//------------------------------------------------------------------------------
+/**
+    2^i * 2^f with i the nearest integer, f in [-0.5, 0.5] goes through a
+    degree 5 polynomial fitted for relative error. x is clamped to [-126, 127]
+*/
+inline float
+ApproxExp2(float x)
+{
+    x = x > -126.f ? x : -126.f;
+    x = x < 127.f ? x : 127.f;
+    int i = int(x + (x >= 0.f ? 0.5f : -0.5f));
+    float f = x - float(i);
+
+    float p = 1.f + f * (0.693146978f + f * (0.240222421f + f * (0.0555073375f + f * (0.00967151287f + f * 0.00132647239f))));
+
+    uint32_t bits = uint32_t(i + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Reduced to [-pi/4, pi/4] by the nearest multiple of pi/2, which is split
+    in three so the remainder stays exact, then the cephes polynomials
+*/
+inline void
+ApproxSinCos(float x, float& s, float& c)
+{
+    // adding 1.5 * 2^23 rounds to the nearest integer and leaves it in the low mantissa bits
+    float shifted = x * 0.636619772f + 12582912.f;
+    float fq = shifted - 12582912.f;
+    uint32_t quadrant;
+    memcpy(&quadrant, &shifted, sizeof(quadrant));
+    float r = ((x - fq * 1.5703125f) - fq * 4.837512969970703125e-4f) - fq * 7.54978995489188216e-8f;
+
+    float r2 = r * r;
+    float sr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    float cr = 1.f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+    // rotate by the quadrant with bit operations, the quadrant of random angles would defeat branch prediction
+    uint32_t sinBits, cosBits;
+    memcpy(&sinBits, &sr, sizeof(sinBits));
+    memcpy(&cosBits, &cr, sizeof(cosBits));
+    uint32_t swap = 0u - (quadrant & 1);
+    uint32_t sBits = ((sinBits & ~swap) | (cosBits & swap)) ^ ((quadrant & 2) << 30);
+    uint32_t cBits = ((cosBits & ~swap) | (sinBits & swap)) ^ (((quadrant + 1) & 2) << 30);
+    memcpy(&s, &sBits, sizeof(s));
+    memcpy(&c, &cBits, sizeof(c));
+}
+
+//------------------------------------------------------------------------------
+/**
+    The 12 bit hardware estimate and one Newton step. Without SSE this is the
+    exact 1 / sqrt
+*/
+inline float
+ApproxRsqrt(float x)
+{
+#ifdef FLOAT4_SSE
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f * x * y * y);
+#else
+    return 1.f / std::sqrt(x);
+#endif
+}
+
+#ifdef FAST_MATH
+
+inline float Exp2(float x) { return ApproxExp2(x); }
+inline void SinCos(float x, float& s, float& c) { ApproxSinCos(x, s, c); }
+inline float Rsqrt(float x) { return ApproxRsqrt(x); }
+
+// zero vectors are returned as they are, like normalize
+inline vec3
+Normalize(const vec3& v)
+{
+    float lengthSquared = dot(v, v);
+    return lengthSquared != 0.f ? v * ApproxRsqrt(lengthSquared) : v;
+}
+
+#else
+
+inline float Exp2(float x) { return std::powf(2.f, x); }
+inline void SinCos(float x, float& s, float& c) { s = std::sin(x); c = std::cos(x); }
+inline float Rsqrt(float x) { return 1.f / std::sqrtf(x); }
+inline vec3 Normalize(const vec3& v) { return normalize(v); }
+
+#endif
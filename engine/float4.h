@@ -0,0 +1,118 @@
+#pragma once
+
+// sse2 is the x64 baseline, define FLOAT4_SCALAR to build the plain C++ version instead
+#if !defined(FLOAT4_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FLOAT4_SSE 1
+#include <immintrin.h>
+#endif
+
+// only with -mfma or /arch:AVX2, fused results round differently from mul then add
+#if defined(FLOAT4_SSE) && (defined(__FMA__) || defined(__AVX2__))
+#define FLOAT4_FMA 1
+#endif
+
+//------------------------------------------------------------------------------
+/**
+    @struct float4
+
+    Four floats in one register. Trivially copyable so it is passed and
+    returned in registers. The scalar version does the same operations in
+    the same order, so both give the same results unless FMA is on.
+*/
+#ifdef FLOAT4_SSE
+
+struct float4
+{
+    __m128 v;
+};
+
+inline float4 Load4(const float* p) { return { _mm_loadu_ps(p) }; }
+inline void Store4(float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+inline float4 Set4(float x, float y, float z, float w) { return { _mm_setr_ps(x, y, z, w) }; }
+inline float4 Splat(float s) { return { _mm_set1_ps(s) }; }
+
+inline float4 operator+(float4 a, float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline float4 operator-(float4 a, float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline float4 operator*(float4 a, float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline float4 operator/(float4 a, float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+
+// a * b + c
+inline float4
+MulAdd(float4 a, float4 b, float4 c)
+{
+#ifdef FLOAT4_FMA
+    return { _mm_fmadd_ps(a.v, b.v, c.v) };
+#else
+    return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) };
+#endif
+}
+
+// (a[X], a[Y], b[Z], b[W])
+template<int X, int Y, int Z, int W>
+inline float4
+Shuffle(float4 a, float4 b)
+{
+    return { _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(W, Z, Y, X)) };
+}
+
+inline float
+GetX(float4 a)
+{
+    return _mm_cvtss_f32(a.v);
+}
+
+#else
+
+struct alignas(16) float4
+{
+    float v[4];
+};
+
+inline float4 Load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void Store4(float* p, float4 a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+inline float4 Set4(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+inline float4 Splat(float s) { return { { s, s, s, s } }; }
+
+inline float4 operator+(float4 a, float4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+inline float4 operator-(float4 a, float4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+inline float4 operator*(float4 a, float4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+inline float4 operator/(float4 a, float4 b) { return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+
+// a * b + c
+inline float4
+MulAdd(float4 a, float4 b, float4 c)
+{
+    return a * b + c;
+}
+
+// (a[X], a[Y], b[Z], b[W])
+template<int X, int Y, int Z, int W>
+inline float4
+Shuffle(float4 a, float4 b)
+{
+    return { { a.v[X], a.v[Y], b.v[Z], b.v[W] } };
+}
+
+inline float
+GetX(float4 a)
+{
+    return a.v[0];
+}
+
+#endif
+
+// (a[X], a[Y], a[Z], a[W])
+template<int X, int Y, int Z, int W>
+inline float4
+Swizzle(float4 a)
+{
+    return Shuffle<X, Y, Z, W>(a, a);
+}
+
+// a[I] in every lane
+template<int I>
+inline float4
+Broadcast(float4 a)
+{
+    return Shuffle<I, I, I, I>(a, a);
+}
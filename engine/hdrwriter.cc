@@ -0,0 +1,473 @@
+#include "hdrwriter.h"
+#include "deflate.h"
+#include "threadpool.h"
+#include "timeline.h"
+#include <string.h>
+#include <ctype.h>
+
+// raw bytes per pfm slice
+#define HDR_SLICE_BYTES (1 << 20)
+// blocks per band and thread
+#define HDR_BLOCKS_PER_THREAD 4
+// scanlines per exr block, fixed by the format for zip and none
+#define EXR_ZIP_LINES 16
+#define EXR_NONE_LINES 1
+
+#define EXR_MAGIC 20000630
+#define EXR_VERSION 2
+#define EXR_TILED_FLAG 0x200
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/**
+    Round to nearest even, overflow goes to infinity and NaN stays NaN
+*/
+inline uint16_t
+FloatToHalf(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t bits = f & 0x7fffffff;
+
+    // inf and nan
+    if (bits >= 0x7f800000)
+        return uint16_t(sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0));
+    // 65520 and above round to infinity
+    if (bits >= 0x477ff000)
+        return uint16_t(sign | 0x7c00);
+
+    if (bits < 0x38800000)
+    {
+        // below half of the smallest subnormal
+        if (bits < 0x33000000)
+            return uint16_t(sign);
+
+        uint32_t exponent = bits >> 23;
+        uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            half++;
+        return uint16_t(sign | half);
+    }
+
+    // rebias the exponent from 127 to 15, a carry out of the mantissa is still correct
+    uint32_t half = (bits - 0x38000000) >> 13;
+    uint32_t remainder = bits & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        half++;
+    return uint16_t(sign | half);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+AppendBytes(std::vector<uint8_t>& out, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+AppendInt(std::vector<uint8_t>& out, int32_t value)
+{
+    AppendBytes(out, &value, sizeof(value));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+AppendAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const void* value, size_t size)
+{
+    AppendBytes(out, name, strlen(name) + 1);
+    AppendBytes(out, type, strlen(type) + 1);
+    AppendInt(out, int32_t(size));
+    AppendBytes(out, value, size);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+/**
+*/
+HdrFormat
+HdrFormatFromFilename(const char* filename)
+{
+    const char* extension = strrchr(filename, '.');
+    if (extension == nullptr)
+        return HdrFormat::EXR;
+
+    char lower[8] = {};
+    for (size_t i = 0; i < sizeof(lower) - 1 && extension[i] != 0; i++)
+        lower[i] = char(tolower(extension[i]));
+
+    if (strcmp(lower, ".pfm") == 0)
+        return HdrFormat::PFM;
+
+    return HdrFormat::EXR;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+HdrWriter::HdrWriter(size_t threadCount) :
+    ownThreads(new ThreadPool(threadCount == 0 ? 1 : threadCount)),
+    threads(ownThreads.get()),
+    pixels(nullptr),
+    width(0),
+    height(0),
+    scale(1.f),
+    format(HdrFormat::EXR),
+    blockLines(0),
+    bandStart(0),
+    bandEnd(0),
+    nextBlock(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+HdrWriter::HdrWriter(ThreadPool& threads) :
+    threads(&threads),
+    pixels(nullptr),
+    width(0),
+    height(0),
+    scale(1.f),
+    format(HdrFormat::EXR),
+    blockLines(0),
+    bandStart(0),
+    bandEnd(0),
+    nextBlock(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+HdrWriter::Save(const char* filename, const Color* pixels, size_t width, size_t height, float scale)
+{
+    return Save(filename, pixels, width, height, scale, HdrFormatFromFilename(filename));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+HdrWriter::Save(const char* filename, const Color* pixels, size_t width, size_t height, float scale, HdrFormat format, const ExrOptions& options)
+{
+    TIMELINE_SCOPE("HdrWriter::Save");
+    if (width == 0 || height == 0)
+        return false;
+
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr)
+        return false;
+
+    this->pixels = pixels;
+    this->width = width;
+    this->height = height;
+    this->scale = scale;
+    this->format = format;
+    this->options = options;
+
+    LayoutBlocks();
+
+    // exr chunk offsets are only known once the chunks are compressed
+    std::vector<uint64_t> offsets(blocks.size(), 0);
+    long tablePosition = 0;
+    uint64_t position = 0;
+
+    if (format == HdrFormat::EXR)
+    {
+        WriteExrHeader(file);
+        tablePosition = ftell(file);
+        fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+        position = uint64_t(tablePosition) + offsets.size() * sizeof(uint64_t);
+    }
+    else
+    {
+        // negative scale marks little endian data
+        fprintf(file, "PF\n%zu %zu\n-1.0\n", width, height);
+    }
+
+    bool ok = true;
+
+    for (size_t i = 0; i < threads->size; i++)
+        threads->InitThread<WorkArgs>(Work, { this }, i);
+
+    size_t bandSize = threads->size * HDR_BLOCKS_PER_THREAD;
+    for (bandStart = 0; bandStart < blocks.size() && ok; bandStart = bandEnd)
+    {
+        bandEnd = blocks.size() - bandStart < bandSize ? blocks.size() : bandStart + bandSize;
+        nextBlock = bandStart;
+        threads->ExecuteAndWait();
+
+        for (size_t i = bandStart; i < bandEnd; i++)
+        {
+            Block& block = blocks[i];
+            offsets[i] = position;
+            position += block.chunk.size();
+            ok = ok && fwrite(block.chunk.data(), 1, block.chunk.size(), file) == block.chunk.size();
+
+            // only a band is held in memory
+            std::vector<uint8_t>().swap(block.raw);
+            std::vector<uint8_t>().swap(block.chunk);
+        }
+    }
+
+    if (ok && format == HdrFormat::EXR)
+    {
+        ok = fseek(file, tablePosition, SEEK_SET) == 0 &&
+            fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+    }
+
+    ok = fclose(file) == 0 && ok;
+    blocks.clear();
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+HdrWriter::LayoutBlocks()
+{
+    blocks.clear();
+
+    if (format == HdrFormat::PFM)
+    {
+        // pfm rows are bottom up like the framebuffer, so slices are plain row ranges
+        size_t rowsPerSlice = HDR_SLICE_BYTES / (width * sizeof(Color));
+        rowsPerSlice = rowsPerSlice == 0 ? 1 : rowsPerSlice;
+        for (size_t y = 0; y < height; y += rowsPerSlice)
+        {
+            Block block;
+            block.y = y;
+            block.width = width;
+            block.height = height - y < rowsPerSlice ? height - y : rowsPerSlice;
+            blocks.push_back(block);
+        }
+        return;
+    }
+
+    if (options.tileSize > 0)
+    {
+        // increasing y order is row major over the tiles
+        size_t tile = options.tileSize;
+        for (size_t y = 0, tileY = 0; y < height; y += tile, tileY++)
+        {
+            for (size_t x = 0, tileX = 0; x < width; x += tile, tileX++)
+            {
+                Block block;
+                block.x = x;
+                block.y = y;
+                block.width = width - x < tile ? width - x : tile;
+                block.height = height - y < tile ? height - y : tile;
+                block.tileX = tileX;
+                block.tileY = tileY;
+                blocks.push_back(block);
+            }
+        }
+        return;
+    }
+
+    blockLines = options.compress ? EXR_ZIP_LINES : EXR_NONE_LINES;
+    for (size_t y = 0; y < height; y += blockLines)
+    {
+        Block block;
+        block.y = y;
+        block.width = width;
+        block.height = height - y < blockLines ? height - y : blockLines;
+        blocks.push_back(block);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+HdrWriter::Work(const WorkArgs& args)
+{
+    HdrWriter* self = args.self;
+    for (size_t i = self->nextBlock++; i < self->bandEnd; i = self->nextBlock++)
+    {
+        TIMELINE_SCOPE("hdr block");
+        self->ProcessBlock(self->blocks[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+HdrWriter::ProcessBlock(Block& block)
+{
+    if (format == HdrFormat::EXR)
+    {
+        ProcessExrBlock(block);
+        return;
+    }
+
+    size_t count = block.width * block.height;
+    block.chunk.resize(count * sizeof(Color));
+    float* out = (float*)block.chunk.data();
+    const float* in = &pixels[block.y * width].r;
+
+    for (size_t i = 0; i < count * 3; i++)
+        out[i] = in[i] * scale;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Lines of the block one after the other, each line holding all of its B,
+    then G, then R values. Channels are stored in alphabetical order.
+*/
+void
+HdrWriter::ProcessExrBlock(Block& block)
+{
+    size_t valueSize = options.halfFloat ? sizeof(uint16_t) : sizeof(float);
+    size_t lineBytes = block.width * 3 * valueSize;
+    block.raw.resize(block.height * lineBytes);
+
+    for (size_t line = 0; line < block.height; line++)
+    {
+        // framebuffer rows start at the bottom
+        const Color* row = pixels + (height - 1 - (block.y + line)) * width + block.x;
+        uint8_t* out = block.raw.data() + line * lineBytes;
+
+        for (int channel = 2; channel >= 0; channel--)
+        {
+            if (options.halfFloat)
+            {
+                uint16_t* values = (uint16_t*)out;
+                for (size_t x = 0; x < block.width; x++)
+                    values[x] = FloatToHalf((&row[x].r)[channel] * scale);
+            }
+            else
+            {
+                float* values = (float*)out;
+                for (size_t x = 0; x < block.width; x++)
+                    values[x] = (&row[x].r)[channel] * scale;
+            }
+            out += block.width * valueSize;
+        }
+    }
+
+    // chunk header, tile coordinates and level, or the first scanline
+    block.chunk.clear();
+    if (options.tileSize > 0)
+    {
+        AppendInt(block.chunk, int32_t(block.tileX));
+        AppendInt(block.chunk, int32_t(block.tileY));
+        AppendInt(block.chunk, 0);
+        AppendInt(block.chunk, 0);
+    }
+    else
+    {
+        AppendInt(block.chunk, int32_t(block.y));
+    }
+
+    size_t sizePosition = block.chunk.size();
+    AppendInt(block.chunk, 0);
+
+    bool stored = true;
+    if (options.compress)
+    {
+        // zip: split even and odd bytes, delta encode, then zlib
+        size_t size = block.raw.size();
+        std::vector<uint8_t> reordered(size);
+        uint8_t* even = reordered.data();
+        uint8_t* odd = reordered.data() + (size + 1) / 2;
+        for (size_t i = 0; i < size; i++)
+            (i & 1 ? *odd++ : *even++) = block.raw[i];
+
+        for (size_t i = size - 1; i > 0; i--)
+            reordered[i] = uint8_t(int(reordered[i]) - int(reordered[i - 1]) + 128);
+
+        ZlibCompress(reordered.data(), size, block.chunk);
+
+        // readers take a chunk as uncompressed when it isn't smaller
+        stored = block.chunk.size() - sizePosition - 4 >= size;
+        if (stored)
+            block.chunk.resize(sizePosition + 4);
+    }
+
+    if (stored)
+        AppendBytes(block.chunk, block.raw.data(), block.raw.size());
+
+    int32_t dataSize = int32_t(block.chunk.size() - sizePosition - 4);
+    memcpy(block.chunk.data() + sizePosition, &dataSize, sizeof(dataSize));
+}
+
+//------------------------------------------------------------------------------
+/**
+    Magic, version and the required attributes, see
+    https://openexr.com/en/latest/OpenEXRFileLayout.html
+*/
+void
+HdrWriter::WriteExrHeader(FILE* file)
+{
+    std::vector<uint8_t> header;
+    bool tiled = options.tileSize > 0;
+
+    AppendInt(header, EXR_MAGIC);
+    AppendInt(header, EXR_VERSION | (tiled ? EXR_TILED_FLAG : 0));
+
+    // name, pixel type, linear flag, 3 reserved bytes and the x and y sampling
+    std::vector<uint8_t> channels;
+    const char* names[3] = { "B", "G", "R" };
+    for (const char* name : names)
+    {
+        AppendBytes(channels, name, 2);
+        AppendInt(channels, options.halfFloat ? 1 : 2);
+        AppendInt(channels, 0);
+        AppendInt(channels, 1);
+        AppendInt(channels, 1);
+    }
+    channels.push_back(0);
+    AppendAttribute(header, "channels", "chlist", channels.data(), channels.size());
+
+    // NO_COMPRESSION or ZIP_COMPRESSION
+    uint8_t compression = options.compress ? 3 : 0;
+    AppendAttribute(header, "compression", "compression", &compression, 1);
+
+    const int32_t window[4] = { 0, 0, int32_t(width) - 1, int32_t(height) - 1 };
+    AppendAttribute(header, "dataWindow", "box2i", window, sizeof(window));
+    AppendAttribute(header, "displayWindow", "box2i", window, sizeof(window));
+
+    // INCREASING_Y
+    uint8_t lineOrder = 0;
+    AppendAttribute(header, "lineOrder", "lineOrder", &lineOrder, 1);
+
+    const float aspect = 1.f;
+    AppendAttribute(header, "pixelAspectRatio", "float", &aspect, sizeof(aspect));
+
+    const float center[2] = { 0.f, 0.f };
+    AppendAttribute(header, "screenWindowCenter", "v2f", center, sizeof(center));
+    AppendAttribute(header, "screenWindowWidth", "float", &aspect, sizeof(aspect));
+
+    if (tiled)
+    {
+        // tile size followed by ONE_LEVEL and ROUND_DOWN
+        uint8_t tiles[9] = {};
+        uint32_t tileSize = uint32_t(options.tileSize);
+        memcpy(tiles, &tileSize, 4);
+        memcpy(tiles + 4, &tileSize, 4);
+        AppendAttribute(header, "tiles", "tiledesc", tiles, sizeof(tiles));
+    }
+
+    header.push_back(0);
+    fwrite(header.data(), 1, header.size(), file);
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "color.h"
+#include "threadpool.h"
+
+enum class HdrFormat
+{
+    EXR,
+    PFM
+};
+
+// format from the file extension, exr if it isn't known
+HdrFormat HdrFormatFromFilename(const char* filename);
+
+//------------------------------------------------------------------------------
+/**
+*/
+struct ExrOptions
+{
+    // 16 bit half channels, 32 bit float otherwise
+    bool halfFloat = true;
+    // zip compression, per block of 16 scanlines or per tile
+    bool compress = true;
+    // tile edge in pixels, 0 writes scanline blocks
+    size_t tileSize = 0;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Writes float framebuffers without quantizing them, as OpenEXR or PFM.
+
+    Pixels are multiplied by a scale while they are converted, so the
+    Raytracer's accumulation buffer can be written directly with
+    1 / frameIndex instead of resolving it into a second buffer first.
+
+    Works in bands like the ImageWriter: worker threads convert and compress
+    every exr block (or pfm row slice) of a band in parallel, then the band is
+    streamed to disk in order. The exr offset table is patched at the end.
+*/
+class HdrWriter
+{
+public:
+    // with worker threads of its own
+    HdrWriter(size_t threadCount);
+    // with the workers of a pool that isn't busy while saving, like ImageWriter
+    HdrWriter(ThreadPool& threads);
+
+    // store pixels * scale. rows are bottom up, like the Raytracer's framebuffers
+    bool Save(const char* filename, const Color* pixels, size_t width, size_t height, float scale, HdrFormat format, const ExrOptions& options = ExrOptions());
+    // same, with the format picked from the file extension
+    bool Save(const char* filename, const Color* pixels, size_t width, size_t height, float scale = 1.f);
+
+private:
+    struct Block
+    {
+        // area in output (top down) pixels
+        size_t x = 0;
+        size_t y = 0;
+        size_t width = 0;
+        size_t height = 0;
+        // exr tile coordinates
+        size_t tileX = 0;
+        size_t tileY = 0;
+        // converted pixels, and the compressed chunk that is written
+        std::vector<uint8_t> raw;
+        std::vector<uint8_t> chunk;
+    };
+
+    struct WorkArgs
+    {
+        HdrWriter* self;
+    };
+
+    static void Work(const WorkArgs& args);
+    void ProcessBlock(Block& block);
+    void ProcessExrBlock(Block& block);
+
+    // build every block of the image, in file order
+    void LayoutBlocks();
+    void WriteExrHeader(FILE* file);
+
+    std::unique_ptr<ThreadPool> ownThreads;
+    ThreadPool* threads;
+
+    // current image
+    const Color* pixels;
+    size_t width;
+    size_t height;
+    float scale;
+    HdrFormat format;
+    ExrOptions options;
+    size_t blockLines;
+
+    // every block of the image, only those of the current band hold data
+    std::vector<Block> blocks;
+    size_t bandStart;
+    size_t bandEnd;
+    std::atomic<size_t> nextBlock;
+};
@@ -0,0 +1,399 @@
+#include "imagewriter.h"
+#include "deflate.h"
+#include "threadpool.h"
+#include "timeline.h"
+#include "cpudispatch.h"
+#include <string.h>
+#include <ctype.h>
+
+// raw bytes per slice, large enough to give deflate some context
+#define IMAGE_SLICE_BYTES (1 << 20)
+// slices per band and thread
+#define IMAGE_SLICES_PER_THREAD 2
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline void
+WriteBigEndian(uint8_t* out, uint32_t value)
+{
+    out[0] = uint8_t(value >> 24);
+    out[1] = uint8_t(value >> 16);
+    out[2] = uint8_t(value >> 8);
+    out[3] = uint8_t(value);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Clamp to [0,1] and map to 0-255 with the widest kernel the cpu runs,
+    NaN ends up as 0
+*/
+static inline void
+QuantizeRow(const Color* row, size_t width, uint8_t* out)
+{
+    GetCpuKernels().quantize(&row->r, width * 3, out);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Write a png chunk header and crc around data that is already in place
+*/
+static void
+FinishPngChunk(std::vector<uint8_t>& chunk, const char* type)
+{
+    uint32_t length = uint32_t(chunk.size() - 8);
+    WriteBigEndian(chunk.data(), length);
+    memcpy(chunk.data() + 4, type, 4);
+
+    uint8_t crc[4];
+    WriteBigEndian(crc, Crc32(chunk.data() + 4, length + 4));
+    chunk.insert(chunk.end(), crc, crc + 4);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ImageFormat
+ImageFormatFromFilename(const char* filename)
+{
+    const char* extension = strrchr(filename, '.');
+    if (extension == nullptr)
+        return ImageFormat::PNG;
+
+    char lower[8] = {};
+    for (size_t i = 0; i < sizeof(lower) - 1 && extension[i] != 0; i++)
+        lower[i] = char(tolower(extension[i]));
+
+    if (strcmp(lower, ".qoi") == 0)
+        return ImageFormat::QOI;
+    if (strcmp(lower, ".ppm") == 0)
+        return ImageFormat::PPM;
+
+    return ImageFormat::PNG;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ImageWriter::ImageWriter(size_t threadCount) :
+    ownThreads(new ThreadPool(threadCount == 0 ? 1 : threadCount)),
+    threads(ownThreads.get()),
+    pixels(nullptr),
+    width(0),
+    height(0),
+    format(ImageFormat::PNG),
+    sliceCount(0),
+    nextSlice(0),
+    adler(1),
+    qoiRun(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ImageWriter::ImageWriter(ThreadPool& threads) :
+    threads(&threads),
+    pixels(nullptr),
+    width(0),
+    height(0),
+    format(ImageFormat::PNG),
+    sliceCount(0),
+    nextSlice(0),
+    adler(1),
+    qoiRun(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+ImageWriter::Save(const char* filename, const Color* pixels, size_t width, size_t height)
+{
+    return Save(filename, pixels, width, height, ImageFormatFromFilename(filename));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+ImageWriter::Save(const char* filename, const Color* pixels, size_t width, size_t height, ImageFormat format)
+{
+    TIMELINE_SCOPE("ImageWriter::Save");
+    if (width == 0 || height == 0)
+        return false;
+
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr)
+        return false;
+
+    this->pixels = pixels;
+    this->width = width;
+    this->height = height;
+    this->format = format;
+
+    size_t rowsPerSlice = IMAGE_SLICE_BYTES / (width * 3);
+    rowsPerSlice = rowsPerSlice == 0 ? 1 : rowsPerSlice;
+    slices.resize(threads->size * IMAGE_SLICES_PER_THREAD);
+
+    WriteHeader(file);
+    bool ok = true;
+
+    for (size_t i = 0; i < threads->size; i++)
+        threads->InitThread<WorkArgs>(Work, { this }, i);
+
+    for (size_t row = 0; row < height && ok;)
+    {
+        sliceCount = 0;
+        for (; sliceCount < slices.size() && row < height; sliceCount++)
+        {
+            Slice& slice = slices[sliceCount];
+            slice.firstRow = row;
+            slice.rowCount = height - row < rowsPerSlice ? height - row : rowsPerSlice;
+            row += slice.rowCount;
+        }
+
+        nextSlice = 0;
+        threads->ExecuteAndWait();
+
+        for (size_t i = 0; i < sliceCount && ok; i++)
+            ok = WriteSlice(file, slices[i]);
+    }
+
+    ok = ok && WriteFooter(file);
+    ok = fclose(file) == 0 && ok;
+
+    // keep the band buffers small between images
+    slices.clear();
+    qoiBuffer.clear();
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+ImageWriter::Work(const WorkArgs& args)
+{
+    ImageWriter* self = args.self;
+    for (size_t i = self->nextSlice++; i < self->sliceCount; i = self->nextSlice++)
+    {
+        TIMELINE_SCOPE("image slice");
+        self->ProcessSlice(self->slices[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+ImageWriter::ProcessSlice(Slice& slice)
+{
+    size_t rowBytes = width * 3;
+    bool png = format == ImageFormat::PNG;
+    size_t stride = png ? rowBytes + 1 : rowBytes;
+    slice.raw.resize(slice.rowCount * stride);
+
+    for (size_t i = 0; i < slice.rowCount; i++)
+    {
+        // framebuffer rows start at the bottom
+        size_t sourceRow = height - 1 - (slice.firstRow + i);
+        uint8_t* out = slice.raw.data() + i * stride;
+
+        if (!png)
+        {
+            QuantizeRow(pixels + sourceRow * width, width, out);
+            continue;
+        }
+
+        // sub filter: only depends on the row itself, so slices stay independent
+        out[0] = 1;
+        QuantizeRow(pixels + sourceRow * width, width, out + 1);
+        for (size_t x = rowBytes; x > 3; x--)
+            out[x] = uint8_t(out[x] - out[x - 3]);
+    }
+
+    if (!png)
+        return;
+
+    slice.chunk.assign(8, 0);
+    if (slice.firstRow == 0)
+    {
+        // zlib header, 32k window and fastest level
+        slice.chunk.push_back(0x78);
+        slice.chunk.push_back(0x01);
+    }
+
+    DeflatePiece(slice.raw.data(), slice.raw.size(), slice.chunk);
+    FinishPngChunk(slice.chunk, "IDAT");
+    slice.adler = Adler32(slice.raw.data(), slice.raw.size());
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+ImageWriter::WriteHeader(FILE* file)
+{
+    switch (format)
+    {
+    case ImageFormat::PNG:
+    {
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        fwrite(signature, 1, sizeof(signature), file);
+
+        // 8 bit rgb, no interlacing
+        std::vector<uint8_t> header(8 + 13, 0);
+        WriteBigEndian(header.data() + 8, uint32_t(width));
+        WriteBigEndian(header.data() + 12, uint32_t(height));
+        header[16] = 8;
+        header[17] = 2;
+        FinishPngChunk(header, "IHDR");
+        fwrite(header.data(), 1, header.size(), file);
+
+        adler = 1;
+        break;
+    }
+
+    case ImageFormat::QOI:
+    {
+        uint8_t header[14] = { 'q', 'o', 'i', 'f' };
+        WriteBigEndian(header + 4, uint32_t(width));
+        WriteBigEndian(header + 8, uint32_t(height));
+        header[12] = 3;
+        header[13] = 0;
+        fwrite(header, 1, sizeof(header), file);
+
+        memset(qoiIndex, 0, sizeof(qoiIndex));
+        qoiPrevious[0] = 0;
+        qoiPrevious[1] = 0;
+        qoiPrevious[2] = 0;
+        qoiPrevious[3] = 255;
+        qoiRun = 0;
+        break;
+    }
+
+    case ImageFormat::PPM:
+        fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+        break;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+ImageWriter::WriteSlice(FILE* file, const Slice& slice)
+{
+    if (format == ImageFormat::PNG)
+    {
+        adler = Adler32Combine(adler, slice.adler, slice.raw.size());
+        return fwrite(slice.chunk.data(), 1, slice.chunk.size(), file) == slice.chunk.size();
+    }
+
+    if (format == ImageFormat::PPM)
+        return fwrite(slice.raw.data(), 1, slice.raw.size(), file) == slice.raw.size();
+
+    // qoi, see https://qoiformat.org/qoi-specification.pdf
+    qoiBuffer.clear();
+    qoiBuffer.reserve(slice.raw.size() + slice.raw.size() / 3);
+
+    size_t pixelCount = slice.raw.size() / 3;
+    const uint8_t* px = slice.raw.data();
+    uint8_t* previous = qoiPrevious;
+
+    for (size_t i = 0; i < pixelCount; i++, px += 3)
+    {
+        if (px[0] == previous[0] && px[1] == previous[1] && px[2] == previous[2])
+        {
+            if (++qoiRun == 62)
+            {
+                qoiBuffer.push_back(uint8_t(0xc0 | (qoiRun - 1)));
+                qoiRun = 0;
+            }
+            continue;
+        }
+
+        if (qoiRun > 0)
+        {
+            qoiBuffer.push_back(uint8_t(0xc0 | (qoiRun - 1)));
+            qoiRun = 0;
+        }
+
+        int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+        uint8_t* entry = qoiIndex[hash];
+
+        if (entry[0] == px[0] && entry[1] == px[1] && entry[2] == px[2] && entry[3] == 255)
+        {
+            qoiBuffer.push_back(uint8_t(hash));
+        }
+        else
+        {
+            entry[0] = px[0];
+            entry[1] = px[1];
+            entry[2] = px[2];
+            entry[3] = 255;
+
+            int8_t dr = int8_t(px[0] - previous[0]);
+            int8_t dg = int8_t(px[1] - previous[1]);
+            int8_t db = int8_t(px[2] - previous[2]);
+            int8_t drdg = int8_t(dr - dg);
+            int8_t dbdg = int8_t(db - dg);
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+            {
+                qoiBuffer.push_back(uint8_t(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+            }
+            else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7)
+            {
+                qoiBuffer.push_back(uint8_t(0x80 | (dg + 32)));
+                qoiBuffer.push_back(uint8_t(((drdg + 8) << 4) | (dbdg + 8)));
+            }
+            else
+            {
+                const uint8_t rgb[4] = { 0xfe, px[0], px[1], px[2] };
+                qoiBuffer.insert(qoiBuffer.end(), rgb, rgb + 4);
+            }
+        }
+
+        previous[0] = px[0];
+        previous[1] = px[1];
+        previous[2] = px[2];
+    }
+
+    return fwrite(qoiBuffer.data(), 1, qoiBuffer.size(), file) == qoiBuffer.size();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+ImageWriter::WriteFooter(FILE* file)
+{
+    if (format == ImageFormat::PNG)
+    {
+        // last IDAT ends the deflate stream and carries the adler32 of all slices
+        std::vector<uint8_t> chunk(8, 0);
+        DeflateFinish(chunk);
+        chunk.resize(chunk.size() + 4);
+        WriteBigEndian(chunk.data() + chunk.size() - 4, adler);
+        FinishPngChunk(chunk, "IDAT");
+
+        std::vector<uint8_t> end(8, 0);
+        FinishPngChunk(end, "IEND");
+
+        return fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size() &&
+            fwrite(end.data(), 1, end.size(), file) == end.size();
+    }
+
+    if (format == ImageFormat::QOI)
+    {
+        static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        if (qoiRun > 0 && fputc(0xc0 | (qoiRun - 1), file) == EOF)
+            return false;
+        return fwrite(padding, 1, sizeof(padding), file) == sizeof(padding);
+    }
+
+    return true;
+}
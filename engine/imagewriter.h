@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "color.h"
+#include "threadpool.h"
+
+enum class ImageFormat
+{
+    PNG,
+    QOI,
+    PPM
+};
+
+// format from the file extension, png if it isn't known
+ImageFormat ImageFormatFromFilename(const char* filename);
+
+//------------------------------------------------------------------------------
+/**
+    Writes float framebuffers as 8 bit rgb images.
+
+    The image is processed in bands of row slices. Worker threads quantize
+    every slice of a band in parallel, and for png also filter and deflate it
+    into its own IDAT chunk, then the band is streamed to disk in order. Only a
+    band is ever held in memory, never a second full size image.
+
+    qoi encoding is inherently serial, so only its quantization is parallel.
+*/
+class ImageWriter
+{
+public:
+    // with worker threads of its own
+    ImageWriter(size_t threadCount);
+    // with the workers of a pool that isn't busy while saving, e.g. a Raytracer's renderThreads
+    ImageWriter(ThreadPool& threads);
+
+    // store pixels as an 8 bit image. rows are bottom up, like the Raytracer's framebuffers
+    bool Save(const char* filename, const Color* pixels, size_t width, size_t height, ImageFormat format);
+    // same, with the format picked from the file extension
+    bool Save(const char* filename, const Color* pixels, size_t width, size_t height);
+
+private:
+    struct Slice
+    {
+        // first row in output (top down) order
+        size_t firstRow = 0;
+        size_t rowCount = 0;
+        // quantized rows, with a filter byte per row for png
+        std::vector<uint8_t> raw;
+        // complete IDAT chunk for png
+        std::vector<uint8_t> chunk;
+        uint32_t adler = 1;
+    };
+
+    struct WorkArgs
+    {
+        ImageWriter* self;
+    };
+
+    static void Work(const WorkArgs& args);
+    void ProcessSlice(Slice& slice);
+
+    void WriteHeader(FILE* file);
+    bool WriteSlice(FILE* file, const Slice& slice);
+    bool WriteFooter(FILE* file);
+
+    std::unique_ptr<ThreadPool> ownThreads;
+    ThreadPool* threads;
+
+    // current image
+    const Color* pixels;
+    size_t width;
+    size_t height;
+    ImageFormat format;
+
+    // current band
+    std::vector<Slice> slices;
+    size_t sliceCount;
+    std::atomic<size_t> nextSlice;
+
+    // png stream state
+    uint32_t adler;
+
+    // qoi encoder state, carried across slices
+    uint8_t qoiIndex[64][4];
+    uint8_t qoiPrevious[4];
+    int qoiRun;
+    std::vector<uint8_t> qoiBuffer;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//------------------------------------------------------------------------------
+/**
+    Read-only memory mapping of a whole file
+*/
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // map path, returns false if it can't be opened or is empty
+    bool Open(const char* path);
+    // unmap the file
+    void Close();
+
+    bool IsOpen() const;
+    const uint8_t* Data() const;
+    size_t Size() const;
+
+private:
+    const uint8_t* data;
+    size_t size;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline bool
+MappedFile::IsOpen() const
+{
+    return this->data != nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline const uint8_t*
+MappedFile::Data() const
+{
+    return this->data;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline size_t
+MappedFile::Size() const
+{
+    return this->size;
+}
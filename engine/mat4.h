@@ -70,6 +70,25 @@ inline mat4 zero_mat()
     return m;
 }
 
+//------------------------------------------------------------------------------
+/**
+    row i, m_i0 to m_i3
+*/
+inline float4
+load_row(const mat4& m, int i)
+{
+    return Load4(&m.m00 + i * 4);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+store_row(mat4& m, int i, float4 row)
+{
+    Store4(&m.m00 + i * 4, row);
+}
+
 //------------------------------------------------------------------------------
 /**
     transform vector with matrix basis
@@ -77,17 +96,10 @@ inline mat4 zero_mat()
 inline vec3
 transform(const vec3& v, const mat4& m)
 {
-    //swizzle!
-    //this should be easy to vectorize! ;)
-    //it didn't get any faster :(
-    vec3 x = {v.x, v.x, v.x};
-    vec3 y = {v.y, v.y, v.y};
-    vec3 z = {v.z, v.z, v.z};
-    vec3 r0 = { m.m00, m.m01, m.m02 };
-    vec3 r1 = { m.m10, m.m11, m.m12 };
-    vec3 r2 = { m.m20, m.m21, m.m22 };
-
-    return x * r0 + y * r1 + z * r2;
+    float4 r = Splat(v.x) * load_row(m, 0);
+    r = MulAdd(Splat(v.y), load_row(m, 1), r);
+    r = MulAdd(Splat(v.z), load_row(m, 2), r);
+    return ToVec3(r);
 }
 
 //------------------------------------------------------------------------------
@@ -156,34 +168,91 @@ det(const mat4& m)
 
 //------------------------------------------------------------------------------
 /**
-    Calculate inverse of matrix
+    2x2 matrices in one float4, row major. a * b
+*/
+inline float4
+mat2_mul(float4 a, float4 b)
+{
+    return a * Swizzle<0, 3, 0, 3>(b) + Swizzle<1, 0, 3, 2>(a) * Swizzle<2, 1, 2, 1>(b);
+}
+
+//------------------------------------------------------------------------------
+/**
+    adjugate(a) * b
+*/
+inline float4
+mat2_adj_mul(float4 a, float4 b)
+{
+    return Swizzle<3, 3, 0, 0>(a) * b - Swizzle<1, 1, 2, 2>(a) * Swizzle<2, 3, 0, 1>(b);
+}
+
+//------------------------------------------------------------------------------
+/**
+    a * adjugate(b)
+*/
+inline float4
+mat2_mul_adj(float4 a, float4 b)
+{
+    return a * Swizzle<3, 0, 3, 0>(b) - Swizzle<1, 0, 3, 2>(a) * Swizzle<2, 1, 2, 1>(b);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Calculate inverse of matrix, blockwise from the four 2x2 sub matrices
+    | A B |
+    | C D |
 */
 inline mat4
 inverse(const mat4& m)
 {
-    float s = det(m);
-    
-    if (s == 0.0) 
-		return {1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1}; // cannot inverse, make it identity matrix
-
-    s = 1.0f / s;
-
-    return { s * (m.m11*(m.m22*m.m33 - m.m23*m.m32) + m.m12*(m.m23*m.m31 - m.m21*m.m33) + m.m13*(m.m21*m.m32 - m.m22*m.m31)),
-             s * (m.m21*(m.m02*m.m33 - m.m03*m.m32) + m.m22*(m.m03*m.m31 - m.m01*m.m33) + m.m23*(m.m01*m.m32 - m.m02*m.m31)),
-             s * (m.m31*(m.m02*m.m13 - m.m03*m.m12) + m.m32*(m.m03*m.m11 - m.m01*m.m13) + m.m33*(m.m01*m.m12 - m.m02*m.m11)),
-             s * (m.m01*(m.m13*m.m22 - m.m12*m.m23) + m.m02*(m.m11*m.m23 - m.m13*m.m21) + m.m03*(m.m12*m.m21 - m.m11*m.m22)),
-             s * (m.m12*(m.m20*m.m33 - m.m23*m.m30) + m.m13*(m.m22*m.m30 - m.m20*m.m32) + m.m10*(m.m23*m.m32 - m.m22*m.m33)),
-             s * (m.m22*(m.m00*m.m33 - m.m03*m.m30) + m.m23*(m.m02*m.m30 - m.m00*m.m32) + m.m20*(m.m03*m.m32 - m.m02*m.m33)),
-             s * (m.m32*(m.m00*m.m13 - m.m03*m.m10) + m.m33*(m.m02*m.m10 - m.m00*m.m12) + m.m30*(m.m03*m.m12 - m.m02*m.m13)),
-             s * (m.m02*(m.m13*m.m20 - m.m10*m.m23) + m.m03*(m.m10*m.m22 - m.m12*m.m20) + m.m00*(m.m12*m.m23 - m.m13*m.m22)),
-             s * (m.m13*(m.m20*m.m31 - m.m21*m.m30) + m.m10*(m.m21*m.m33 - m.m23*m.m31) + m.m11*(m.m23*m.m30 - m.m20*m.m33)),
-             s * (m.m23*(m.m00*m.m31 - m.m01*m.m30) + m.m20*(m.m01*m.m33 - m.m03*m.m31) + m.m21*(m.m03*m.m30 - m.m00*m.m33)),
-             s * (m.m33*(m.m00*m.m11 - m.m01*m.m10) + m.m30*(m.m01*m.m13 - m.m03*m.m11) + m.m31*(m.m03*m.m10 - m.m00*m.m13)),
-             s * (m.m03*(m.m11*m.m20 - m.m10*m.m21) + m.m00*(m.m13*m.m21 - m.m11*m.m23) + m.m01*(m.m10*m.m23 - m.m13*m.m20)),
-             s * (m.m10*(m.m22*m.m31 - m.m21*m.m32) + m.m11*(m.m20*m.m32 - m.m22*m.m30) + m.m12*(m.m21*m.m30 - m.m20*m.m31)),
-             s * (m.m20*(m.m02*m.m31 - m.m01*m.m32) + m.m21*(m.m00*m.m32 - m.m02*m.m30) + m.m22*(m.m01*m.m30 - m.m00*m.m31)),
-             s * (m.m30*(m.m02*m.m11 - m.m01*m.m12) + m.m31*(m.m00*m.m12 - m.m02*m.m10) + m.m32*(m.m01*m.m10 - m.m00*m.m11)),
-             s * (m.m00*(m.m11*m.m22 - m.m12*m.m21) + m.m01*(m.m12*m.m20 - m.m10*m.m22) + m.m02*(m.m10*m.m21 - m.m11*m.m20)) };
+    float4 r0 = load_row(m, 0);
+    float4 r1 = load_row(m, 1);
+    float4 r2 = load_row(m, 2);
+    float4 r3 = load_row(m, 3);
+
+    float4 a = Shuffle<0, 1, 0, 1>(r0, r1);
+    float4 b = Shuffle<2, 3, 2, 3>(r0, r1);
+    float4 c = Shuffle<0, 1, 0, 1>(r2, r3);
+    float4 d = Shuffle<2, 3, 2, 3>(r2, r3);
+
+    // |A| |B| |C| |D|
+    float4 detSub = Shuffle<0, 2, 0, 2>(r0, r2) * Shuffle<1, 3, 1, 3>(r1, r3) - Shuffle<1, 3, 1, 3>(r0, r2) * Shuffle<0, 2, 0, 2>(r1, r3);
+    float4 detA = Broadcast<0>(detSub);
+    float4 detB = Broadcast<1>(detSub);
+    float4 detC = Broadcast<2>(detSub);
+    float4 detD = Broadcast<3>(detSub);
+
+    float4 dc = mat2_adj_mul(d, c);
+    float4 ab = mat2_adj_mul(a, b);
+
+    // adjugates of the blocks of the inverse
+    float4 x = detD * a - mat2_mul(b, dc);
+    float4 w = detA * d - mat2_mul(c, ab);
+    float4 y = detB * c - mat2_mul_adj(d, ab);
+    float4 z = detC * b - mat2_mul_adj(a, dc);
+
+    // |M| = |A||D| + |B||C| - tr(A#B D#C)
+    float4 tr = ab * Swizzle<0, 2, 1, 3>(dc);
+    tr = tr + Swizzle<2, 3, 0, 1>(tr);
+    tr = tr + Swizzle<1, 0, 3, 2>(tr);
+    float4 detM = detA * detD + detB * detC - tr;
+
+    if (GetX(detM) == 0.0f)
+        return {1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1}; // cannot inverse, make it identity matrix
+
+    float4 scale = Set4(1.f, -1.f, -1.f, 1.f) / detM;
+    x = x * scale;
+    y = y * scale;
+    z = z * scale;
+    w = w * scale;
+
+    // the shuffles also turn the adjugates back
+    mat4 ret;
+    store_row(ret, 0, Shuffle<3, 1, 3, 1>(x, y));
+    store_row(ret, 1, Shuffle<2, 0, 2, 0>(x, y));
+    store_row(ret, 2, Shuffle<3, 1, 3, 1>(z, w));
+    store_row(ret, 3, Shuffle<2, 0, 2, 0>(z, w));
+    return ret;
 }
 
 //------------------------------------------------------------------------------
@@ -207,25 +276,22 @@ transpose(const mat4& m)
 inline mat4
 multiply(const mat4& b, const mat4& a)
 {
-    return { b.m00*a.m00 + b.m10*a.m01 + b.m20*a.m02 + b.m30*a.m03,
-             b.m01*a.m00 + b.m11*a.m01 + b.m21*a.m02 + b.m31*a.m03,
-             b.m02*a.m00 + b.m12*a.m01 + b.m22*a.m02 + b.m32*a.m03,
-             b.m03*a.m00 + b.m13*a.m01 + b.m23*a.m02 + b.m33*a.m03,
-
-			 b.m00*a.m10 + b.m10*a.m11 + b.m20*a.m12 + b.m30*a.m13,
-             b.m01*a.m10 + b.m11*a.m11 + b.m21*a.m12 + b.m31*a.m13,
-             b.m02*a.m10 + b.m12*a.m11 + b.m22*a.m12 + b.m32*a.m13,
-             b.m03*a.m10 + b.m13*a.m11 + b.m23*a.m12 + b.m33*a.m13,
-
-			 b.m00*a.m20 + b.m10*a.m21 + b.m20*a.m22 + b.m30*a.m23,
-             b.m01*a.m20 + b.m11*a.m21 + b.m21*a.m22 + b.m31*a.m23,
-             b.m02*a.m20 + b.m12*a.m21 + b.m22*a.m22 + b.m32*a.m23,
-             b.m03*a.m20 + b.m13*a.m21 + b.m23*a.m22 + b.m33*a.m23,
-
-			 b.m00*a.m30 + b.m10*a.m31 + b.m20*a.m32 + b.m30*a.m33,
-             b.m01*a.m30 + b.m11*a.m31 + b.m21*a.m32 + b.m31*a.m33,
-             b.m02*a.m30 + b.m12*a.m31 + b.m22*a.m32 + b.m32*a.m33,
-             b.m03*a.m30 + b.m13*a.m31 + b.m23*a.m32 + b.m33*a.m33 };
+    float4 b0 = load_row(b, 0);
+    float4 b1 = load_row(b, 1);
+    float4 b2 = load_row(b, 2);
+    float4 b3 = load_row(b, 3);
+
+    // row i of the result is row i of a weighting the rows of b
+    mat4 ret;
+    for (int i = 0; i < 4; i++)
+    {
+        float4 r = Splat(a[i * 4]) * b0;
+        r = MulAdd(Splat(a[i * 4 + 1]), b1, r);
+        r = MulAdd(Splat(a[i * 4 + 2]), b2, r);
+        r = MulAdd(Splat(a[i * 4 + 3]), b3, r);
+        store_row(ret, i, r);
+    }
+    return ret;
 }
 
 //------------------------------------------------------------------------------
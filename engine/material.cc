@@ -1,11 +1,12 @@
 #include "material.h"
 #include "pbr.h"
+#include "fastmath.h"
 #include "mat4.h"
 #include "random.h"
 
-inline vec3 RandomPointInUnitCube(uint32_t seed)
+inline vec3 RandomPointInUnitCube(const float random[3])
 {
-    return { 0.5f - RandomFloat(++seed), 0.5f - RandomFloat(++seed), 0.5f - RandomFloat(++seed) };
+    return { 0.5f - random[0], 0.5f - random[1], 0.5f - random[2] };
 }
 
 //------------------------------------------------------------------------------
@@ -13,63 +14,80 @@ inline vec3 RandomPointInUnitCube(uint32_t seed)
 */
 
 void
-Material::BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const
+Material::BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const
 {
     switch (type)
     {
     case MaterialType::Lambertian:
-        BSDF_Lambertian(inOutRay, point, normal, seed);
+        BSDF_Lambertian(inOutRay, point, normal, rng);
         break;
     case MaterialType::Dielectric:
-        BSDF_Dielectric(inOutRay, point, normal, seed);
+        BSDF_Dielectric(inOutRay, point, normal, rng);
         break;
     case MaterialType::Conductor:
-        BSDF_Conductor(inOutRay, point, normal, seed);
+        BSDF_Conductor(inOutRay, point, normal, rng);
         break;
     }
 }
 
-void Material::BSDF_Lambertian(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const
+//------------------------------------------------------------------------------
+/**
+    Same choice of side and index ratio as BSDF_Conductor
+*/
+bool
+Material::TotallyReflects(const vec3& dir, const vec3& normal) const
+{
+    bool entering = -dot(dir, normal) > 0;
+    vec3 refracted;
+    return !Refract(Normalize(dir), entering ? normal : -normal, entering ? 1.f / this->refractionIndex : this->refractionIndex, refracted);
+}
+
+void Material::BSDF_Lambertian(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const
 {
     float cosTheta = -dot(inOutRay.dir, normal);
 
     // probability that a ray will reflect on a microfacet
     float F = FresnelSchlick(cosTheta, 0.04f, this->roughness);
-    float r = RandomFloat(++seed);
 
-    if (r < F)
+    // one block covers the lobe choice and either lobe's sample
+    float random[4];
+    rng.Next4(random);
+
+    if (random[0] < F)
     {
         // importance sample with brdf specular lobe
-        vec3 H = ImportanceSampleGGX_VNDF(RandomFloat(++seed), RandomFloat(++seed), this->roughness, inOutRay.dir, TBN(normal));
+        vec3 H = ImportanceSampleGGX_VNDF(random[1], random[2], this->roughness, inOutRay.dir, TBN(normal));
         inOutRay = {point, reflect(inOutRay.dir, H) };
     }
     else
     {
-        inOutRay = {point, normalize(normal + RandomPointInUnitCube(++seed)) };
+        inOutRay = {point, Normalize(normal + RandomPointInUnitCube(random + 1)) };
     }
 }
-void Material::BSDF_Dielectric(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const
+void Material::BSDF_Dielectric(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const
 {
     float cosTheta = -dot(inOutRay.dir, normal);
 
     // probability that a ray will reflect on a microfacet
     float F = FresnelSchlick(cosTheta, 0.95f, this->roughness);
-    float r = RandomFloat(++seed);
 
-    if (r < F)
+    float random[4];
+    rng.Next4(random);
+
+    if (random[0] < F)
     {
         // importance sample with brdf specular lobe
-        vec3 H = ImportanceSampleGGX_VNDF(RandomFloat(++seed), RandomFloat(++seed), this->roughness, inOutRay.dir, TBN(normal));
+        vec3 H = ImportanceSampleGGX_VNDF(random[1], random[2], this->roughness, inOutRay.dir, TBN(normal));
         vec3 reflected = reflect(inOutRay.dir, H);
         inOutRay = { point, reflect(inOutRay.dir, H) };
 
     }
     else
     {
-        inOutRay = { point, normalize(normal + RandomPointInUnitCube(++seed)) };
+        inOutRay = { point, Normalize(normal + RandomPointInUnitCube(random + 1)) };
     }
 }
-void Material::BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const
+void Material::BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const
 {
     float cosTheta = -dot(inOutRay.dir, normal);
 
@@ -84,19 +102,19 @@ void Material::BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& norm
     {
         outwardNormal = -normal;
         niOverNt = this->refractionIndex;
-        cosine = cosTheta * niOverNt / len(rayDir);
+        cosine = cosTheta * niOverNt * Rsqrt(dot(rayDir, rayDir));
     }
     else
     {
         outwardNormal = normal;
         niOverNt = 1.f / this->refractionIndex;
-        cosine = cosTheta / len(rayDir);
+        cosine = cosTheta * Rsqrt(dot(rayDir, rayDir));
     }
 
-    if (Refract(normalize(rayDir), outwardNormal, niOverNt, refracted))
+    if (Refract(Normalize(rayDir), outwardNormal, niOverNt, refracted))
     {
         // fresnel reflectance at 0 deg incidence angle
-        float F0 = std::powf(this->refractionIndex - 1, 2) / std::powf(this->refractionIndex + 1, 2);
+        float F0 = ((this->refractionIndex - 1) * (this->refractionIndex - 1)) / ((this->refractionIndex + 1) * (this->refractionIndex + 1));
         reflect_prob = FresnelSchlick(cosine, F0, this->roughness);
     }
     else
@@ -104,7 +122,7 @@ void Material::BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& norm
         reflect_prob = 1.0;
     }
 
-    if (RandomFloat(++seed) < reflect_prob)
+    if (rng.Next() < reflect_prob)
     {
         inOutRay = { point, reflect(rayDir, normal) };
     }
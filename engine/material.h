@@ -2,6 +2,7 @@
 #include "color.h"
 #include "ray.h"
 #include "vec3.h"
+#include "random.h"
 #include <stdint.h>
 
 enum class MaterialType
@@ -32,10 +33,31 @@ struct Material
     /**
         Scatter ray against material
     */
-    void BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const;
+    void BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const;
+    // same, for callers that know the type at compile time
+    template<MaterialType TYPE>
+    void BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const;
+
+    // whether the refracting BSDF reflects all of a ray arriving along dir
+    bool TotallyReflects(const vec3& dir, const vec3& normal) const;
 
 private:
-    void BSDF_Lambertian(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const;
-    void BSDF_Dielectric(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const;
-    void BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& normal, uint32_t seed) const;
-};
\ No newline at end of file
+    void BSDF_Lambertian(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const;
+    void BSDF_Dielectric(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const;
+    void BSDF_Conductor(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<MaterialType TYPE>
+inline void
+Material::BSDF(Ray& inOutRay, const vec3& point, const vec3& normal, RandomStream& rng) const
+{
+    if constexpr (TYPE == MaterialType::Lambertian)
+        BSDF_Lambertian(inOutRay, point, normal, rng);
+    else if constexpr (TYPE == MaterialType::Dielectric)
+        BSDF_Dielectric(inOutRay, point, normal, rng);
+    else
+        BSDF_Conductor(inOutRay, point, normal, rng);
+}
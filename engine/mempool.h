@@ -21,10 +21,21 @@ public:
 
 	T* GetNew()
 	{
-		if (++topIndex < size)
-			return pool + topIndex;
+		if (topIndex + 1 >= size)
+			return nullptr;
 
-		return nullptr;
+		return pool + ++topIndex;
+	}
+
+	// allocate count contiguous elements, returns nullptr if they don't fit
+	T* GetNew(int count)
+	{
+		if (count < 0 || count > size - (topIndex + 1))
+			return nullptr;
+
+		T* first = pool + topIndex + 1;
+		topIndex += count;
+		return first;
 	}
 
 	T* operator[](int i)
@@ -39,4 +50,42 @@ public:
 	{
 		return topIndex+1;
 	}
+
+	// release all elements, the storage is kept
+	void Clear()
+	{
+		topIndex = -1;
+	}
+
+	// release all elements and make room for at least _size of them
+	void Reset(int _size)
+	{
+		topIndex = -1;
+		if (_size <= size)
+			return;
+
+		delete[] pool;
+		size = _size;
+		pool = new T[size];
+	}
+
+	int Capacity() const
+	{
+		return size;
+	}
+
+	// contiguous storage of all allocated elements
+	T* Data()
+	{
+		return pool;
+	}
+
+	// index of an element owned by this pool, or -1 if it isn't ours
+	int IndexOf(const T* element) const
+	{
+		if (element >= pool && element <= pool + topIndex)
+			return int(element - pool);
+
+		return -1;
+	}
 };
\ No newline at end of file
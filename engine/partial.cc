@@ -0,0 +1,181 @@
+#include "partial.h"
+#include "timeline.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static_assert(sizeof(PartialHeader) == 16 + sizeof(CheckpointHeader), "PartialHeader is written as is");
+
+//------------------------------------------------------------------------------
+/**
+    Everything but the frame index has to match for sums to be added
+*/
+static bool
+SameRender(CheckpointHeader a, CheckpointHeader b)
+{
+    a.frameIndex = 0;
+    b.frameIndex = 0;
+    return memcmp(&a, &b, sizeof(CheckpointHeader)) == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PartialRender::Reset(const CheckpointHeader& settings, uint64_t firstFrame)
+{
+    header = PartialHeader();
+    header.settings = settings;
+    header.settings.frameIndex = 0;
+
+    uint64_t firstSample = firstFrame * settings.raysPerPixel;
+    ranges.assign(1, { firstSample, firstSample });
+    sums.assign(size_t(settings.width) * settings.height * 3, 0);
+}
+
+//------------------------------------------------------------------------------
+/**
+    The conversion only depends on the float value, so every run turns the
+    same frame into the same integers
+*/
+bool
+PartialRender::AddFrame(const Color* frame)
+{
+    if (FrameCount() >= PARTIAL_MAX_FRAMES)
+        return false;
+
+    const float* in = &frame->r;
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        float value = in[i];
+        // also maps NaN to 0
+        value = value > 0.f ? value : 0.f;
+        value = value < PARTIAL_MAX_VALUE ? value : PARTIAL_MAX_VALUE;
+        sums[i] += int64_t(double(value) * PARTIAL_FIXED_ONE + 0.5);
+    }
+
+    ranges.back().second += header.settings.raysPerPixel;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+PartialRender::Merge(const PartialRender& other)
+{
+    if (!SameRender(header.settings, other.header.settings) || sums.size() != other.sums.size() ||
+        FrameCount() + other.FrameCount() > PARTIAL_MAX_FRAMES)
+        return false;
+
+    std::vector<std::pair<uint64_t, uint64_t>> merged = ranges;
+    merged.insert(merged.end(), other.ranges.begin(), other.ranges.end());
+    std::sort(merged.begin(), merged.end());
+
+    // drop empty ranges, refuse overlaps and join touching ranges
+    std::vector<std::pair<uint64_t, uint64_t>> joined;
+    for (const auto& range : merged)
+    {
+        if (range.first == range.second)
+            continue;
+        if (!joined.empty() && range.first < joined.back().second)
+            return false;
+        if (!joined.empty() && range.first == joined.back().second)
+            joined.back().second = range.second;
+        else
+            joined.push_back(range);
+    }
+    ranges = joined.empty() ? std::vector<std::pair<uint64_t, uint64_t>>(1, { 0, 0 }) : joined;
+
+    for (size_t i = 0; i < sums.size(); i++)
+        sums[i] += other.sums[i];
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PartialRender::Resolve(Color* sum, Color* image) const
+{
+    TIMELINE_SCOPE("PartialRender::Resolve");
+    float* out = &sum->r;
+    for (size_t i = 0; i < sums.size(); i++)
+        out[i] = float(double(sums[i]) / PARTIAL_FIXED_ONE);
+
+    float inv_frameIndex = 1.f / FrameCount();
+    size_t pixelCount = sums.size() / 3;
+    for (size_t i = 0; i < pixelCount; i++)
+        image[i] = sum[i] * inv_frameIndex;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+PartialRender::FrameCount() const
+{
+    uint64_t samples = 0;
+    for (const auto& range : ranges)
+        samples += range.second - range.first;
+    return header.settings.raysPerPixel == 0 ? 0 : samples / header.settings.raysPerPixel;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+PartialRender::IsContiguous() const
+{
+    return ranges.size() == 1 && ranges[0].first == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+PartialRender::Save(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    PartialHeader out = header;
+    out.rangeCount = uint32_t(ranges.size());
+
+    bool ok = fwrite(&out, sizeof(out), 1, file) == 1 &&
+        fwrite(ranges.data(), sizeof(ranges[0]), ranges.size(), file) == ranges.size() &&
+        fwrite(sums.data(), sizeof(int64_t), sums.size(), file) == sums.size();
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+PartialRender::Load(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == PARTIAL_MAGIC &&
+        header.version == PARTIAL_VERSION &&
+        header.rangeCount > 0;
+
+    if (ok)
+    {
+        ranges.resize(header.rangeCount);
+        sums.resize(size_t(header.settings.width) * header.settings.height * 3);
+        ok = fread(ranges.data(), sizeof(ranges[0]), ranges.size(), file) == ranges.size() &&
+            fread(sums.data(), sizeof(int64_t), sums.size(), file) == sums.size() &&
+            FrameCount() <= PARTIAL_MAX_FRAMES;
+    }
+
+    fclose(file);
+    return ok;
+}
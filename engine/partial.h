@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "color.h"
+#include "checkpoint.h"
+
+#define PARTIAL_MAGIC 0x50504252 // "RBPP"
+#define PARTIAL_VERSION 3
+
+// fixed point scale of the sums, 32 fraction bits
+#define PARTIAL_FIXED_ONE 4294967296.0
+// frame means are clamped to this before conversion, 2^16 at 32 fraction bits is 2^48 per frame
+#define PARTIAL_MAX_VALUE 65536.f
+// 2^15 frames at the clamp would wrap the int64 sums, partials are refused beyond this
+#define PARTIAL_MAX_FRAMES 32767
+
+//------------------------------------------------------------------------------
+/**
+    Header of a partial render file. It is followed by rangeCount pairs of
+    uint64 sample ranges, then width * height * 3 int64 fixed point sums in
+    framebuffer order.
+
+    Samples are counted over the whole render, frame f (counted like
+    Raytracer::frameIndex) holds samples (f - 1) * raysPerPixel up to
+    f * raysPerPixel, so ranges always cover whole frames.
+*/
+struct PartialHeader
+{
+    uint32_t magic = PARTIAL_MAGIC;
+    uint32_t version = PARTIAL_VERSION;
+    uint32_t rangeCount = 0;
+    uint32_t reserved = 0;
+    // render settings, frameIndex is unused
+    CheckpointHeader settings;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Sum of frame means over a range of samples, in fixed point.
+
+    Float sums depend on the order they are added in, so partial renders
+    summed in floats could never reproduce a single run. Integer addition
+    is associative: partials merged in any order and split in any way give
+    exactly the sums a single run over all samples does.
+*/
+class PartialRender
+{
+public:
+    // start an empty partial, frames are added from firstFrame + 1 on
+    void Reset(const CheckpointHeader& settings, uint64_t firstFrame);
+
+    // add the per pixel means of the next frame, fails once the partial holds PARTIAL_MAX_FRAMES
+    bool AddFrame(const Color* frame);
+
+    // add another partial of the same render, fails if the settings differ, the samples overlap
+    // or the frames together are more than PARTIAL_MAX_FRAMES
+    bool Merge(const PartialRender& other);
+
+    // sum of the frame means and the resolved image, computed like Raytracer::Resume
+    void Resolve(Color* sum, Color* image) const;
+
+    // frames covered, the Raytracer's frameIndex after rendering them all
+    uint64_t FrameCount() const;
+    // true if the samples form one range starting at 0
+    bool IsContiguous() const;
+
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path);
+
+    PartialHeader header;
+    // samples covered, as sorted and disjoint [first, end) ranges
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    std::vector<int64_t> sums;
+};
@@ -0,0 +1,40 @@
+#include "pathstats.h"
+
+//------------------------------------------------------------------------------
+/**
+    The refracting BSDF is the one behind MaterialType::Conductor
+*/
+void
+PathStatistics::AddHit(const Material& material, const vec3& dir, const vec3& normal)
+{
+    materialHits[int(material.type)]++;
+    if (material.type == MaterialType::Conductor && material.TotallyReflects(dir, normal))
+        totalInternalReflections++;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PathStatistics::AddPath(int rays, PathEnd end)
+{
+    paths++;
+    depth[rays < PATH_STATS_MAX_DEPTH ? rays : PATH_STATS_MAX_DEPTH]++;
+    ends[int(end)]++;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PathStatistics::operator+=(const PathStatistics& rhs)
+{
+    paths += rhs.paths;
+    for (int i = 0; i <= PATH_STATS_MAX_DEPTH; i++)
+        depth[i] += rhs.depth[i];
+    for (int i = 0; i < int(PathEnd::Count); i++)
+        ends[i] += rhs.ends[i];
+    for (int i = 0; i < 3; i++)
+        materialHits[i] += rhs.materialHits[i];
+    totalInternalReflections += rhs.totalInternalReflections;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include "vec3.h"
+#include "material.h"
+
+// depth histogram buckets, longer paths share the last one
+#define PATH_STATS_MAX_DEPTH 32
+
+enum class PathEnd
+{
+    // the last ray left the scene
+    SkyMiss,
+    // the last ray hit a surface, but bounces were used up
+    BounceLimit,
+    Count
+};
+
+//------------------------------------------------------------------------------
+/**
+    Why and after how many rays paths ended, and what they hit on the way.
+    Kept per render thread, so threads never share a counter.
+*/
+struct PathStatistics
+{
+    uint64_t paths = 0;
+    // paths that ended after n rays, at index n
+    uint64_t depth[PATH_STATS_MAX_DEPTH + 1] = {};
+    uint64_t ends[int(PathEnd::Count)] = {};
+    uint64_t materialHits[3] = {};
+    // hits on the refracting material that reflected everything
+    uint64_t totalInternalReflections = 0;
+
+    void AddHit(const Material& material, const vec3& dir, const vec3& normal);
+    void AddPath(int rays, PathEnd end);
+
+    void operator+=(const PathStatistics& rhs);
+};
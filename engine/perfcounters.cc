@@ -0,0 +1,147 @@
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+//------------------------------------------------------------------------------
+/**
+*/
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+        fds[i] = -1;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+#endif
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const char*
+PerfCounters::GetName(PerfCounter counter)
+{
+    static const char* names[] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+    return names[int(counter)];
+}
+
+#ifdef __linux__
+
+//------------------------------------------------------------------------------
+/**
+    Counters are opened one by one rather than as a group, so a single
+    unsupported event, common in virtual machines, doesn't take the others down
+*/
+bool
+PerfCounters::Open()
+{
+    struct Event
+    {
+        uint32_t type;
+        uint64_t config;
+    };
+    static const Event events[] =
+    {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    int lastErrno = 0;
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // this thread, on any cpu
+        fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fds[i] == -1)
+            lastErrno = errno;
+        open = open || fds[i] != -1;
+    }
+
+    if (!open)
+        error = std::string("perf_event_open failed: ") + strerror(lastErrno) + ", check /proc/sys/kernel/perf_event_paranoid";
+    return open;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PerfCounters::Start()
+{
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+    {
+        if (fds[i] == -1)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+PerfCounters::Stop()
+{
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+    {
+        if (fds[i] != -1)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (int i = 0; i < int(PerfCounter::Count); i++)
+    {
+        // value, time enabled, time running
+        uint64_t data[3];
+        last.available[i] = fds[i] != -1 && read(fds[i], data, sizeof(data)) == sizeof(data) && data[2] > 0;
+        last.values[i] = last.available[i] ? uint64_t(double(data[0]) * double(data[1]) / double(data[2])) : 0;
+    }
+}
+
+#else
+
+bool
+PerfCounters::Open()
+{
+    error = "hardware counters are only read on linux";
+    return false;
+}
+
+void
+PerfCounters::Start()
+{
+}
+
+void
+PerfCounters::Stop()
+{
+}
+
+#endif
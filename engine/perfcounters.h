@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+enum class PerfCounter
+{
+    Cycles,
+    Instructions,
+    L1DataMisses,
+    LastLevelMisses,
+    BranchMisses,
+    Count
+};
+
+//------------------------------------------------------------------------------
+/**
+    Counts of one measured interval. A counter the CPU, kernel or
+    permissions don't provide is marked missing instead of reading 0
+*/
+struct PerfCounterValues
+{
+    uint64_t values[int(PerfCounter::Count)] = {};
+    bool available[int(PerfCounter::Count)] = {};
+
+    uint64_t
+    operator[](PerfCounter counter) const
+    {
+        return values[int(counter)];
+    }
+
+    bool
+    Has(PerfCounter counter) const
+    {
+        return available[int(counter)];
+    }
+
+    void
+    operator+=(const PerfCounterValues& rhs)
+    {
+        for (int i = 0; i < int(PerfCounter::Count); i++)
+        {
+            values[i] += rhs.values[i];
+            available[i] = available[i] || rhs.available[i];
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+/**
+    Hardware performance counters of the thread that opened them, read
+    through perf_event_open. Only user space is counted, so the default
+    perf_event_paranoid setting allows it. Elsewhere than Linux Open fails.
+
+    Counters multiplexed with other users of the PMU are scaled up by the
+    fraction of time they actually ran.
+*/
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // open the counters for the calling thread, false if none of them could be opened
+    bool Open();
+    bool IsOpen() const;
+    // why Open failed
+    const std::string& GetError() const;
+
+    // measure from here
+    void Start();
+    // to here, the counts are kept as the last interval
+    void Stop();
+
+    const PerfCounterValues& GetLast() const;
+
+    static const char* GetName(PerfCounter counter);
+
+private:
+    int fds[int(PerfCounter::Count)];
+    bool open = false;
+    std::string error;
+    PerfCounterValues last;
+};
+
+inline bool
+PerfCounters::IsOpen() const
+{
+    return open;
+}
+
+inline const std::string&
+PerfCounters::GetError() const
+{
+    return error;
+}
+
+inline const PerfCounterValues&
+PerfCounters::GetLast() const
+{
+    return last;
+}
@@ -0,0 +1,115 @@
+#include "pixelcost.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static_assert(sizeof(PixelCost) == 32, "cost dumps store PixelCosts as is");
+static_assert(sizeof(PixelCostHeader) == 32, "PixelCostHeader layout changed, bump the version");
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+CostMetricFromName(const char* name, CostMetric& metric)
+{
+    static const char* names[] = { "steps", "entered", "spheres", "bounces" };
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            metric = CostMetric(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t
+MetricValue(const PixelCost& cost, CostMetric metric)
+{
+    switch (metric)
+    {
+    case CostMetric::TraversalSteps: return cost.traversalSteps;
+    case CostMetric::BoundingSpheresEntered: return cost.boundingSpheresEntered;
+    case CostMetric::SpheresTested: return cost.spheresTested;
+    case CostMetric::Bounces: return cost.bounces;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+    The scale ends at the 99th percentile, so a handful of pathological
+    pixels doesn't wash out the rest of the map
+*/
+float
+CostHeatmap(const PixelCost* costs, size_t pixelCount, uint64_t samplesPerPixel, CostMetric metric, Color* heatmap)
+{
+    if (pixelCount == 0)
+        return 0.f;
+
+    std::vector<uint64_t> sorted(pixelCount);
+    for (size_t i = 0; i < pixelCount; i++)
+        sorted[i] = MetricValue(costs[i], metric);
+    size_t percentile = std::min(pixelCount - 1, pixelCount * 99 / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + percentile, sorted.end());
+    float scale = float(std::max<uint64_t>(sorted[percentile], 1));
+
+    // blue, cyan, green, yellow, red
+    static const Color palette[] = { {0.f, 0.f, 1.f}, {0.f, 1.f, 1.f}, {0.f, 1.f, 0.f}, {1.f, 1.f, 0.f}, {1.f, 0.f, 0.f} };
+    const int stops = 4;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        float t = std::min(float(MetricValue(costs[i], metric)) / scale, 1.f) * stops;
+        int stop = std::min(int(t), stops - 1);
+        float f = t - stop;
+        const Color& a = palette[stop];
+        const Color& b = palette[stop + 1];
+        heatmap[i] = { a.r + (b.r - a.r) * f, a.g + (b.g - a.g) * f, a.b + (b.b - a.b) * f };
+    }
+
+    return scale / float(std::max<uint64_t>(samplesPerPixel, 1));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SavePixelCosts(const char* path, const PixelCostHeader& header, const PixelCost* costs)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    size_t count = size_t(header.width) * header.height;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(costs, sizeof(PixelCost), count, file) == count;
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadPixelCosts(const char* path, PixelCostHeader& header, std::vector<PixelCost>& costs)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == PIXEL_COST_MAGIC &&
+        header.version == PIXEL_COST_VERSION;
+
+    if (ok)
+    {
+        size_t count = size_t(header.width) * header.height;
+        costs.resize(count);
+        ok = fread(costs.data(), sizeof(PixelCost), count, file) == count;
+    }
+
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "color.h"
+
+#define PIXEL_COST_MAGIC 0x43504252 // "RBPC"
+#define PIXEL_COST_VERSION 1
+
+//------------------------------------------------------------------------------
+/**
+    Work the Raytracer did for one pixel, summed over all its samples
+*/
+struct PixelCost
+{
+    // bounding spheres tested against a ray
+    uint64_t traversalSteps = 0;
+    // bounding spheres a ray started in or hit, so their spheres were tested
+    uint64_t boundingSpheresEntered = 0;
+    // spheres tested against a ray
+    uint64_t spheresTested = 0;
+    // rays traced along the paths, one per bounce
+    uint64_t bounces = 0;
+
+    void operator+=(const PixelCost& rhs)
+    {
+        traversalSteps += rhs.traversalSteps;
+        boundingSpheresEntered += rhs.boundingSpheresEntered;
+        spheresTested += rhs.spheresTested;
+        bounces += rhs.bounces;
+    }
+};
+
+enum class CostMetric
+{
+    TraversalSteps,
+    BoundingSpheresEntered,
+    SpheresTested,
+    Bounces
+};
+
+// metric from its name, "steps", "entered", "spheres" or "bounces". false if it isn't known
+bool CostMetricFromName(const char* name, CostMetric& metric);
+
+//------------------------------------------------------------------------------
+/**
+    Header of a raw cost dump, followed by width * height PixelCosts in
+    framebuffer order (rows bottom up). Every pixel holds the sums of
+    frameCount * raysPerPixel samples.
+*/
+struct PixelCostHeader
+{
+    uint32_t magic = PIXEL_COST_MAGIC;
+    uint32_t version = PIXEL_COST_VERSION;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t frameCount = 0;
+    uint32_t raysPerPixel = 0;
+    uint32_t reserved = 0;
+};
+
+// false color image of a metric, blue for cheap pixels to red for the most expensive percent.
+// returns the cost per sample drawn as full red
+float CostHeatmap(const PixelCost* costs, size_t pixelCount, uint64_t samplesPerPixel, CostMetric metric, Color* heatmap);
+
+// store the raw cost buffer
+bool SavePixelCosts(const char* path, const PixelCostHeader& header, const PixelCost* costs);
+
+// load a raw cost buffer, fails on a bad header or a truncated file
+bool LoadPixelCosts(const char* path, PixelCostHeader& header, std::vector<PixelCost>& costs);
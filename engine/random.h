@@ -3,4 +3,116 @@
 
 float RandomFloat(uint32_t x);
 
-float RandomFloatNTP(uint32_t x);
\ No newline at end of file
+float RandomFloatNTP(uint32_t x);
+
+// philox multipliers and key increments, see "Parallel Random Numbers: As Easy as 1, 2, 3" (Salmon et al.)
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// second key word of every sample stream
+#define RANDOM_STREAM_KEY 0x5EED1337u
+
+//------------------------------------------------------------------------------
+/**
+    Philox4x32-10 on LANES counters at once. Every lane runs the same
+    branch free instructions, so the loops vectorize. counter[word][lane] is
+    replaced by the random output.
+*/
+template<int LANES>
+inline void
+Philox4x32(uint32_t counter[4][LANES], uint32_t key0, uint32_t key1)
+{
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            uint64_t product0 = uint64_t(PHILOX_M0) * counter[0][lane];
+            uint64_t product1 = uint64_t(PHILOX_M1) * counter[2][lane];
+            uint32_t c1 = counter[1][lane];
+            uint32_t c3 = counter[3][lane];
+            counter[0][lane] = uint32_t(product1 >> 32) ^ c1 ^ key0;
+            counter[1][lane] = uint32_t(product1);
+            counter[2][lane] = uint32_t(product0 >> 32) ^ c3 ^ key1;
+            counter[3][lane] = uint32_t(product0);
+        }
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    uniform float in [0, 1) from the top 24 bits
+*/
+inline float
+UnitFloat(uint32_t x)
+{
+    return float(x >> 8) * (1.f / 16777216.f);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Counter based random numbers for one sample.
+
+    Streams are split without any shared state: the key is the pixel index
+    and RANDOM_STREAM_KEY, the counter is the sample's index over the whole
+    render, a free stream word (views, passes) and the block number. Every
+    block yields 4 floats, a sample can draw 2^32 blocks before repeating
+    and no two pixels, samples or streams ever share a block.
+*/
+class RandomStream
+{
+public:
+    RandomStream(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t stream = 0) :
+        key0(pixelIndex),
+        sample(sampleIndex),
+        stream(stream),
+        block(0),
+        used(4)
+    {
+    }
+
+    // next float of the current block
+    float Next()
+    {
+        if (used == 4)
+        {
+            Next4(values);
+            used = 0;
+        }
+        return values[used++];
+    }
+
+    // a whole new block
+    void Next4(float out[4])
+    {
+        uint32_t counter[4][1] = { { sample }, { stream }, { block++ }, { 0 } };
+        Philox4x32<1>(counter, key0, RANDOM_STREAM_KEY);
+        for (int i = 0; i < 4; i++)
+            out[i] = UnitFloat(counter[i][0]);
+    }
+
+    // two new blocks, generated side by side
+    void Next8(float out[8])
+    {
+        uint32_t counter[4][2] = { { sample, sample }, { stream, stream }, { block, block + 1 }, { 0, 0 } };
+        block += 2;
+        Philox4x32<2>(counter, key0, RANDOM_STREAM_KEY);
+        for (int i = 0; i < 4; i++)
+        {
+            out[i] = UnitFloat(counter[i][0]);
+            out[i + 4] = UnitFloat(counter[i][1]);
+        }
+    }
+
+private:
+    uint32_t key0;
+    uint32_t sample;
+    uint32_t stream;
+    uint32_t block;
+    int used;
+    float values[4];
+};
@@ -14,11 +14,6 @@ public:
 
     }
 
-    ~Ray()
-    {
-
-    }
-
     vec3 PointAt(float t) const
     {
         return {origin + dir * t};
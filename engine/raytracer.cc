@@ -1,5 +1,9 @@
 #include "raytracer.h"
 #include "random.h"
+#include "bscache.h"
+#include "timeline.h"
+#include "cpudispatch.h"
+#include <algorithm>
 
 struct WorkArgs
 {
@@ -11,15 +15,75 @@ struct WorkArgs
 
 void RenderThreadWork(const WorkArgs& args)
 {
+    TIMELINE_SCOPE("RaytraceGroup");
+    PerfCounters* counters = args.self->perfCounters != nullptr ? args.self->perfCounters + args.workerIndex : nullptr;
+    if (counters != nullptr)
+    {
+        // counters only count the thread that opened them, tried once
+        if (!counters->IsOpen() && counters->GetError().empty())
+            counters->Open();
+        counters->Start();
+    }
+
     size_t rayCount = 0;
-    args.self->RaytraceGroup(args.pixelX, args.pixelY, args.pixelCount, &rayCount);
+    PathStatistics* stats = args.self->pathStatistics != nullptr ? args.self->pathStatistics + args.workerIndex : nullptr;
+    args.self->RaytraceGroup(args.pixelX, args.pixelY, args.pixelCount, &rayCount, stats);
     args.self->rayCounters[args.workerIndex] = rayCount;
+
+    if (counters != nullptr)
+        counters->Stop();
+}
+
+// edge of the square tiles RaytraceViews hands out
+#define VIEW_TILE_SIZE 16
+
+struct ViewBatch
+{
+    RaytraceView* views;
+    size_t viewCount;
+    std::vector<vec3> origins;
+    std::vector<mat4> frustums;
+    size_t tilesX;
+    size_t itemCount;
+    std::atomic<size_t> nextItem;
+};
+
+struct ViewWorkArgs
+{
+    Raytracer* self;
+    ViewBatch* batch;
+    int workerIndex;
+};
+
+void ViewThreadWork(const ViewWorkArgs& args)
+{
+    Raytracer* self = args.self;
+    ViewBatch* batch = args.batch;
+    size_t rayCount = 0;
+    for (size_t item = batch->nextItem++; item < batch->itemCount; item = batch->nextItem++)
+    {
+        size_t viewIndex = item % batch->viewCount;
+        size_t tile = item / batch->viewCount;
+        size_t x = (tile % batch->tilesX) * VIEW_TILE_SIZE;
+        size_t y = (tile / batch->tilesX) * VIEW_TILE_SIZE;
+        size_t tileWidth = std::min<size_t>(VIEW_TILE_SIZE, self->width - x);
+        size_t tileHeight = std::min<size_t>(VIEW_TILE_SIZE, self->height - y);
+
+        TIMELINE_SCOPE("view tile");
+        const RaytraceView& view = batch->views[viewIndex];
+        for (size_t row = 0; row < tileHeight; row++)
+        {
+            self->RaytraceGroup(batch->origins[viewIndex], batch->frustums[viewIndex], view.frameIndex, view.frameBuffer, view.frameBufferCopy,
+                int(x), int(y + row), tileWidth, &rayCount);
+        }
+    }
+    self->rayCounters[args.workerIndex] = rayCount;
 }
 
 //------------------------------------------------------------------------------
 /**
 */
-Raytracer::Raytracer(size_t w, size_t h, std::vector<Color>& frameBuffer, std::vector<Color>& frameBufferCopy, size_t rpp, size_t bounces, int maxSpheres) :
+Raytracer::Raytracer(size_t w, size_t h, std::vector<Color>& frameBuffer, std::vector<Color>& frameBufferCopy, size_t rpp, size_t bounces, int maxSpheres, ThreadPool* threads) :
     frameBuffer(frameBuffer),
     frameBufferCopy(frameBufferCopy),
     rpp(rpp),
@@ -30,37 +94,120 @@ Raytracer::Raytracer(size_t w, size_t h, std::vector<Color>& frameBuffer, std::v
     frustum(zero_mat()),
     boundingSpheres(maxSpheres),
     spheres(maxSpheres),
-    renderThreads(std::thread::hardware_concurrency())
+    materials(maxSpheres),
+    ownThreads(threads == nullptr ? new ThreadPool(std::thread::hardware_concurrency()) : nullptr),
+    renderThreads(threads != nullptr ? *threads : *ownThreads)
 {
-    int x = 0;
-    int y = 0;
-    size_t pixelCount = width * height / renderThreads.size;
-    for (int i = 0; i < renderThreads.size; i++)
+    rayCounters.resize(renderThreads.size, 0);
+}
+
+Raytracer::~Raytracer()
+{
+
+}
+
+bool Raytracer::CreateBoundingSpheres()
+{
+    TIMELINE_SCOPE("CreateBoundingSpheres");
+    int sphereCount = spheres.Count();
+    std::vector<PackedSphere> packed(sphereCount);
+    std::vector<uint32_t> materialIndices(sphereCount);
+
+    for (int i = 0; i < sphereCount; i++)
     {
-        rayCounters.push_back(0);
-        renderThreads.InitThread<WorkArgs>(RenderThreadWork, {this, x, y, pixelCount, i}, i);
-        x += int(pixelCount);
-        while (x >= width)
+        Sphere* s = spheres[i];
+        packed[i] = { s->center.x, s->center.y, s->center.z, s->radius };
+
+        // materials created outside of the table are copied into it
+        if (s->material == nullptr)
+            return false;
+        int materialIndex = materials.IndexOf(s->material);
+        if (materialIndex == -1)
         {
-            y++;
-            x -= int(width);
+            Material* copy = materials.GetNew();
+            if (copy == nullptr)
+                return false;
+            *copy = *s->material;
+            materialIndex = materials.IndexOf(copy);
         }
+        materialIndices[i] = uint32_t(materialIndex);
     }
+
+    packedSpheres.swap(packed);
+    sphereMaterialIndices.swap(materialIndices);
+
+    SceneView view;
+    view.spheres = packedSpheres.data();
+    view.materialIndices = sphereMaterialIndices.data();
+    view.sphereCount = packedSpheres.size();
+    view.materials = materials.Data();
+    view.materialCount = materials.Count();
+    SetScene(view);
+    return true;
 }
 
-Raytracer::~Raytracer()
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Raytracer::SetScene(const SceneView& view)
 {
+    scene = view;
+    if (scene.boundingSpheres == nullptr)
+        BuildBoundingSpheres();
+
+    // the culling kernels read the bounding spheres as separate arrays
+    boundsX.resize(scene.boundingSphereCount);
+    boundsY.resize(scene.boundingSphereCount);
+    boundsZ.resize(scene.boundingSphereCount);
+    boundsRadius.resize(scene.boundingSphereCount);
+    for (size_t i = 0; i < scene.boundingSphereCount; i++)
+    {
+        const BoundingSphere& bs = scene.boundingSpheres[i];
+        boundsX[i] = bs.center.x;
+        boundsY[i] = bs.center.y;
+        boundsZ[i] = bs.center.z;
+        boundsRadius[i] = bs.radius;
+    }
 
+    sceneMaterialType = scene.materialCount > 0 ? int(scene.materials[0].type) : -1;
+    for (size_t i = 1; i < scene.materialCount; i++)
+    {
+        if (int(scene.materials[i].type) != sceneMaterialType)
+            sceneMaterialType = -1;
+    }
 }
 
-void Raytracer::CreateBoundingSpheres()
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Raytracer::BuildBoundingSpheres()
 {
-    for (int i = 0; i < spheres.Count(); i++)
+    TIMELINE_SCOPE("BuildBoundingSpheres");
+    // in the worst case every sphere gets a bounding sphere of its own
+    boundingSpheres.Reset(int(scene.sphereCount));
+
+    uint64_t sceneHash = 0;
+    bool useCache = !boundingSphereCacheDirectory.empty();
+    if (useCache)
+    {
+        sceneHash = HashSceneSpheres(scene);
+        if (LoadBoundingSphereCache(boundingSphereCacheDirectory, sceneHash, scene.sphereCount, boundingSpheres))
+        {
+            scene.boundingSpheres = boundingSpheres.Data();
+            scene.boundingSphereCount = boundingSpheres.Count();
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < scene.sphereCount; i++)
     {
+        const PackedSphere& s = scene.spheres[i];
         int j = 0;
         for (; j < boundingSpheres.Count(); j++)
         {
-            if (boundingSpheres[j]->TryAddSphere(i, spheres[i]->center, spheres[i]->radius))
+            if (boundingSpheres[j]->TryAddSphere(int(i), s.Center(), s.radius))
             {
                 break;
             }
@@ -68,20 +215,32 @@ void Raytracer::CreateBoundingSpheres()
         
         if (j == boundingSpheres.Count())
         {
-            *boundingSpheres.GetNew() = BoundingSphere();
-            boundingSpheres[j]->TryAddSphere(i, spheres[i]->center, spheres[i]->radius);
+            BoundingSphere* bs = boundingSpheres.GetNew();
+            *bs = BoundingSphere();
+            bs->TryAddSphere(int(i), s.Center(), s.radius);
         }
     }
 
-    int a = 0;
+    scene.boundingSpheres = boundingSpheres.Data();
+    scene.boundingSphereCount = boundingSpheres.Count();
+
+    if (useCache)
+        StoreBoundingSphereCache(boundingSphereCacheDirectory, sceneHash, scene.sphereCount, scene.boundingSpheres, scene.boundingSphereCount);
 }
 
-void Raytracer::RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t* rayCount)
+void Raytracer::RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PathStatistics* stats)
 {
-    // just some random stuff that changes over time
-    uint32_t seed = 1337420 + (pixelX | frameIndex ^ 45312) * 1234 + (pixelY | frameIndex ^ 31235) * 4321;
+    RaytraceGroup(get_position(view), frustum, frameIndex, frameBuffer.data(), frameBufferCopy.data(), pixelX, pixelY, pixelCount, rayCount, costBuffer, stats);
+}
 
-    vec3 origin = get_position(view);
+//------------------------------------------------------------------------------
+/**
+*/
+template<int BOUNCES, int MATERIAL, bool INSTRUMENTED>
+void
+Raytracer::RaytraceGroupVariant(const vec3& origin, const mat4& frustum, int frameIndex, Color* frameBuffer, Color* frameBufferCopy,
+    int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PixelCost* costBuffer, PathStatistics* stats)
+{
     float aspect = (float)width / height;
     int row = pixelY * int(width);
 
@@ -90,29 +249,35 @@ void Raytracer::RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t*
     float inv_frameIndex = 1.f / frameIndex;
     float inv_rpp = 1.f / rpp;
 
+    // samples are numbered over the whole render, so every sample of every frame has its own random stream
+    uint32_t firstSample = uint32_t(frameIndex - 1) * uint32_t(rpp);
+
     for (size_t i = 0; i < pixelCount; i++)
     {
         Color color;
-        for (int i = 0; i < rpp; ++i)
+        int index = row + pixelX;
+        PixelCost* cost = INSTRUMENTED && costBuffer != nullptr ? costBuffer + index : nullptr;
+        for (size_t i = 0; i < rpp; ++i)
         {
-            float u = ((float(pixelX + RandomFloat(++seed)) * two_inv_width) - 1.0f) * aspect;
-            float v = ((float(pixelY + RandomFloat(++seed)) * two_inv_height) - 1.0f);
+            // only depends on the pixel and sample, never on how pixels are split over threads or tiles
+            RandomStream rng(uint32_t(index), firstSample + uint32_t(i));
+            float u = ((float(pixelX + rng.Next()) * two_inv_width) - 1.0f) * aspect;
+            float v = ((float(pixelY + rng.Next()) * two_inv_height) - 1.0f);
 
             vec3 direction = normalize(transform({ u, v, -1.0f }, frustum));
-            color += TracePath(Ray(origin, direction), seed, rayCount);
+            color += TracePathVariant<BOUNCES, MATERIAL, INSTRUMENTED>(Ray(origin, direction), rng, rayCount, cost, stats);
         }
 
         // divide by number of samples per pixel, to get the average of the distribution
         color *= inv_rpp;
 
-        int index = row + pixelX;
         Color& res = frameBuffer[index];
         res += color;
         frameBufferCopy[index] = res * inv_frameIndex;
 
-        if (++pixelX >= width)
+        if (++pixelX >= int(width))
         {
-            if (++pixelY >= height)
+            if (++pixelY >= int(height))
             {
                 return;
             }
@@ -122,94 +287,255 @@ void Raytracer::RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t*
     }
 }
 
+typedef void (Raytracer::*RaytraceGroupFunction)(const vec3&, const mat4&, int, Color*, Color*, int, int, size_t, size_t*, PixelCost*, PathStatistics*);
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<int BOUNCES>
+static RaytraceGroupFunction
+SelectMaterialVariant(int materialType)
+{
+    switch (materialType)
+    {
+    case int(MaterialType::Lambertian):
+        return &Raytracer::RaytraceGroupVariant<BOUNCES, int(MaterialType::Lambertian), false>;
+    case int(MaterialType::Dielectric):
+        return &Raytracer::RaytraceGroupVariant<BOUNCES, int(MaterialType::Dielectric), false>;
+    case int(MaterialType::Conductor):
+        return &Raytracer::RaytraceGroupVariant<BOUNCES, int(MaterialType::Conductor), false>;
+    default:
+        return &Raytracer::RaytraceGroupVariant<BOUNCES, -1, false>;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Picks the variant for the bounce count, the scene's materials and
+    whether anything is counted. Only common bounce counts are compiled in,
+    one bounce being primary visibility, the others read it at runtime
+*/
+void
+Raytracer::RaytraceGroup(const vec3& origin, const mat4& frustum, int frameIndex, Color* frameBuffer, Color* frameBufferCopy,
+    int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PixelCost* costBuffer, PathStatistics* stats)
+{
+    RaytraceGroupFunction variant;
+    if (costBuffer != nullptr || stats != nullptr)
+        variant = &Raytracer::RaytraceGroupVariant<0, -1, true>;
+    else if (bounces == 1)
+        variant = SelectMaterialVariant<1>(sceneMaterialType);
+    else if (bounces == 2)
+        variant = SelectMaterialVariant<2>(sceneMaterialType);
+    else if (bounces == 4)
+        variant = SelectMaterialVariant<4>(sceneMaterialType);
+    else if (bounces == 5)
+        variant = SelectMaterialVariant<5>(sceneMaterialType);
+    else if (bounces == 8)
+        variant = SelectMaterialVariant<8>(sceneMaterialType);
+    else
+        variant = SelectMaterialVariant<0>(sceneMaterialType);
+
+    (this->*variant)(origin, frustum, frameIndex, frameBuffer, frameBufferCopy, pixelX, pixelY, pixelCount, rayCount, costBuffer, stats);
+}
+
 //------------------------------------------------------------------------------
 /**
 */
 void
 Raytracer::Raytrace()
 {
+    TIMELINE_SCOPE("Raytrace");
     frameIndex++;
+
+    // the pool may have run other work since the last frame
+    int x = 0;
+    int y = 0;
+    size_t pixelCount = width * height / renderThreads.size;
+    for (size_t i = 0; i < renderThreads.size; i++)
+    {
+        // the last thread also takes the pixels that don't divide evenly
+        size_t count = i == renderThreads.size - 1 ? width * height - i * pixelCount : pixelCount;
+        renderThreads.InitThread<WorkArgs>(RenderThreadWork, {this, x, y, count, int(i)}, i);
+        x += int(pixelCount);
+        while (x >= int(width))
+        {
+            y++;
+            x -= int(width);
+        }
+    }
     renderThreads.ExecuteAndWait();
 }
 
 //------------------------------------------------------------------------------
 /**
+    Work items alternate between views first, so the threads trace the same
+    tile of every view before moving on
 */
+void
+Raytracer::RaytraceViews(RaytraceView* views, size_t viewCount)
+{
+    TIMELINE_SCOPE("RaytraceViews");
+    ViewBatch batch;
+    batch.views = views;
+    batch.viewCount = viewCount;
+    batch.tilesX = (width + VIEW_TILE_SIZE - 1) / VIEW_TILE_SIZE;
+    batch.itemCount = batch.tilesX * ((height + VIEW_TILE_SIZE - 1) / VIEW_TILE_SIZE) * viewCount;
+    batch.nextItem = 0;
+
+    for (size_t i = 0; i < viewCount; i++)
+    {
+        views[i].frameIndex++;
+        batch.origins.push_back(get_position(views[i].view));
+        batch.frustums.push_back(transpose(inverse(views[i].view)));
+    }
+
+    // the render threads pick up whatever work they were given last, Raytrace sets its own again
+    for (size_t i = 0; i < renderThreads.size; i++)
+        renderThreads.InitThread<ViewWorkArgs>(ViewThreadWork, { this, &batch, int(i) }, i);
+    renderThreads.ExecuteAndWait();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Color
+Raytracer::TracePath(const Ray& ray, RandomStream& rng, size_t* rayCount, PixelCost* cost, PathStatistics* stats)
+{
+    return TracePathVariant<0, -1, true>(ray, rng, rayCount, cost, stats);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<int BOUNCES, int MATERIAL, bool INSTRUMENTED>
 inline Color
-Raytracer::TracePath(const Ray& ray, uint32_t seed, size_t* rayCount)
+Raytracer::TracePathVariant(const Ray& ray, RandomStream& rng, size_t* rayCount, PixelCost* cost, PathStatistics* stats)
 {
+    const int bounceCount = BOUNCES > 0 ? BOUNCES : int(bounces);
     vec3 hitPoint;
     vec3 hitNormal;
-    Material* hitMaterial = nullptr;
+    const Material* hitMaterial = nullptr;
     float distance = FLT_MAX;
     Ray updatedRay = ray;
     Color color = {1.f, 1.f, 1.f};
+    int depth = 0;
+    PathEnd end = PathEnd::BounceLimit;
 
-    for (int i = 0; i < bounces; i++)
+    for (int i = 0; i < bounceCount; i++)
     {
         (*rayCount)++;
-        if (!Raycast(updatedRay, hitPoint, hitNormal, hitMaterial, distance))
+        depth++;
+        bool hit = INSTRUMENTED ? Raycast(updatedRay, hitPoint, hitNormal, hitMaterial, distance, cost) :
+            RaycastScene<false>(updatedRay, hitPoint, hitNormal, hitMaterial, distance, nullptr);
+        if (!hit)
         {
             color = color * Skybox(updatedRay.dir);
+            end = PathEnd::SkyMiss;
             break;
         }
 
         color = color * hitMaterial->color;
+        if (INSTRUMENTED && stats != nullptr)
+            stats->AddHit(*hitMaterial, updatedRay.dir, hitNormal);
+
+        // the ray leaving the last bounce is never traced
+        if (i + 1 == bounceCount)
+            break;
 
-        hitMaterial->BSDF(updatedRay, hitPoint, hitNormal, ++seed);
+        if constexpr (MATERIAL < 0)
+            hitMaterial->BSDF(updatedRay, hitPoint, hitNormal, rng);
+        else
+            hitMaterial->BSDF<MaterialType(MATERIAL)>(updatedRay, hitPoint, hitNormal, rng);
     }
 
+    if (INSTRUMENTED && stats != nullptr)
+        stats->AddPath(depth, end);
+
     return color;
 }
 
 //------------------------------------------------------------------------------
 /**
 */
-inline bool
-Raytracer::Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, Material*& hitMaterial, float& distance)
+bool
+Raytracer::Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance)
+{
+    return RaycastScene<false>(ray, hitPoint, hitNormal, hitMaterial, distance, nullptr);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Raytracer::Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance, PixelCost* cost)
+{
+    if (cost != nullptr)
+        return RaycastScene<true>(ray, hitPoint, hitNormal, hitMaterial, distance, cost);
+    return RaycastScene<false>(ray, hitPoint, hitNormal, hitMaterial, distance, nullptr);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<bool COUNT_COST>
+bool
+Raytracer::RaycastScene(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance, PixelCost* cost)
 {
     HitResult closestHit;
     int sphereIndex = -1;
+    const PackedSphere* packed = scene.spheres;
 
-    // no bounding spheres
-    /*for (int j = 0; j < spheres.Count(); j++)
-    {
-        if (IntersectSphere(ray, spheres[j]->center, spheres[j]->radius, closestHit.t, closestHit))
-        {
-            sphereIndex = j;
-        }
-    }*/
+    size_t entered = 0;
+    size_t tested = 0;
 
-    HitResult boundingSphereHit;
+    const CpuKernels& kernels = GetCpuKernels();
+    const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+    const float dir[3] = { ray.dir.x, ray.dir.y, ray.dir.z };
+    float dirDot = dot(ray.dir, ray.dir);
+    uint32_t candidates[RAYCAST_CULL_BLOCK];
 
-    for (int i = 0; i < boundingSpheres.Count(); i++)
+    // culled a block at a time, so later blocks see the closer hits of earlier ones
+    for (size_t first = 0; first < scene.boundingSphereCount; first += RAYCAST_CULL_BLOCK)
     {
-        BoundingSphere* bs = boundingSpheres[i];
-        vec3 toCenter = bs->center - ray.origin;
-        float distSquared = dot(toCenter, toCenter);
-        bool isInside = distSquared < bs->radius* bs->radius;
+        size_t count = std::min<size_t>(RAYCAST_CULL_BLOCK, scene.boundingSphereCount - first);
+        size_t candidateCount = kernels.cullSpheres(boundsX.data() + first, boundsY.data() + first, boundsZ.data() + first, boundsRadius.data() + first,
+            count, origin, dir, dirDot, closestHit.t, candidates);
 
-        if (isInside || IntersectSphere(ray, bs->center, bs->radius, closestHit.t, boundingSphereHit))
+        for (size_t k = 0; k < candidateCount; k++)
         {
+            const BoundingSphere* bs = scene.boundingSpheres + first + candidates[k];
+            if (COUNT_COST)
+            {
+                entered++;
+                tested += bs->count;
+            }
             for (int j = 0; j < bs->count; j++)
             {
                 int index = bs->containedSphereIndices[j];
-                Sphere* s = spheres[index];
+                const PackedSphere& s = packed[index];
                 
-                if (IntersectSphere(ray, s->center, s->radius, closestHit.t, closestHit))
+                if (IntersectSphere(ray, s.Center(), s.radius, closestHit.t, closestHit))
                 {
                     sphereIndex = index;
                 }
             }
         }
     }
+
+    if (COUNT_COST)
+    {
+        cost->traversalSteps += scene.boundingSphereCount;
+        cost->boundingSpheresEntered += entered;
+        cost->spheresTested += tested;
+        cost->bounces++;
+    }
     
     if (sphereIndex != -1)
     {
         hitPoint = closestHit.p;
         hitNormal = closestHit.normal;
         distance = closestHit.t;
-        hitMaterial = spheres[sphereIndex]->material;
+        hitMaterial = scene.materials + scene.materialIndices[sphereIndex];
         return true;
     }
 
@@ -230,6 +556,29 @@ Raytracer::Clear()
         color.g = 0.0f;
         color.b = 0.0f;
     }
+
+    if (costBuffer != nullptr)
+        std::fill(costBuffer, costBuffer + width * height, PixelCost());
+    if (pathStatistics != nullptr)
+        std::fill(pathStatistics, pathStatistics + renderThreads.size, PathStatistics());
+}
+
+//------------------------------------------------------------------------------
+/**
+    Resolves the same way RaytraceGroup does, so the next frame continues bit
+    for bit as if the render had never stopped
+*/
+void
+Raytracer::Resume(const Color* sum, int frameIndex)
+{
+    TIMELINE_SCOPE("Resume");
+    this->frameIndex = frameIndex;
+    float inv_frameIndex = 1.f / frameIndex;
+    for (size_t i = 0; i < width * height; i++)
+    {
+        frameBuffer[i] = sum[i];
+        frameBufferCopy[i] = sum[i] * inv_frameIndex;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1,13 +1,22 @@
 #pragma once
+#include <memory>
 #include <vector>
+#include <string>
 #include "vec3.h"
 #include "mat4.h"
 #include "color.h"
 #include "ray.h"
 #include <float.h>
+#include <type_traits>
 #include "mempool.h"
 #include "sphere.h"
 #include "threadpool.h"
+#include "pixelcost.h"
+#include "perfcounters.h"
+#include "pathstats.h"
+
+// bounding spheres culled per kernel call in Raycast
+#define RAYCAST_CULL_BLOCK 64
 
 //------------------------------------------------------------------------------
 /**
@@ -58,27 +67,91 @@ struct BoundingSphere
     }
 };
 
+static_assert(std::is_standard_layout<BoundingSphere>::value, "BoundingSphere is stored in scene files as is");
+static_assert(sizeof(BoundingSphere) == 100, "BoundingSphere layout changed, bump the scene file version");
+
+//------------------------------------------------------------------------------
+/**
+    Read-only view of the data the intersection loop works on. Points either
+    at the Raytracer's own storage or at externally owned memory, e.g. a
+    memory-mapped scene file.
+*/
+struct SceneView
+{
+    const PackedSphere* spheres = nullptr;
+    // material index per sphere, parallel to spheres
+    const uint32_t* materialIndices = nullptr;
+    size_t sphereCount = 0;
+
+    const Material* materials = nullptr;
+    size_t materialCount = 0;
+
+    // optional, built by the Raytracer if missing
+    const BoundingSphere* boundingSpheres = nullptr;
+    size_t boundingSphereCount = 0;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Camera and accumulation buffers of one view traced by RaytraceViews
+*/
+struct RaytraceView
+{
+    // camera matrix, like SetViewMatrix
+    mat4 view;
+    // accumulation sum and resolved image, width * height each
+    Color* frameBuffer = nullptr;
+    Color* frameBufferCopy = nullptr;
+    // frames accumulated so far, incremented by RaytraceViews
+    int frameIndex = 0;
+};
+
 class Raytracer
 {
 public:
-    Raytracer(size_t w, size_t h, std::vector<Color>& frameBuffer, std::vector<Color>& frameBufferCopy, size_t rpp, size_t bounces, int maxSpheres);
+    // renders with threads, or with a pool of its own that has a thread per core if there are none
+    Raytracer(size_t w, size_t h, std::vector<Color>& frameBuffer, std::vector<Color>& frameBufferCopy, size_t rpp, size_t bounces, int maxSpheres, ThreadPool* threads = nullptr);
 
     ~Raytracer();
 
-    void CreateBoundingSpheres();
+    // pack the sphere pool into the intersection format and group it into bounding spheres.
+    // false if a sphere has no material or the material table is full, the current scene is kept then
+    bool CreateBoundingSpheres();
+
+    // use externally owned scene data in place, bounding spheres are built if the view has none.
+    // the data must outlive the Raytracer or the next call to SetScene
+    void SetScene(const SceneView& view);
 
     // start raytracing!
     void Raytrace();
 
-    void RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t* rayCount);
+    void RaytraceGroup(int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PathStatistics* stats = nullptr);
+
+    // trace one more frame of every view. Tiles of all views are handed out interleaved,
+    // so views looking at the same part of the scene walk it together instead of once per view
+    void RaytraceViews(RaytraceView* views, size_t viewCount);
+
+    // trace pixels of any camera into any buffers, origin and frustum as set up by UpdateMatrices.
+    // the work done per pixel is added to costBuffer and how paths went to stats, if there are any
+    void RaytraceGroup(const vec3& origin, const mat4& frustum, int frameIndex, Color* frameBuffer, Color* frameBufferCopy,
+        int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PixelCost* costBuffer = nullptr, PathStatistics* stats = nullptr);
 
     // add object to scene
     //void AddObject(Object* obj);
 
     Sphere* GetNewSphere();
 
+    // add material to the scene's material table
+    Material* GetNewMaterial();
+
     // single raycast, find object
-    bool Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, Material*& hitMaterial, float& distance);
+    bool Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance);
+    // same, adding the traversal work to cost
+    bool Raycast(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance, PixelCost* cost);
+
+    // body of both Raycasts, the counting is compiled out unless COUNT_COST
+    template<bool COUNT_COST>
+    bool RaycastScene(const Ray& ray, vec3& hitPoint, vec3& hitNormal, const Material*& hitMaterial, float& distance, PixelCost* cost);
 
     // set camera matrix
     void SetViewMatrix(const mat4& val);
@@ -86,11 +159,30 @@ public:
     // clear screen
     void Clear();
 
+    // continue from an earlier accumulation buffer, frameBufferCopy is resolved from it
+    void Resume(const Color* sum, int frameIndex);
+
+    // group the spheres of the current scene view into bounding spheres, or load them from the cache
+    void BuildBoundingSpheres();
+
+    // directory where built bounding spheres are stored and looked up by scene hash, empty disables caching
+    void SetBoundingSphereCache(const std::string& directory);
+
     // update matrices. Called automatically after setting view matrix
     void UpdateMatrices();
 
     // trace a path and return intersection color
-    Color TracePath(const Ray& ray, uint32_t seed, size_t* rayCount);
+    Color TracePath(const Ray& ray, RandomStream& rng, size_t* rayCount, PixelCost* cost = nullptr, PathStatistics* stats = nullptr);
+
+    // TracePath with the bounce count and material type fixed at compile time, 0 and -1 read them at runtime.
+    // without INSTRUMENTED cost and stats are ignored and their counting compiled out
+    template<int BOUNCES, int MATERIAL, bool INSTRUMENTED>
+    Color TracePathVariant(const Ray& ray, RandomStream& rng, size_t* rayCount, PixelCost* cost, PathStatistics* stats);
+
+    // body of RaytraceGroup for one TracePathVariant, RaytraceGroup picks it once per call
+    template<int BOUNCES, int MATERIAL, bool INSTRUMENTED>
+    void RaytraceGroupVariant(const vec3& origin, const mat4& frustum, int frameIndex, Color* frameBuffer, Color* frameBufferCopy,
+        int pixelX, int pixelY, size_t pixelCount, size_t* rayCount, PixelCost* costBuffer, PathStatistics* stats);
 
     // get the color of the skybox in a direction
     Color Skybox(vec3 direction);
@@ -115,10 +207,36 @@ public:
     mat4 frustum;
 
     MemoryPool<BoundingSphere> boundingSpheres;
+    std::string boundingSphereCacheDirectory;
 
     MemoryPool<Sphere> spheres;
+    // contiguous material table, indexed by sphereMaterialIndices
+    MemoryPool<Material> materials;
+
+    // packed intersection data, built from the sphere pool by CreateBoundingSpheres
+    std::vector<PackedSphere> packedSpheres;
+    // material index per packed sphere, parallel to packedSpheres
+    std::vector<uint32_t> sphereMaterialIndices;
+
+    // what Raycast traces against, either the storage above or an external scene
+    SceneView scene;
+    // MaterialType shared by every material of the scene, -1 if they differ. set by SetScene
+    int sceneMaterialType = -1;
+    // centers and radii of scene.boundingSpheres as separate arrays, filled by SetScene
+    std::vector<float> boundsX;
+    std::vector<float> boundsY;
+    std::vector<float> boundsZ;
+    std::vector<float> boundsRadius;
+
     std::vector<size_t> rayCounters;
-    ThreadPool renderThreads;
+    // optional, width * height work counters summed over the frames Raytrace renders. zeroed by Clear
+    PixelCost* costBuffer = nullptr;
+    // optional, one per render thread. each thread opens its own on the first frame and counts its part of every frame
+    PerfCounters* perfCounters = nullptr;
+    // optional, one per render thread, summed over the frames Raytrace renders. zeroed by Clear
+    PathStatistics* pathStatistics = nullptr;
+    std::unique_ptr<ThreadPool> ownThreads;
+    ThreadPool& renderThreads;
 };
 
 inline Sphere* Raytracer::GetNewSphere()
@@ -126,6 +244,16 @@ inline Sphere* Raytracer::GetNewSphere()
     return this->spheres.GetNew();
 }
 
+inline Material* Raytracer::GetNewMaterial()
+{
+    return this->materials.GetNew();
+}
+
+inline void Raytracer::SetBoundingSphereCache(const std::string& directory)
+{
+    this->boundingSphereCacheDirectory = directory;
+}
+
 inline void Raytracer::SetViewMatrix(const mat4& val)
 {
     this->view = val;
@@ -0,0 +1,489 @@
+#include "renderfarm.h"
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+// how long the coordinator waits for messages before checking timeouts
+#define FARM_POLL_MILLISECONDS 100
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+SendFarmMessage(Socket& socket, FarmMessage type, const void* payload, size_t size, const void* extra = nullptr, size_t extraSize = 0)
+{
+    FarmMessageHeader header;
+    header.magic = FARM_MAGIC;
+    header.type = type;
+    header.size = size + extraSize;
+
+    return socket.Send(&header, sizeof(header)) &&
+        (size == 0 || socket.Send(payload, size)) &&
+        (extraSize == 0 || socket.Send(extra, extraSize));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FarmCoordinator::FarmCoordinator(Raytracer& rt, size_t tileSize) :
+    rt(rt),
+    tilesLeft(0),
+    taskTimeout(0.f),
+    workerCount(0),
+    taskCount(0),
+    retryCount(0),
+    rayCount(0)
+{
+    tileSize = tileSize == 0 ? 64 : tileSize;
+    maxPayload = std::max(sizeof(FarmHello), sizeof(FarmResult) + tileSize * tileSize * sizeof(Color));
+    for (size_t y = 0; y < rt.height; y += tileSize)
+    {
+        for (size_t x = 0; x < rt.width; x += tileSize)
+        {
+            Tile tile;
+            tile.x = uint32_t(x);
+            tile.y = uint32_t(y);
+            tile.width = uint32_t(std::min(tileSize, rt.width - x));
+            tile.height = uint32_t(std::min(tileSize, rt.height - y));
+            tile.cost = 0.0;
+            tiles.push_back(tile);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+FarmCoordinator::Run(uint16_t port, int frameCount, int framesPerPass, bool loopbackOnly)
+{
+    Socket listener;
+    if (!listener.Listen(port, loopbackOnly))
+    {
+        error = "failed to listen on port " + std::to_string(port);
+        return false;
+    }
+
+    framesPerPass = framesPerPass < 1 ? 1 : framesPerPass;
+    std::vector<Socket*> sockets;
+
+    while (rt.frameIndex < frameCount)
+    {
+        int firstFrame = rt.frameIndex;
+        int passFrames = std::min(framesPerPass, frameCount - firstFrame);
+
+        // most expensive tiles first, the first pass has no costs yet and keeps scanline order
+        std::vector<int> order(tiles.size());
+        for (size_t i = 0; i < tiles.size(); i++)
+            order[i] = int(i);
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return tiles[a].cost > tiles[b].cost; });
+        queue.assign(order.begin(), order.end());
+        tilesLeft = tiles.size();
+
+        while (tilesLeft > 0)
+        {
+            for (Worker& worker : workers)
+            {
+                if (worker.accepted && worker.tile == -1 && !queue.empty())
+                {
+                    int tile = queue.front();
+                    queue.pop_front();
+                    if (!SendTask(worker, tile, firstFrame, passFrames))
+                        worker.socket.Close();
+                }
+            }
+
+            // the listener is polled last, after the workers
+            sockets.clear();
+            for (Worker& worker : workers)
+                sockets.push_back(&worker.socket);
+            sockets.push_back(&listener);
+            std::unique_ptr<bool[]> readable(new bool[sockets.size()]);
+
+            if (Socket::Poll(sockets.data(), sockets.size(), readable.get(), FARM_POLL_MILLISECONDS) < 0)
+            {
+                error = "polling the workers failed";
+                return false;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < workers.size(); i++)
+            {
+                Worker& worker = workers[i];
+                if (worker.socket.IsOpen() && readable[i] && !ReceiveMessage(worker, passFrames))
+                    worker.socket.Close();
+
+                std::chrono::duration<float> elapsed = now - worker.taskStart;
+                if (worker.socket.IsOpen() && worker.tile != -1 && taskTimeout > 0.f && elapsed.count() > taskTimeout)
+                    worker.socket.Close();
+            }
+
+            // closed sockets are only removed here, so indices stay valid while handling messages
+            for (size_t i = workers.size(); i-- > 0;)
+            {
+                if (!workers[i].socket.IsOpen())
+                    DropWorker(i);
+            }
+
+            // before the first worker joins the coordinator waits for as long as it takes
+            if (workers.empty() && workerCount > 0)
+            {
+                error = "every worker disconnected with " + std::to_string(tilesLeft) + " tiles of the pass left";
+                return false;
+            }
+
+            if (readable[sockets.size() - 1])
+            {
+                Worker worker;
+                if (listener.Accept(worker.socket))
+                    workers.push_back(std::move(worker));
+            }
+        }
+
+        rt.frameIndex += passFrames;
+    }
+
+    for (Worker& worker : workers)
+        SendFarmMessage(worker.socket, FarmMessage::Done, nullptr, 0);
+    workers.clear();
+
+    rt.Resume(rt.frameBuffer.data(), rt.frameIndex);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+FarmCoordinator::ReceiveMessage(Worker& worker, int passFrames)
+{
+    bool complete = false;
+    if (!worker.message.Receive(worker.socket, maxPayload, complete))
+        return false;
+    if (!complete)
+        return true;
+
+    worker.message.Reset();
+    return HandleMessage(worker, passFrames);
+}
+
+//------------------------------------------------------------------------------
+/**
+    The payload is all there, only its size still has to be checked
+*/
+bool
+FarmCoordinator::HandleMessage(Worker& worker, int passFrames)
+{
+    const FarmMessageHeader& header = worker.message.header;
+    const std::vector<uint8_t>& payload = worker.message.payload;
+    if (header.magic != FARM_MAGIC)
+        return false;
+
+    if (header.type == FarmMessage::Hello && !worker.accepted)
+    {
+        FarmHello hello;
+        if (header.size != sizeof(hello))
+            return false;
+        memcpy(&hello, payload.data(), sizeof(hello));
+
+        // a worker rendering a different image would silently corrupt the result
+        if (hello.version != FARM_VERSION || !CheckpointMatches(hello.settings, rt))
+        {
+            SendFarmMessage(worker.socket, FarmMessage::Rejected, nullptr, 0);
+            return false;
+        }
+
+        worker.accepted = true;
+        workerCount++;
+        return true;
+    }
+
+    if (header.type == FarmMessage::Result && worker.tile != -1)
+    {
+        FarmResult result;
+        const Tile& tile = tiles[worker.tile];
+        size_t pixelCount = size_t(tile.width) * tile.height;
+        if (header.size != sizeof(result) + pixelCount * sizeof(Color))
+            return false;
+        memcpy(&result, payload.data(), sizeof(result));
+        if (result.tileIndex != uint32_t(worker.tile))
+            return false;
+
+        // the worker continued from the sum it was sent, so its sum replaces the old one
+        const Color* in = (const Color*)(payload.data() + sizeof(result));
+        for (uint32_t y = 0; y < tile.height; y++)
+        {
+            Color* out = rt.frameBuffer.data() + (tile.y + y) * rt.width + tile.x;
+            std::copy(in, in + tile.width, out);
+            in += tile.width;
+        }
+
+        tiles[worker.tile].cost = result.milliseconds / passFrames;
+        worker.tile = -1;
+        tilesLeft--;
+        taskCount++;
+        rayCount += result.rayCount;
+        return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+FarmCoordinator::SendTask(Worker& worker, int tile, int firstFrame, int passFrames)
+{
+    const Tile& t = tiles[tile];
+    FarmTask task;
+    task.tileIndex = uint32_t(tile);
+    task.x = t.x;
+    task.y = t.y;
+    task.width = t.width;
+    task.height = t.height;
+    task.firstFrame = uint32_t(firstFrame);
+    task.frameCount = uint32_t(passFrames);
+    task.reserved = 0;
+
+    taskSum.resize(size_t(t.width) * t.height);
+    for (uint32_t y = 0; y < t.height; y++)
+    {
+        const Color* row = rt.frameBuffer.data() + (t.y + y) * rt.width + t.x;
+        std::copy(row, row + t.width, taskSum.data() + y * t.width);
+    }
+
+    worker.tile = tile;
+    worker.taskStart = std::chrono::steady_clock::now();
+    return SendFarmMessage(worker.socket, FarmMessage::Task, &task, sizeof(task), taskSum.data(), taskSum.size() * sizeof(Color));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FarmCoordinator::DropWorker(size_t index)
+{
+    // hand the unfinished tile to the next idle worker
+    if (workers[index].tile != -1)
+    {
+        queue.push_front(workers[index].tile);
+        retryCount++;
+    }
+    workers.erase(workers.begin() + index);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FarmCoordinator::SetTaskTimeout(float seconds)
+{
+    taskTimeout = seconds;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const std::string&
+FarmCoordinator::GetError() const
+{
+    return error;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+FarmCoordinator::WorkerCount() const
+{
+    return workerCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+FarmCoordinator::TaskCount() const
+{
+    return taskCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+FarmCoordinator::RetryCount() const
+{
+    return retryCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+FarmCoordinator::RayCount() const
+{
+    return rayCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FarmWorker::FarmWorker(Raytracer& rt) :
+    rt(rt),
+    task(),
+    nextRow(0),
+    taskCount(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+FarmWorker::Run(const char* host, uint16_t port, float connectTimeout)
+{
+    // workers are often started before the coordinator is listening
+    Socket socket;
+    auto start = std::chrono::steady_clock::now();
+    while (!socket.Connect(host, port))
+    {
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() > connectTimeout)
+        {
+            error = "failed to connect to " + std::string(host) + ":" + std::to_string(port);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    FarmHello hello;
+    hello.version = FARM_VERSION;
+    hello.reserved = 0;
+    hello.settings = MakeCheckpointHeader(rt);
+    if (!SendFarmMessage(socket, FarmMessage::Hello, &hello, sizeof(hello)))
+    {
+        error = "lost the coordinator";
+        return false;
+    }
+
+    while (true)
+    {
+        FarmMessageHeader header;
+        if (!socket.Receive(&header, sizeof(header)) || header.magic != FARM_MAGIC)
+        {
+            error = "lost the coordinator";
+            return false;
+        }
+
+        if (header.type == FarmMessage::Done)
+            return true;
+
+        if (header.type == FarmMessage::Rejected)
+        {
+            error = "the coordinator renders a different scene, camera or settings";
+            return false;
+        }
+
+        // the tile has to be inside the frame and its sum has to follow the task
+        bool ok = header.type == FarmMessage::Task && header.size >= sizeof(task) && socket.Receive(&task, sizeof(task)) &&
+            task.x < rt.width && task.width <= rt.width - task.x && task.y < rt.height && task.height <= rt.height - task.y &&
+            header.size == sizeof(task) + size_t(task.width) * task.height * sizeof(Color);
+        if (ok)
+        {
+            sum.resize(size_t(task.width) * task.height);
+            ok = socket.Receive(sum.data(), sum.size() * sizeof(Color));
+        }
+        if (!ok)
+        {
+            error = "unexpected message from the coordinator";
+            return false;
+        }
+
+        auto taskStart = std::chrono::steady_clock::now();
+        uint64_t rayCount = RenderTask(task);
+        std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - taskStart;
+
+        FarmResult result;
+        result.tileIndex = task.tileIndex;
+        result.reserved = 0;
+        result.milliseconds = duration.count();
+        result.rayCount = rayCount;
+        if (!SendFarmMessage(socket, FarmMessage::Result, &result, sizeof(result), sum.data(), sum.size() * sizeof(Color)))
+        {
+            error = "lost the coordinator";
+            return false;
+        }
+        taskCount++;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+FarmWorker::RenderTask(const FarmTask& task)
+{
+    // frames are added to the sum the coordinator sent, in the order a local render adds them
+    for (uint32_t y = 0; y < task.height; y++)
+    {
+        const Color* in = sum.data() + y * task.width;
+        std::copy(in, in + task.width, rt.frameBuffer.data() + (task.y + y) * rt.width + task.x);
+    }
+
+    ThreadPool& threads = rt.renderThreads;
+    for (size_t i = 0; i < threads.size; i++)
+        threads.InitThread<WorkArgs>(Work, { this, i }, i);
+
+    uint64_t rayCount = 0;
+    for (uint32_t frame = 1; frame <= task.frameCount; frame++)
+    {
+        rt.frameIndex = int(task.firstFrame + frame);
+        nextRow = 0;
+        threads.ExecuteAndWait();
+        for (size_t rays : rt.rayCounters)
+            rayCount += rays;
+    }
+
+    sum.resize(size_t(task.width) * task.height);
+    for (uint32_t y = 0; y < task.height; y++)
+    {
+        const Color* row = rt.frameBuffer.data() + (task.y + y) * rt.width + task.x;
+        std::copy(row, row + task.width, sum.data() + y * task.width);
+    }
+    return rayCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FarmWorker::Work(const WorkArgs& args)
+{
+    FarmWorker* self = args.self;
+    const FarmTask& task = self->task;
+    size_t rayCount = 0;
+    for (uint32_t row = self->nextRow++; row < task.height; row = self->nextRow++)
+        self->rt.RaytraceGroup(int(task.x), int(task.y + row), task.width, &rayCount);
+    self->rt.rayCounters[args.threadIndex] = rayCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const std::string&
+FarmWorker::GetError() const
+{
+    return error;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+FarmWorker::TaskCount() const
+{
+    return taskCount;
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include "raytracer.h"
+#include "checkpoint.h"
+#include "socket.h"
+
+#define FARM_MAGIC 0x4d464252 // "RBFM"
+#define FARM_VERSION 5
+
+enum class FarmMessage : uint32_t
+{
+    // worker to coordinator: FarmHello
+    Hello,
+    // coordinator to worker: FarmTask followed by the accumulation sum of the tile so far
+    Task,
+    // worker to coordinator: FarmResult followed by the tile's accumulation sum with the task's frames added
+    Result,
+    // coordinator to worker: no more work
+    Done,
+    // coordinator to worker: the worker renders something else
+    Rejected
+};
+
+struct FarmMessageHeader
+{
+    uint32_t magic;
+    FarmMessage type;
+    // payload bytes following the header
+    uint64_t size;
+};
+
+struct FarmHello
+{
+    uint32_t version;
+    uint32_t reserved;
+    // the worker's render settings, frameIndex is unused
+    CheckpointHeader settings;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Accumulate frames firstFrame + 1 to firstFrame + frameCount of a tile,
+    counted like Raytracer::frameIndex
+*/
+struct FarmTask
+{
+    uint32_t tileIndex;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t reserved;
+};
+
+struct FarmResult
+{
+    uint32_t tileIndex;
+    uint32_t reserved;
+    // time the worker spent tracing
+    double milliseconds;
+    // rays traced for the tile over all its frames
+    uint64_t rayCount;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Hands out tiles of the Raytracer's frame to worker processes and
+    accumulates their results into its frameBuffer.
+
+    Frames are rendered in passes of framesPerPass frames. Workers pull one
+    tile at a time, so fast workers simply take more of them. After the first
+    pass every tile has a measured cost and later passes hand out the most
+    expensive tiles first, which keeps a slow tile from finishing a pass alone.
+
+    A worker that disconnects, sends garbage or holds a task past the timeout
+    is dropped and its tile goes back to the front of the queue. Messages are
+    collected without blocking, so a worker that stalls halfway through one
+    is caught by the timeout as well. The render fails once every worker
+    that joined is gone.
+
+    Samples are seeded by pixel and sample index, and every task carries the
+    tile's running sum for the worker to continue, so frames are added in
+    the same order as in a local render. The image is the same no matter
+    how tiles were split, how many passes there were and who rendered them.
+*/
+class FarmCoordinator
+{
+public:
+    FarmCoordinator(Raytracer& rt, size_t tileSize);
+
+    // listen on port and render until rt.frameIndex reaches frameCount, frameBufferCopy is resolved at the end.
+    // by default only workers on this machine can connect, the protocol has no authentication
+    bool Run(uint16_t port, int frameCount, int framesPerPass, bool loopbackOnly = true);
+
+    // drop workers that hold a task for longer than this, 0 waits forever
+    void SetTaskTimeout(float seconds);
+
+    const std::string& GetError() const;
+    // workers that joined, tasks completed and tasks that had to be handed out again
+    size_t WorkerCount() const;
+    size_t TaskCount() const;
+    size_t RetryCount() const;
+    // rays the workers traced for completed tasks
+    uint64_t RayCount() const;
+
+private:
+    struct Tile
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        // measured milliseconds per frame, 0 until rendered once
+        double cost;
+    };
+
+    struct Worker
+    {
+        Socket socket;
+        bool accepted = false;
+        // tile being rendered, -1 if idle
+        int tile = -1;
+        std::chrono::steady_clock::time_point taskStart;
+        // message being received
+        SocketMessage<FarmMessageHeader> message;
+    };
+
+    // read what arrived and handle the message once it is complete, false drops the worker
+    bool ReceiveMessage(Worker& worker, int passFrames);
+    bool HandleMessage(Worker& worker, int passFrames);
+    bool SendTask(Worker& worker, int tile, int firstFrame, int passFrames);
+    void DropWorker(size_t index);
+
+    Raytracer& rt;
+    std::vector<Tile> tiles;
+    std::vector<Worker> workers;
+    // tiles left in the current pass, in the order they are handed out
+    std::deque<int> queue;
+    size_t tilesLeft;
+    // largest message a worker may send
+    size_t maxPayload;
+    // running sum of the tile being sent
+    std::vector<Color> taskSum;
+
+    float taskTimeout;
+    std::string error;
+    size_t workerCount;
+    size_t taskCount;
+    size_t retryCount;
+    uint64_t rayCount;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Renders tiles for a FarmCoordinator with the render threads of its
+    Raytracer. The Raytracer has to be set up with the same scene, camera and
+    settings, which the coordinator checks on connect.
+*/
+class FarmWorker
+{
+public:
+    FarmWorker(Raytracer& rt);
+
+    // connect, retrying for connectTimeout seconds, and render tasks until the coordinator is done
+    bool Run(const char* host, uint16_t port, float connectTimeout = 10.f);
+
+    const std::string& GetError() const;
+    size_t TaskCount() const;
+
+private:
+    struct WorkArgs
+    {
+        FarmWorker* self;
+        size_t threadIndex;
+    };
+
+    static void Work(const WorkArgs& args);
+    // returns the rays traced
+    uint64_t RenderTask(const FarmTask& task);
+
+    Raytracer& rt;
+
+    // current task, rows are pulled by the threads of a frame
+    FarmTask task;
+    std::atomic<uint32_t> nextRow;
+    std::vector<Color> sum;
+
+    std::string error;
+    size_t taskCount;
+};
@@ -0,0 +1,738 @@
+#include "renderserver.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// how long an idle server waits for messages before checking for Stop
+#define SERVER_POLL_MILLISECONDS 100
+// largest accepted image edge
+#define SERVER_MAX_SIZE 16384
+// most bounces a job may ask for
+#define SERVER_MAX_BOUNCES 64
+// jobs and pixels of all jobs that may be queued at once, each pixel takes two Colors once its job starts
+#define SERVER_MAX_JOBS 64
+#define SERVER_MAX_QUEUED_PIXELS (size_t(1) << 25)
+// unsent bytes above which a client's progress images are skipped
+#define SERVER_PROGRESS_BACKLOG (32 << 20)
+// unsent bytes at which a client is dropped
+#define SERVER_MAX_BACKLOG (size_t(1) << 30)
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+SendServerMessage(Socket& socket, RenderMessage type, const void* payload, size_t size, const void* extra = nullptr, size_t extraSize = 0)
+{
+    RenderMessageHeader header;
+    header.magic = RENDER_SERVER_MAGIC;
+    header.type = type;
+    header.size = size + extraSize;
+
+    return socket.Send(&header, sizeof(header)) &&
+        (size == 0 || socket.Send(payload, size)) &&
+        (extraSize == 0 || socket.Send(extra, extraSize));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+RenderServer::RenderServer(size_t threadCount) :
+    threads(threadCount == 0 ? 1 : threadCount),
+    raytracerJob(0),
+    maxPayload(std::max(sizeof(RenderJobRequest), sizeof(RenderJobCancel))),
+    nextClientId(1),
+    nextJobId(1),
+    finishedJobCount(0),
+    stop(false)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+RenderServer::~RenderServer()
+{
+    // the Raytracer points into a job's buffers
+    raytracer.reset();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::AddScene(const std::string& id, const char* path)
+{
+    if (id.empty() || id.size() >= RENDER_SCENE_ID_SIZE || FindScene(id.c_str()) != nullptr)
+    {
+        error = "scene id '" + id + "' is empty, too long or used twice";
+        return false;
+    }
+
+    std::unique_ptr<Scene> scene(new Scene());
+    scene->id = id;
+    if (!scene->file.Open(path))
+    {
+        error = "failed to open scene file '" + std::string(path) + "'";
+        return false;
+    }
+
+    TakeScene(*scene, scene->file.GetView(), false);
+    scenes.push_back(std::move(scene));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::AddTextScene(const std::string& id, const char* path)
+{
+    if (id.empty() || id.size() >= RENDER_SCENE_ID_SIZE || FindScene(id.c_str()) != nullptr)
+    {
+        error = "scene id '" + id + "' is empty, too long or used twice";
+        return false;
+    }
+
+    TextSceneLoader loader(threads);
+    if (!loader.Open(path))
+    {
+        error = "failed to open text scene: " + loader.GetError();
+        return false;
+    }
+
+    // the pools are filled the same way the tester does, then packed by CreateBoundingSpheres
+    int poolSize = int(std::max(loader.SphereCount(), loader.MaterialCount()));
+    std::vector<Color> frameBuffer(1);
+    std::vector<Color> frameBufferCopy(1);
+    Raytracer rt(1, 1, frameBuffer, frameBufferCopy, 1, 1, poolSize, &threads);
+    rt.SetBoundingSphereCache(cacheDirectory);
+    if (!loader.Load(rt.spheres, rt.materials))
+    {
+        error = "failed to parse text scene: " + loader.GetError();
+        return false;
+    }
+    if (!rt.CreateBoundingSpheres())
+    {
+        error = "text scene '" + std::string(path) + "' has a sphere without material";
+        return false;
+    }
+
+    std::unique_ptr<Scene> scene(new Scene());
+    scene->id = id;
+    scene->hasCamera = loader.HasCamera();
+    scene->camera = loader.GetCamera();
+    TakeScene(*scene, rt.scene, true);
+    scenes.push_back(std::move(scene));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    The bounding spheres are built by a throwaway Raytracer, everything it
+    owns is copied out before it goes away
+*/
+void
+RenderServer::TakeScene(Scene& scene, const SceneView& view, bool copySpheres)
+{
+    scene.view = view;
+    if (copySpheres)
+    {
+        scene.spheres.assign(view.spheres, view.spheres + view.sphereCount);
+        scene.materialIndices.assign(view.materialIndices, view.materialIndices + view.sphereCount);
+        scene.materials.assign(view.materials, view.materials + view.materialCount);
+        scene.view.spheres = scene.spheres.data();
+        scene.view.materialIndices = scene.materialIndices.data();
+        scene.view.materials = scene.materials.data();
+    }
+
+    const BoundingSphere* boundingSpheres = view.boundingSpheres;
+    size_t boundingSphereCount = view.boundingSphereCount;
+    std::vector<Color> frameBuffer(1);
+    std::vector<Color> frameBufferCopy(1);
+    std::unique_ptr<Raytracer> builder;
+    if (boundingSpheres == nullptr)
+    {
+        builder.reset(new Raytracer(1, 1, frameBuffer, frameBufferCopy, 1, 1, int(view.sphereCount), &threads));
+        builder->SetBoundingSphereCache(cacheDirectory);
+        builder->SetScene(scene.view);
+        boundingSpheres = builder->scene.boundingSpheres;
+        boundingSphereCount = builder->scene.boundingSphereCount;
+    }
+
+    if (copySpheres || builder)
+    {
+        scene.boundingSpheres.assign(boundingSpheres, boundingSpheres + boundingSphereCount);
+        scene.view.boundingSpheres = scene.boundingSpheres.data();
+        scene.view.boundingSphereCount = scene.boundingSpheres.size();
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+RenderServer::SetBoundingSphereCache(const std::string& directory)
+{
+    cacheDirectory = directory;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::Run(uint16_t port, bool loopbackOnly)
+{
+    Socket listener;
+    if (!listener.Listen(port, loopbackOnly))
+    {
+        error = "failed to listen on port " + std::to_string(port);
+        return false;
+    }
+
+    std::vector<Socket*> sockets;
+    while (!stop)
+    {
+        // the listener is polled last, after the clients
+        sockets.clear();
+        for (Client& client : clients)
+            sockets.push_back(&client.socket);
+        sockets.push_back(&listener);
+        std::unique_ptr<bool[]> readable(new bool[sockets.size()]);
+        std::unique_ptr<bool[]> wantWritable(new bool[sockets.size()]);
+        std::unique_ptr<bool[]> writable(new bool[sockets.size()]);
+        for (size_t i = 0; i < sockets.size(); i++)
+            wantWritable[i] = i < clients.size() && clients[i].outboxSent < clients[i].outbox.size();
+
+        // only peek between frames while there is work, sleep in poll otherwise
+        int timeout = jobs.empty() ? SERVER_POLL_MILLISECONDS : 0;
+        if (Socket::Poll(sockets.data(), sockets.size(), readable.get(), timeout, wantWritable.get(), writable.get()) < 0)
+        {
+            // a signal calling Stop interrupts the poll
+            if (stop)
+                break;
+            error = "polling the clients failed";
+            return false;
+        }
+
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            if (clients[i].socket.IsOpen() && writable[i] && !FlushClient(clients[i]))
+                clients[i].socket.Close();
+            if (clients[i].socket.IsOpen() && readable[i] && !ReceiveMessage(clients[i]))
+                clients[i].socket.Close();
+        }
+
+        // closed sockets are only removed here, so indices stay valid while handling messages
+        for (size_t i = clients.size(); i-- > 0;)
+        {
+            if (!clients[i].socket.IsOpen())
+                DropClient(i);
+        }
+
+        if (readable[sockets.size() - 1])
+        {
+            Client client;
+            if (listener.Accept(client.socket) && client.socket.SetNonBlocking())
+            {
+                client.id = nextClientId++;
+                clients.push_back(std::move(client));
+            }
+        }
+
+        Job* job = NextJob();
+        if (job != nullptr && !RenderFrame(*job))
+        {
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                if (jobs[i].get() == job)
+                {
+                    RemoveJob(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    raytracer.reset();
+    jobs.clear();
+    clients.clear();
+    stop = false;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+RenderServer::Stop()
+{
+    stop = true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::ReceiveMessage(Client& client)
+{
+    bool complete = false;
+    if (!client.message.Receive(client.socket, maxPayload, complete))
+        return false;
+    if (!complete)
+        return true;
+
+    client.message.Reset();
+    return HandleMessage(client);
+}
+
+//------------------------------------------------------------------------------
+/**
+    The payload is all there, only its size still has to be checked
+*/
+bool
+RenderServer::HandleMessage(Client& client)
+{
+    const RenderMessageHeader& header = client.message.header;
+    const std::vector<uint8_t>& payload = client.message.payload;
+    if (header.magic != RENDER_SERVER_MAGIC)
+        return false;
+
+    if (header.type == RenderMessage::Submit)
+    {
+        RenderJobRequest request;
+        if (header.size != sizeof(request))
+            return false;
+        memcpy(&request, payload.data(), sizeof(request));
+        return HandleSubmit(client, request);
+    }
+
+    if (header.type == RenderMessage::Cancel)
+    {
+        RenderJobCancel cancel;
+        if (header.size != sizeof(cancel))
+            return false;
+        memcpy(&cancel, payload.data(), sizeof(cancel));
+
+        // only the submitting client may cancel, unknown or finished jobs are ignored
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            if (jobs[i]->id == cancel.jobId && jobs[i]->clientId == client.id)
+            {
+                RemoveJob(i);
+                break;
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::HandleSubmit(Client& client, const RenderJobRequest& request)
+{
+    std::string reason;
+    const Scene* scene = nullptr;
+    size_t pixelCount = size_t(request.width) * request.height;
+    size_t queuedPixels = 0;
+    for (const auto& other : jobs)
+        queuedPixels += size_t(other->request.width) * other->request.height;
+
+    if (request.version != RENDER_SERVER_VERSION)
+    {
+        reason = "the client speaks a different protocol version";
+    }
+    else if (memchr(request.sceneId, 0, sizeof(request.sceneId)) == nullptr || (scene = FindScene(request.sceneId)) == nullptr)
+    {
+        reason = "unknown scene, the server has:";
+        for (const auto& s : scenes)
+            reason += " " + s->id;
+    }
+    else if (request.width == 0 || request.height == 0 || request.width > SERVER_MAX_SIZE || request.height > SERVER_MAX_SIZE)
+    {
+        reason = "the image has to be 1 to " + std::to_string(SERVER_MAX_SIZE) + " pixels wide and high";
+    }
+    else if (request.samplesPerFrame == 0 || request.samplesPerPixel == 0 || request.samplesPerPixel % request.samplesPerFrame != 0)
+    {
+        reason = "samplesPerPixel has to be a non zero multiple of samplesPerFrame";
+    }
+    else if (request.bounces == 0 || request.bounces > SERVER_MAX_BOUNCES)
+    {
+        reason = "bounces has to be 1 to " + std::to_string(SERVER_MAX_BOUNCES);
+    }
+    else if (jobs.size() >= SERVER_MAX_JOBS || queuedPixels + pixelCount > SERVER_MAX_QUEUED_PIXELS)
+    {
+        reason = "the server is full, it queues up to " + std::to_string(SERVER_MAX_JOBS) + " jobs of " +
+            std::to_string(SERVER_MAX_QUEUED_PIXELS) + " pixels together";
+    }
+
+    if (!reason.empty())
+        return QueueMessage(client, RenderMessage::Rejected, reason.data(), reason.size());
+
+    std::unique_ptr<Job> job(new Job());
+    job->id = nextJobId++;
+    job->clientId = client.id;
+    job->request = request;
+    job->scene = scene;
+    job->frameCount = request.samplesPerPixel / request.samplesPerFrame;
+
+    SceneCamera camera;
+    camera.position = { request.cameraPosition[0], request.cameraPosition[1], request.cameraPosition[2] };
+    camera.rotationX = request.cameraRotationX;
+    camera.rotationY = request.cameraRotationY;
+    job->view = SceneCameraMatrix(request.useSceneCamera && scene->hasCamera ? scene->camera : camera);
+
+    RenderJobAccepted accepted;
+    accepted.jobId = job->id;
+    accepted.queueLength = 1;
+    for (const auto& other : jobs)
+        accepted.queueLength += other->request.priority >= request.priority ? 1 : 0;
+
+    jobs.push_back(std::move(job));
+    return QueueMessage(client, RenderMessage::Accepted, &accepted, sizeof(accepted));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::QueueMessage(Client& client, RenderMessage type, const void* payload, size_t size, const void* extra, size_t extraSize)
+{
+    if (client.outbox.size() - client.outboxSent + sizeof(RenderMessageHeader) + size + extraSize > SERVER_MAX_BACKLOG)
+        return false;
+
+    RenderMessageHeader header;
+    header.magic = RENDER_SERVER_MAGIC;
+    header.type = type;
+    header.size = size + extraSize;
+
+    const uint8_t* bytes = (const uint8_t*)&header;
+    client.outbox.insert(client.outbox.end(), bytes, bytes + sizeof(header));
+    client.outbox.insert(client.outbox.end(), (const uint8_t*)payload, (const uint8_t*)payload + size);
+    client.outbox.insert(client.outbox.end(), (const uint8_t*)extra, (const uint8_t*)extra + extraSize);
+    return FlushClient(client);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Sends until the socket's buffer is full, the rest waits for the next poll
+    that reports the socket writable
+*/
+bool
+RenderServer::FlushClient(Client& client)
+{
+    while (client.outboxSent < client.outbox.size())
+    {
+        int64_t sent = client.socket.SendSome(client.outbox.data() + client.outboxSent, client.outbox.size() - client.outboxSent);
+        if (sent < 0)
+            return false;
+        if (sent == 0)
+            break;
+        client.outboxSent += size_t(sent);
+    }
+
+    // sent bytes are dropped once they are the larger part, so moving the rest stays cheap
+    if (client.outboxSent == client.outbox.size())
+    {
+        client.outbox.clear();
+        client.outboxSent = 0;
+    }
+    else if (client.outboxSent > client.outbox.size() / 2)
+    {
+        client.outbox.erase(client.outbox.begin(), client.outbox.begin() + client.outboxSent);
+        client.outboxSent = 0;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+RenderServer::DropClient(size_t index)
+{
+    uint32_t id = clients[index].id;
+    for (size_t i = jobs.size(); i-- > 0;)
+    {
+        if (jobs[i]->clientId == id)
+            RemoveJob(i);
+    }
+    clients.erase(clients.begin() + index);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+RenderServer::RemoveJob(size_t index)
+{
+    if (raytracer && raytracerJob == jobs[index]->id)
+        raytracer.reset();
+    jobs.erase(jobs.begin() + index);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Jobs are kept in submission order, so the first of the highest priority
+    is the oldest
+*/
+RenderServer::Job*
+RenderServer::NextJob()
+{
+    Job* next = nullptr;
+    for (const auto& job : jobs)
+    {
+        if (next == nullptr || job->request.priority > next->request.priority)
+            next = job.get();
+    }
+    return next;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::RenderFrame(Job& job)
+{
+    // a preempted job continues from its own buffers and frame index
+    if (!raytracer || raytracerJob != job.id)
+    {
+        // only the buffers and view change hands, the render threads are the server's
+        const RenderJobRequest& request = job.request;
+        if (job.frameBuffer.empty())
+        {
+            // allocated once the job is on top of the queue, jobs that wait don't hold images
+            size_t pixelCount = size_t(request.width) * request.height;
+            job.frameBuffer.resize(pixelCount);
+            job.frameBufferCopy.resize(pixelCount);
+        }
+        raytracer.reset(new Raytracer(request.width, request.height, job.frameBuffer, job.frameBufferCopy, request.samplesPerFrame, request.bounces, 0, &threads));
+        raytracer->SetScene(job.scene->view);
+        raytracer->SetViewMatrix(job.view);
+        raytracer->frameIndex = job.frameIndex;
+        raytracerJob = job.id;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    raytracer->Raytrace();
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+    job.milliseconds += duration.count();
+    job.frameIndex = raytracer->frameIndex;
+    for (size_t rays : raytracer->rayCounters)
+        job.rayCount += rays;
+
+    bool finished = uint32_t(job.frameIndex) >= job.frameCount;
+    uint32_t progressFrames = job.request.progressFrames;
+    if (finished)
+    {
+        SendUpdate(job, RenderMessage::Finished);
+        finishedJobCount++;
+    }
+    else if (progressFrames > 0 && job.frameIndex % progressFrames == 0)
+    {
+        SendUpdate(job, RenderMessage::Progress);
+    }
+
+    return !finished;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderServer::SendUpdate(Job& job, RenderMessage type)
+{
+    Client* client = FindClient(job.clientId);
+    if (client == nullptr || !client->socket.IsOpen())
+        return false;
+
+    // a client that doesn't keep up with the images misses some, the final one is always queued
+    if (type == RenderMessage::Progress && client->outbox.size() - client->outboxSent > SERVER_PROGRESS_BACKLOG)
+        return true;
+
+    RenderJobUpdate update;
+    update.jobId = job.id;
+    update.frameIndex = uint32_t(job.frameIndex);
+    update.frameCount = job.frameCount;
+    update.width = job.request.width;
+    update.height = job.request.height;
+    update.reserved = 0;
+    update.rayCount = job.rayCount;
+    update.milliseconds = job.milliseconds;
+
+    // a client that can't be reached or is too far behind is dropped along with its jobs on the next poll
+    if (!QueueMessage(*client, type, &update, sizeof(update), job.frameBufferCopy.data(), job.frameBufferCopy.size() * sizeof(Color)))
+    {
+        client->socket.Close();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+RenderServer::Client*
+RenderServer::FindClient(uint32_t id)
+{
+    for (Client& client : clients)
+    {
+        if (client.id == id)
+            return &client;
+    }
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const RenderServer::Scene*
+RenderServer::FindScene(const char* id) const
+{
+    for (const auto& scene : scenes)
+    {
+        if (scene->id == id)
+            return scene.get();
+    }
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const std::string&
+RenderServer::GetError() const
+{
+    return error;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+RenderServer::SceneCount() const
+{
+    return scenes.size();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+RenderServer::FinishedJobCount() const
+{
+    return finishedJobCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderClient::Connect(const char* host, uint16_t port, float timeout)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (!socket.Connect(host, port))
+    {
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() > timeout)
+        {
+            error = "failed to connect to " + std::string(host) + ":" + std::to_string(port);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderClient::Submit(const RenderJobRequest& request)
+{
+    if (!SendServerMessage(socket, RenderMessage::Submit, &request, sizeof(request)))
+    {
+        error = "lost the server";
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderClient::Cancel(uint32_t jobId)
+{
+    RenderJobCancel cancel;
+    cancel.jobId = jobId;
+    cancel.reserved = 0;
+    if (!SendServerMessage(socket, RenderMessage::Cancel, &cancel, sizeof(cancel)))
+    {
+        error = "lost the server";
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+RenderClient::Receive(RenderEvent& event)
+{
+    RenderMessageHeader header;
+    if (!socket.Receive(&header, sizeof(header)) || header.magic != RENDER_SERVER_MAGIC)
+    {
+        error = "lost the server";
+        return false;
+    }
+
+    event.type = header.type;
+    bool ok = false;
+    switch (header.type)
+    {
+    case RenderMessage::Accepted:
+        ok = header.size == sizeof(event.accepted) && socket.Receive(&event.accepted, sizeof(event.accepted));
+        break;
+    case RenderMessage::Rejected:
+        ok = header.size < 4096;
+        event.reason.resize(ok ? size_t(header.size) : 0);
+        ok = ok && (header.size == 0 || socket.Receive(&event.reason[0], event.reason.size()));
+        break;
+    case RenderMessage::Progress:
+    case RenderMessage::Finished:
+        ok = header.size >= sizeof(event.update) && socket.Receive(&event.update, sizeof(event.update));
+        if (ok)
+        {
+            size_t pixelCount = size_t(event.update.width) * event.update.height;
+            event.image.resize(pixelCount);
+            ok = header.size == sizeof(event.update) + pixelCount * sizeof(Color) &&
+                socket.Receive(event.image.data(), pixelCount * sizeof(Color));
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!ok)
+    {
+        error = "unexpected message from the server";
+        socket.Close();
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+const std::string&
+RenderClient::GetError() const
+{
+    return error;
+}
@@ -0,0 +1,261 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "raytracer.h"
+#include "scenefile.h"
+#include "textscene.h"
+#include "socket.h"
+
+#define RENDER_SERVER_MAGIC 0x53524252 // "RBRS"
+#define RENDER_SERVER_VERSION 1
+#define RENDER_SCENE_ID_SIZE 64
+
+enum class RenderMessage : uint32_t
+{
+    // client to server: RenderJobRequest
+    Submit,
+    // client to server: RenderJobCancel
+    Cancel,
+    // server to client: RenderJobAccepted
+    Accepted,
+    // server to client: the reason as text, for the oldest submit without an answer
+    Rejected,
+    // server to client: RenderJobUpdate followed by the image so far
+    Progress,
+    // server to client: RenderJobUpdate followed by the final image
+    Finished
+};
+
+struct RenderMessageHeader
+{
+    uint32_t magic;
+    RenderMessage type;
+    // payload bytes following the header
+    uint64_t size;
+};
+
+//------------------------------------------------------------------------------
+/**
+    A render of a resident scene. samplesPerPixel are traced in progressive
+    frames of samplesPerFrame, which has to divide it.
+*/
+struct RenderJobRequest
+{
+    uint32_t version = RENDER_SERVER_VERSION;
+    // zero terminated id the scene was registered with
+    char sceneId[RENDER_SCENE_ID_SIZE] = {};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t samplesPerPixel = 0;
+    uint32_t samplesPerFrame = 0;
+    uint32_t bounces = 5;
+    // higher priorities are rendered first, equal ones in submission order
+    int32_t priority = 0;
+    // send the image every this many frames, 0 only sends the final one
+    uint32_t progressFrames = 0;
+    // use the camera stored with the scene instead of the one below, if it has one
+    uint32_t useSceneCamera = 0;
+    float cameraPosition[3] = {};
+    // degrees, like SceneCamera
+    float cameraRotationX = 0.f;
+    float cameraRotationY = 0.f;
+};
+
+struct RenderJobCancel
+{
+    uint32_t jobId;
+    uint32_t reserved;
+};
+
+struct RenderJobAccepted
+{
+    uint32_t jobId;
+    // jobs waiting in front of and including this one
+    uint32_t queueLength;
+};
+
+struct RenderJobUpdate
+{
+    uint32_t jobId;
+    // frames traced so far and in total
+    uint32_t frameIndex;
+    uint32_t frameCount;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+    uint64_t rayCount;
+    // time spent tracing this job so far
+    double milliseconds;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Long running render service. Scenes are loaded and their bounding spheres
+    built once, then any number of jobs are rendered against them without
+    paying for process start or scene setup again.
+
+    Clients submit jobs over a socket. The server traces one frame of the
+    highest priority job at a time and checks for new messages in between, so
+    a more urgent job takes over within a frame and the preempted job continues
+    later from its accumulation buffer. Progressive images are streamed to the
+    submitting client every progressFrames frames, the final one always.
+
+    Client sockets never block the server. Messages are collected as they
+    arrive, and everything sent to a client goes into its outbox, which is
+    flushed whenever the socket takes more. A client that stops reading only
+    stalls itself: its progress images are skipped while its backlog is
+    large, and it is dropped once the backlog reaches SERVER_MAX_BACKLOG.
+    Jobs of a client that disconnects are dropped.
+
+    Every Raytracer the server creates, and the text scene loader, work on
+    one pool of threadCount threads that lives as long as the server.
+*/
+class RenderServer
+{
+public:
+    RenderServer(size_t threadCount);
+    ~RenderServer();
+
+    // map a binary scene file and register it under id
+    bool AddScene(const std::string& id, const char* path);
+    // parse a text scene and register it under id
+    bool AddTextScene(const std::string& id, const char* path);
+
+    // reuse bounding spheres between server runs, see Raytracer::SetBoundingSphereCache
+    void SetBoundingSphereCache(const std::string& directory);
+
+    // serve jobs until Stop is called, by default only to clients on this machine
+    bool Run(uint16_t port, bool loopbackOnly = true);
+    // make Run return after the current frame, safe to call from other threads
+    void Stop();
+
+    const std::string& GetError() const;
+    size_t SceneCount() const;
+    // jobs rendered to the end since the server started
+    size_t FinishedJobCount() const;
+
+private:
+    struct Scene
+    {
+        std::string id;
+        SceneFile file;
+        // owned copies of whatever the file doesn't provide
+        std::vector<PackedSphere> spheres;
+        std::vector<uint32_t> materialIndices;
+        std::vector<Material> materials;
+        std::vector<BoundingSphere> boundingSpheres;
+        SceneView view;
+        bool hasCamera = false;
+        SceneCamera camera;
+    };
+
+    struct Client
+    {
+        Socket socket;
+        uint32_t id = 0;
+        // message being received
+        SocketMessage<RenderMessageHeader> message;
+        // messages waiting to be sent, from outboxSent on
+        std::vector<uint8_t> outbox;
+        size_t outboxSent = 0;
+    };
+
+    struct Job
+    {
+        uint32_t id;
+        uint32_t clientId;
+        RenderJobRequest request;
+        const Scene* scene;
+        mat4 view;
+        uint32_t frameCount;
+        int frameIndex = 0;
+        uint64_t rayCount = 0;
+        double milliseconds = 0.0;
+        // empty until the job renders its first frame
+        std::vector<Color> frameBuffer;
+        std::vector<Color> frameBufferCopy;
+    };
+
+    // build missing bounding spheres and copy everything the view doesn't own into scene
+    void TakeScene(Scene& scene, const SceneView& view, bool copySpheres);
+    const Scene* FindScene(const char* id) const;
+
+    // read what arrived and handle the message once it is complete, false drops the client
+    bool ReceiveMessage(Client& client);
+    bool HandleMessage(Client& client);
+    bool HandleSubmit(Client& client, const RenderJobRequest& request);
+    // append a message to the client's outbox and send what the socket takes, false drops the client
+    bool QueueMessage(Client& client, RenderMessage type, const void* payload, size_t size, const void* extra = nullptr, size_t extraSize = 0);
+    bool FlushClient(Client& client);
+    void DropClient(size_t index);
+    void RemoveJob(size_t index);
+
+    // highest priority job, nullptr if there is none
+    Job* NextJob();
+    // trace one frame of job and send the image if it is due, false if the job is done
+    bool RenderFrame(Job& job);
+    bool SendUpdate(Job& job, RenderMessage type);
+    Client* FindClient(uint32_t id);
+
+    ThreadPool threads;
+    std::string cacheDirectory;
+    std::vector<std::unique_ptr<Scene>> scenes;
+    std::vector<Client> clients;
+    std::vector<std::unique_ptr<Job>> jobs;
+
+    // Raytracer of the job that traced last, kept while it stays on top of the queue
+    std::unique_ptr<Raytracer> raytracer;
+    uint32_t raytracerJob;
+    // largest message a client may send
+    size_t maxPayload;
+
+    uint32_t nextClientId;
+    uint32_t nextJobId;
+    size_t finishedJobCount;
+    std::atomic<bool> stop;
+    std::string error;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Everything a client hears from the server
+*/
+struct RenderEvent
+{
+    RenderMessage type = RenderMessage::Rejected;
+    // valid for Accepted
+    RenderJobAccepted accepted = {};
+    // valid for Progress and Finished
+    RenderJobUpdate update = {};
+    std::vector<Color> image;
+    // valid for Rejected
+    std::string reason;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Submits jobs to a RenderServer. Submits are answered in order, with
+    Accepted or Rejected, and updates of all accepted jobs arrive interleaved
+    on the same connection.
+*/
+class RenderClient
+{
+public:
+    // connect, retrying for timeout seconds
+    bool Connect(const char* host, uint16_t port, float timeout = 10.f);
+
+    bool Submit(const RenderJobRequest& request);
+    bool Cancel(uint32_t jobId);
+
+    // wait for the next message from the server, false if the connection is lost
+    bool Receive(RenderEvent& event);
+
+    const std::string& GetError() const;
+
+private:
+    Socket socket;
+    std::string error;
+};
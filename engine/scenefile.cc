@@ -0,0 +1,204 @@
+#include "scenefile.h"
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<PackedSphere>::value, "PackedSphere is stored in scene files as is");
+static_assert(std::is_trivially_copyable<Material>::value, "Material is stored in scene files as is");
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint64_t
+AlignOffset(uint64_t offset)
+{
+    return (offset + SCENE_FILE_ALIGNMENT - 1) & ~uint64_t(SCENE_FILE_ALIGNMENT - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Check that a section lies completely within the file
+*/
+static bool
+SectionInFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+    if (offset % SCENE_FILE_ALIGNMENT != 0 || offset > fileSize)
+        return false;
+
+    return count <= (fileSize - offset) / elementSize;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+SceneFile::SceneFile()
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+SceneFile::~SceneFile()
+{
+    Close();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SceneFile::Open(const char* path, bool validateIndices)
+{
+    Close();
+
+    if (!file.Open(path) || file.Size() < sizeof(SceneFileHeader) || !Validate(validateIndices))
+    {
+        Close();
+        return false;
+    }
+
+    const uint8_t* data = file.Data();
+    const SceneFileHeader* header = (const SceneFileHeader*)data;
+    view.spheres = (const PackedSphere*)(data + header->sphereOffset);
+    view.materialIndices = (const uint32_t*)(data + header->materialIndexOffset);
+    view.sphereCount = size_t(header->sphereCount);
+    view.materials = (const Material*)(data + header->materialOffset);
+    view.materialCount = size_t(header->materialCount);
+
+    if (header->boundingSphereCount > 0)
+    {
+        view.boundingSpheres = (const BoundingSphere*)(data + header->boundingSphereOffset);
+        view.boundingSphereCount = size_t(header->boundingSphereCount);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SceneFile::Close()
+{
+    file.Close();
+    view = SceneView();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SceneFile::Validate(bool validateIndices) const
+{
+    const uint8_t* data = file.Data();
+    size_t size = file.Size();
+    const SceneFileHeader* header = (const SceneFileHeader*)data;
+
+    if (header->magic != SCENE_FILE_MAGIC ||
+        header->version != SCENE_FILE_VERSION ||
+        header->headerSize != sizeof(SceneFileHeader) ||
+        header->sphereSize != sizeof(PackedSphere) ||
+        header->materialSize != sizeof(Material) ||
+        header->boundingSphereSize != sizeof(BoundingSphere) ||
+        header->maxSpheresPerBound != MAX_SPHERES)
+        return false;
+
+    if (header->materialCount == 0 && header->sphereCount > 0)
+        return false;
+
+    if (!SectionInFile(header->sphereOffset, header->sphereCount, sizeof(PackedSphere), size) ||
+        !SectionInFile(header->materialIndexOffset, header->sphereCount, sizeof(uint32_t), size) ||
+        !SectionInFile(header->materialOffset, header->materialCount, sizeof(Material), size) ||
+        !SectionInFile(header->boundingSphereOffset, header->boundingSphereCount, sizeof(BoundingSphere), size))
+        return false;
+
+    if (!validateIndices)
+        return true;
+
+    // touches every index page once, which also warms the mapping
+    const uint32_t* indices = (const uint32_t*)(data + header->materialIndexOffset);
+    for (uint64_t i = 0; i < header->sphereCount; i++)
+    {
+        if (indices[i] >= header->materialCount)
+            return false;
+    }
+
+    const BoundingSphere* bounds = (const BoundingSphere*)(data + header->boundingSphereOffset);
+    for (uint64_t i = 0; i < header->boundingSphereCount; i++)
+    {
+        if (bounds[i].count < 0 || bounds[i].count > MAX_SPHERES)
+            return false;
+
+        for (int j = 0; j < bounds[i].count; j++)
+        {
+            if (bounds[i].containedSphereIndices[j] < 0 || uint64_t(bounds[i].containedSphereIndices[j]) >= header->sphereCount)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Pad the file with zeroes up to offset
+*/
+static bool
+WritePadding(FILE* file, uint64_t& position, uint64_t offset)
+{
+    static const uint8_t zeroes[SCENE_FILE_ALIGNMENT] = {};
+    size_t padding = size_t(offset - position);
+    position = offset;
+    return padding == 0 || fwrite(zeroes, 1, padding, file) == padding;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SceneFile::Save(const char* path, const SceneView& scene, bool includeBoundingSpheres)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    size_t boundingSphereCount = includeBoundingSpheres && scene.boundingSpheres != nullptr ? scene.boundingSphereCount : 0;
+
+    SceneFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    header.headerSize = sizeof(SceneFileHeader);
+    header.sphereSize = sizeof(PackedSphere);
+    header.materialSize = sizeof(Material);
+    header.boundingSphereSize = sizeof(BoundingSphere);
+    header.maxSpheresPerBound = MAX_SPHERES;
+    header.sphereCount = scene.sphereCount;
+    header.materialCount = scene.materialCount;
+    header.boundingSphereCount = boundingSphereCount;
+    header.sphereOffset = AlignOffset(sizeof(SceneFileHeader));
+    header.materialIndexOffset = AlignOffset(header.sphereOffset + scene.sphereCount * sizeof(PackedSphere));
+    header.materialOffset = AlignOffset(header.materialIndexOffset + scene.sphereCount * sizeof(uint32_t));
+    header.boundingSphereOffset = AlignOffset(header.materialOffset + scene.materialCount * sizeof(Material));
+
+    uint64_t position = sizeof(SceneFileHeader);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    ok = ok && WritePadding(file, position, header.sphereOffset);
+    ok = ok && fwrite(scene.spheres, sizeof(PackedSphere), scene.sphereCount, file) == scene.sphereCount;
+    position += scene.sphereCount * sizeof(PackedSphere);
+
+    ok = ok && WritePadding(file, position, header.materialIndexOffset);
+    ok = ok && fwrite(scene.materialIndices, sizeof(uint32_t), scene.sphereCount, file) == scene.sphereCount;
+    position += scene.sphereCount * sizeof(uint32_t);
+
+    ok = ok && WritePadding(file, position, header.materialOffset);
+    ok = ok && fwrite(scene.materials, sizeof(Material), scene.materialCount, file) == scene.materialCount;
+    position += scene.materialCount * sizeof(Material);
+
+    ok = ok && WritePadding(file, position, header.boundingSphereOffset);
+    ok = ok && fwrite(scene.boundingSpheres, sizeof(BoundingSphere), boundingSphereCount, file) == boundingSphereCount;
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "raytracer.h"
+#include "mappedfile.h"
+
+#define SCENE_FILE_MAGIC 0x43534252 // "RBSC"
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGNMENT 64
+
+//------------------------------------------------------------------------------
+/**
+    Header at the start of a binary scene file. All offsets are in bytes from
+    the start of the file and aligned to SCENE_FILE_ALIGNMENT.
+
+    Sections are stored in the exact in-memory layout the intersection loop
+    uses, so a mapped file is handed to the Raytracer without any parsing:
+        PackedSphere[sphereCount]
+        uint32_t[sphereCount]                 material index per sphere
+        Material[materialCount]
+        BoundingSphere[boundingSphereCount]   optional, 0 if not prebuilt
+
+    Spheres stay 16 byte records rather than x, y, z and radius blocks. The
+    loop reaches them through the index lists of the bounding spheres, in no
+    particular order, so a record is one cache line touched where separate
+    blocks would be four. The bounding spheres, which are scanned in order,
+    are split into blocks by SetScene.
+*/
+struct SceneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    // sizes of the stored records, catches layout changes and foreign builds
+    uint16_t sphereSize;
+    uint16_t materialSize;
+    uint32_t boundingSphereSize;
+    uint32_t maxSpheresPerBound;
+
+    uint64_t sphereCount;
+    uint64_t materialCount;
+    uint64_t boundingSphereCount;
+
+    uint64_t sphereOffset;
+    uint64_t materialIndexOffset;
+    uint64_t materialOffset;
+    uint64_t boundingSphereOffset;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Memory-mapped binary scene. The view stays valid until Close or
+    destruction, so the file must outlive any Raytracer using it.
+*/
+class SceneFile
+{
+public:
+    SceneFile();
+    ~SceneFile();
+
+    SceneFile(const SceneFile&) = delete;
+    SceneFile& operator=(const SceneFile&) = delete;
+
+    // map a scene file, validateIndices checks every index against the section sizes
+    bool Open(const char* path, bool validateIndices = true);
+    // unmap the file
+    void Close();
+
+    bool IsOpen() const;
+    bool HasBoundingSpheres() const;
+
+    // view of the mapped data
+    const SceneView& GetView() const;
+
+    // write scene data to path, bounding spheres are only stored if requested and present
+    static bool Save(const char* path, const SceneView& scene, bool includeBoundingSpheres = true);
+
+private:
+    bool Validate(bool validateIndices) const;
+
+    MappedFile file;
+    SceneView view;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline bool
+SceneFile::IsOpen() const
+{
+    return this->file.IsOpen();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline bool
+SceneFile::HasBoundingSpheres() const
+{
+    return this->view.boundingSpheres != nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline const SceneView&
+SceneFile::GetView() const
+{
+    return this->view;
+}
@@ -0,0 +1,323 @@
+#include "socket.h"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define INVALID_HANDLE SocketHandle(INVALID_SOCKET)
+#define CloseSocketHandle closesocket
+#define PollFunction WSAPoll
+#define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+typedef int IoSize;
+#else
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#define INVALID_HANDLE SocketHandle(-1)
+#define CloseSocketHandle close
+#define PollFunction poll
+#define WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+typedef size_t IoSize;
+#endif
+
+// don't raise SIGPIPE when a worker goes away mid send
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+//------------------------------------------------------------------------------
+/**
+    winsock has to be initialized once per process, a no-op elsewhere
+*/
+static bool
+InitializeSockets()
+{
+#ifdef _WIN32
+    static const bool initialized = []()
+    {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return initialized;
+#else
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Socket::Socket() :
+    handle(INVALID_HANDLE)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Socket::~Socket()
+{
+    Close();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Socket::Socket(Socket&& other) :
+    handle(other.handle)
+{
+    other.handle = INVALID_HANDLE;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Socket&
+Socket::operator=(Socket&& other)
+{
+    if (this != &other)
+    {
+        Close();
+        handle = other.handle;
+        other.handle = INVALID_HANDLE;
+    }
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::Listen(uint16_t port, bool loopbackOnly)
+{
+    Close();
+    if (!InitializeSockets())
+        return false;
+
+    handle = SocketHandle(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+    if (handle == INVALID_HANDLE)
+        return false;
+
+    // restarting a coordinator shouldn't wait for the old port to time out
+    int reuse = 1;
+    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(handle, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(handle, SOMAXCONN) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::Accept(Socket& client)
+{
+    client.Close();
+    client.handle = SocketHandle(accept(handle, nullptr, nullptr));
+    if (client.handle == INVALID_HANDLE)
+        return false;
+
+    // results and tasks are single messages, don't hold them back
+    int noDelay = 1;
+    setsockopt(client.handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::Connect(const char* host, uint16_t port)
+{
+    Close();
+    if (!InitializeSockets())
+        return false;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%u", unsigned(port));
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return false;
+
+    for (addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+    {
+        handle = SocketHandle(socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+        if (handle == INVALID_HANDLE)
+            continue;
+
+        if (connect(handle, address->ai_addr, int(address->ai_addrlen)) == 0)
+            break;
+
+        Close();
+    }
+
+    freeaddrinfo(addresses);
+    if (handle == INVALID_HANDLE)
+        return false;
+
+    int noDelay = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::Send(const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0)
+    {
+        // winsock takes an int, stay well below it
+        IoSize chunk = IoSize(size < (1 << 30) ? size : (1 << 30));
+        auto sent = send(handle, bytes, chunk, SEND_FLAGS);
+        if (sent <= 0)
+            return false;
+
+        bytes += sent;
+        size -= size_t(sent);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::Receive(void* data, size_t size)
+{
+    char* bytes = (char*)data;
+    while (size > 0)
+    {
+        IoSize chunk = IoSize(size < (1 << 30) ? size : (1 << 30));
+        auto received = recv(handle, bytes, chunk, 0);
+        if (received <= 0)
+            return false;
+
+        bytes += received;
+        size -= size_t(received);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    A single recv, which returns what is there without waiting for more
+*/
+int64_t
+Socket::ReceiveSome(void* data, size_t size)
+{
+    IoSize chunk = IoSize(size < (1 << 30) ? size : (1 << 30));
+    auto received = recv(handle, (char*)data, chunk, 0);
+    return received < 0 ? -1 : int64_t(received);
+}
+
+//------------------------------------------------------------------------------
+/**
+    A single send, which takes what fits into the send buffer
+*/
+int64_t
+Socket::SendSome(const void* data, size_t size)
+{
+    IoSize chunk = IoSize(size < (1 << 30) ? size : (1 << 30));
+    auto sent = send(handle, (const char*)data, chunk, SEND_FLAGS);
+    if (sent < 0)
+        return WOULD_BLOCK ? 0 : -1;
+    return int64_t(sent);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::SetNonBlocking()
+{
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    return ioctlsocket(handle, FIONBIO, &nonBlocking) == 0;
+#else
+    int flags = fcntl(handle, F_GETFL, 0);
+    return flags != -1 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Socket::Close()
+{
+    if (handle != INVALID_HANDLE)
+    {
+        CloseSocketHandle(handle);
+        handle = INVALID_HANDLE;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+Socket::IsOpen() const
+{
+    return handle != INVALID_HANDLE;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+int
+Socket::Poll(Socket* const* sockets, size_t count, bool* readable, int timeoutMilliseconds, const bool* wantWritable, bool* writable)
+{
+    std::vector<pollfd> descriptors(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        descriptors[i].fd = sockets[i]->handle;
+        descriptors[i].events = short(POLLIN | (wantWritable != nullptr && wantWritable[i] ? POLLOUT : 0));
+        descriptors[i].revents = 0;
+    }
+
+    int result = PollFunction(descriptors.data(), (unsigned long)count, timeoutMilliseconds);
+    if (result < 0)
+        return -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        readable[i] = (descriptors[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        if (writable != nullptr)
+            writable[i] = (descriptors[i].revents & POLLOUT) != 0;
+    }
+
+    return result;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+//------------------------------------------------------------------------------
+/**
+    Blocking TCP socket over winsock or bsd sockets, just enough for the
+    render farm and the render server. Send and Receive always transfer the
+    whole buffer, ReceiveSome and SendSome are for servers that must not wait
+    on a single connection.
+*/
+class Socket
+{
+public:
+    Socket();
+    ~Socket();
+
+    Socket(Socket&& other);
+    Socket& operator=(Socket&& other);
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    // listen for connections from this machine, or on all interfaces
+    bool Listen(uint16_t port, bool loopbackOnly = true);
+    // take a pending connection of a listening socket
+    bool Accept(Socket& client);
+    // connect to a host name or address
+    bool Connect(const char* host, uint16_t port);
+
+    bool Send(const void* data, size_t size);
+    // false if the connection closed before size bytes arrived
+    bool Receive(void* data, size_t size);
+    // whatever arrived, up to size bytes. Doesn't block once Poll reported the socket readable.
+    // returns the number of bytes, 0 if the connection closed and -1 on errors
+    int64_t ReceiveSome(void* data, size_t size);
+    // as much of data as the send buffer takes, for non-blocking sockets.
+    // returns the number of bytes, 0 if the buffer is full and -1 on errors
+    int64_t SendSome(const void* data, size_t size);
+    // make SendSome and ReceiveSome return instead of waiting, Send and Receive must not be used after
+    bool SetNonBlocking();
+
+    void Close();
+    bool IsOpen() const;
+
+    // wait until some sockets are readable or closed, readable[i] is set for each. if wantWritable is
+    // given, sockets with wantWritable[i] set also wake the poll once they can send and set writable[i].
+    // returns the number of ready sockets, 0 on timeout and -1 on error
+    static int Poll(Socket* const* sockets, size_t count, bool* readable, int timeoutMilliseconds,
+        const bool* wantWritable = nullptr, bool* writable = nullptr);
+
+private:
+    SocketHandle handle;
+};
+
+//------------------------------------------------------------------------------
+/**
+    A message collected over as many readable polls as it takes to arrive,
+    so a client that sends half a message holds up no one but itself.
+    HEADER is the protocol's header, its size member counts the payload
+    bytes that follow it.
+*/
+template<typename HEADER>
+struct SocketMessage
+{
+    HEADER header;
+    std::vector<uint8_t> payload;
+    // bytes of header and payload so far
+    size_t received = 0;
+
+    // read once from a socket Poll reported readable. complete is set when the whole message is in,
+    // false if the connection closed or the payload would be larger than maxPayload
+    bool Receive(Socket& socket, uint64_t maxPayload, bool& complete);
+    // start over with the next message
+    void Reset();
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<typename HEADER>
+inline bool
+SocketMessage<HEADER>::Receive(Socket& socket, uint64_t maxPayload, bool& complete)
+{
+    complete = false;
+    if (received < sizeof(HEADER))
+    {
+        int64_t count = socket.ReceiveSome((uint8_t*)&header + received, sizeof(HEADER) - received);
+        if (count <= 0)
+            return false;
+        received += size_t(count);
+        if (received < sizeof(HEADER))
+            return true;
+
+        if (header.size > maxPayload)
+            return false;
+        payload.resize(size_t(header.size));
+        complete = header.size == 0;
+        return true;
+    }
+
+    size_t payloadReceived = received - sizeof(HEADER);
+    int64_t count = socket.ReceiveSome(payload.data() + payloadReceived, payload.size() - payloadReceived);
+    if (count <= 0)
+        return false;
+    received += size_t(count);
+    complete = received == sizeof(HEADER) + payload.size();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<typename HEADER>
+inline void
+SocketMessage<HEADER>::Reset()
+{
+    received = 0;
+}
@@ -5,7 +5,7 @@
 #include "ray.h"
 #include "material.h"
 
-// a spherical object
+// a spherical object, used when building a scene
 class Sphere
 {
 public:
@@ -37,6 +37,25 @@ public:
     }
 };
 
+//------------------------------------------------------------------------------
+/**
+    Packed 16 byte sphere used by the intersection loop, center in xyz and
+    radius in w. The material is looked up through a parallel index array so
+    the intersection working set stays free of pointers.
+*/
+struct alignas(16) PackedSphere
+{
+    float x, y, z;
+    float radius;
+
+    vec3 Center() const
+    {
+        return { x, y, z };
+    }
+};
+
+static_assert(sizeof(PackedSphere) == 16, "PackedSphere must stay 16 bytes");
+
 inline bool IntersectSphere(const Ray& ray, const vec3& center, float radius, float maxDist, HitResult& outHitInfo)
 {
     vec3 oc = ray.origin - center;
@@ -0,0 +1,624 @@
+#include "textscene.h"
+#include "timeline.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+enum class LineType
+{
+    Empty,
+    Camera,
+    Material,
+    Sphere,
+    Unknown
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline bool
+IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline bool
+IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline const char*
+SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && IsSpace(*p))
+        p++;
+    return p;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Read the next whitespace separated token
+*/
+static inline bool
+ParseToken(const char*& p, const char* end, const char*& token, size_t& length)
+{
+    p = SkipSpaces(p, end);
+    token = p;
+    while (p < end && !IsSpace(*p) && *p != '#')
+        p++;
+    length = size_t(p - token);
+    return length > 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline bool
+TokenEquals(const char* token, size_t length, const char* keyword)
+{
+    return strlen(keyword) == length && memcmp(token, keyword, length) == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Locale independent float parser, the file isn't null terminated so the
+    C library functions can't be used on it directly
+*/
+static bool
+ParseFloat(const char*& p, const char* end, float& out)
+{
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = SkipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; p < end && IsDigit(*p); p++, digits++)
+    {
+        if (mantissa < 100000000000000000ull)
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+        else
+            exponent++;
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && IsDigit(*p); p++, digits++)
+        {
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                exponent--;
+            }
+        }
+    }
+
+    if (digits == 0)
+        return false;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+
+        if (p == end || !IsDigit(*p))
+            return false;
+
+        int value = 0;
+        for (; p < end && IsDigit(*p); p++)
+            value = value < 10000 ? value * 10 + (*p - '0') : value;
+        exponent += negativeExponent ? -value : value;
+    }
+
+    double result = double(mantissa);
+    if (exponent >= 0 && exponent <= 22)
+        result *= powersOfTen[exponent];
+    else if (exponent < 0 && exponent >= -22)
+        result /= powersOfTen[-exponent];
+    else
+        result *= pow(10.0, exponent);
+
+    out = float(negative ? -result : result);
+    return p == end || IsSpace(*p) || *p == '#';
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+ParseUnsigned(const char*& p, const char* end, uint64_t& out)
+{
+    p = SkipSpaces(p, end);
+    if (p == end || !IsDigit(*p))
+        return false;
+
+    out = 0;
+    for (; p < end && IsDigit(*p); p++)
+        out = out * 10 + uint64_t(*p - '0');
+
+    return p == end || IsSpace(*p) || *p == '#';
+}
+
+//------------------------------------------------------------------------------
+/**
+    Only whitespace or a comment may follow the last value
+*/
+static inline bool
+AtLineEnd(const char* p, const char* end)
+{
+    p = SkipSpaces(p, end);
+    return p == end || *p == '#';
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static LineType
+ParseLineType(const char*& p, const char* end)
+{
+    const char* token;
+    size_t length;
+    if (!ParseToken(p, end, token, length))
+        return LineType::Empty;
+
+    if (TokenEquals(token, length, "sphere"))
+        return LineType::Sphere;
+    if (TokenEquals(token, length, "material"))
+        return LineType::Material;
+    if (TokenEquals(token, length, "camera"))
+        return LineType::Camera;
+
+    return LineType::Unknown;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline const char*
+FindLineEnd(const char* p, const char* end)
+{
+    const char* lineEnd = (const char*)memchr(p, '\n', size_t(end - p));
+    return lineEnd == nullptr ? end : lineEnd;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+mat4
+SceneCameraMatrix(const SceneCamera& camera)
+{
+    mat4 transform = multiply(rotationy(camera.rotationY), rotationx(camera.rotationX));
+    transform.m30 = camera.position.x;
+    transform.m31 = camera.position.y;
+    transform.m32 = camera.position.z;
+    return transform;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextSceneLoader::TextSceneLoader(size_t threadCount) :
+    ownThreads(new ThreadPool(threadCount == 0 ? 1 : threadCount)),
+    threads(ownThreads.get()),
+    nextChunk(0),
+    sphereCount(0),
+    materialCount(0),
+    hasCamera(false),
+    sphereBlock(nullptr),
+    materialBlock(nullptr)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextSceneLoader::TextSceneLoader(ThreadPool& threads) :
+    threads(&threads),
+    nextChunk(0),
+    sphereCount(0),
+    materialCount(0),
+    hasCamera(false),
+    sphereBlock(nullptr),
+    materialBlock(nullptr)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextSceneLoader::~TextSceneLoader()
+{
+    Close();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+TextSceneLoader::Open(const char* path)
+{
+    Close();
+
+    if (!file.Open(path))
+    {
+        error = std::string("can't open '") + path + "'";
+        return false;
+    }
+
+    // split into more chunks than threads so uneven lines still balance, every chunk starts at a line
+    const char* begin = (const char*)file.Data();
+    const char* end = begin + file.Size();
+    size_t chunkCount = threads->size * 8;
+    const char* chunkBegin = begin;
+
+    for (size_t i = 1; i <= chunkCount && chunkBegin < end; i++)
+    {
+        const char* chunkEnd = i == chunkCount ? end : begin + file.Size() * i / chunkCount;
+        if (chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+
+        // extend to the end of the line the split point falls into
+        if (chunkEnd < end)
+        {
+            chunkEnd = FindLineEnd(chunkEnd, end);
+            chunkEnd = chunkEnd < end ? chunkEnd + 1 : end;
+        }
+
+        Chunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        chunkBegin = chunkEnd;
+    }
+
+    RunChunks(CountWork);
+
+    size_t lineCount = 0;
+    for (Chunk& chunk : chunks)
+    {
+        chunk.firstLine = lineCount;
+        chunk.firstSphere = sphereCount;
+        chunk.firstMaterial = materialCount;
+        lineCount += chunk.lineCount;
+        sphereCount += chunk.sphereCount;
+        materialCount += chunk.materialCount;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+TextSceneLoader::Load(MemoryPool<Sphere>& spheres, MemoryPool<Material>& materials)
+{
+    TIMELINE_SCOPE("TextSceneLoader::Load");
+    if (!file.IsOpen())
+    {
+        error = "no scene opened";
+        return false;
+    }
+
+    sphereBlock = spheres.GetNew(int(sphereCount));
+    materialBlock = materials.GetNew(int(materialCount));
+    if (sphereBlock == nullptr || materialBlock == nullptr)
+    {
+        error = "scene does not fit in the sphere or material pool";
+        return false;
+    }
+
+    RunChunks(ParseWork);
+
+    // report the first error in file order, the last camera in file order wins
+    for (const Chunk& chunk : chunks)
+    {
+        if (!chunk.error.empty())
+        {
+            error = chunk.error;
+            return false;
+        }
+
+        if (chunk.hasCamera)
+        {
+            hasCamera = true;
+            camera = chunk.camera;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::Close()
+{
+    file.Close();
+    chunks.clear();
+    sphereCount = 0;
+    materialCount = 0;
+    hasCamera = false;
+    error.clear();
+    sphereBlock = nullptr;
+    materialBlock = nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::RunChunks(void(*work)(const WorkArgs&))
+{
+    nextChunk = 0;
+
+    for (size_t i = 0; i < threads->size; i++)
+        threads->InitThread<WorkArgs>(work, { this }, i);
+
+    threads->ExecuteAndWait();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::CountWork(const WorkArgs& args)
+{
+    TextSceneLoader* self = args.self;
+    for (size_t i = self->nextChunk++; i < self->chunks.size(); i = self->nextChunk++)
+        self->CountChunk(self->chunks[i]);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::ParseWork(const WorkArgs& args)
+{
+    TextSceneLoader* self = args.self;
+    for (size_t i = self->nextChunk++; i < self->chunks.size(); i = self->nextChunk++)
+    {
+        TIMELINE_SCOPE("parse chunk");
+        self->ParseChunk(self->chunks[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::CountChunk(Chunk& chunk)
+{
+    for (const char* p = chunk.begin; p < chunk.end;)
+    {
+        const char* lineEnd = FindLineEnd(p, chunk.end);
+        chunk.lineCount++;
+
+        switch (ParseLineType(p, lineEnd))
+        {
+        case LineType::Sphere:
+            chunk.sphereCount++;
+            break;
+        case LineType::Material:
+            chunk.materialCount++;
+            break;
+        default:
+            break;
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TextSceneLoader::ParseChunk(Chunk& chunk)
+{
+    size_t line = chunk.firstLine;
+    Sphere* sphere = sphereBlock + chunk.firstSphere;
+    Material* material = materialBlock + chunk.firstMaterial;
+
+    for (const char* p = chunk.begin; p < chunk.end;)
+    {
+        const char* lineEnd = FindLineEnd(p, chunk.end);
+        const char* problem = nullptr;
+        line++;
+
+        switch (ParseLineType(p, lineEnd))
+        {
+        case LineType::Empty:
+            break;
+
+        case LineType::Sphere:
+        {
+            float x, y, z, radius;
+            uint64_t materialIndex;
+            if (!ParseFloat(p, lineEnd, x) || !ParseFloat(p, lineEnd, y) || !ParseFloat(p, lineEnd, z) ||
+                !ParseFloat(p, lineEnd, radius) || !ParseUnsigned(p, lineEnd, materialIndex) || !AtLineEnd(p, lineEnd))
+                problem = "expected: sphere <x> <y> <z> <radius> <materialIndex>";
+            else if (materialIndex >= materialCount)
+                problem = "material index out of range";
+            else
+                *sphere++ = Sphere(radius, vec3(x, y, z), materialBlock + materialIndex);
+            break;
+        }
+
+        case LineType::Material:
+        {
+            const char* token;
+            size_t length;
+            Material m;
+            ParseToken(p, lineEnd, token, length);
+
+            if (TokenEquals(token, length, "lambertian"))
+                m.type = MaterialType::Lambertian;
+            else if (TokenEquals(token, length, "dielectric"))
+                m.type = MaterialType::Dielectric;
+            else if (TokenEquals(token, length, "conductor"))
+                m.type = MaterialType::Conductor;
+            else
+                problem = "unknown material type";
+
+            if (problem == nullptr)
+            {
+                if (!ParseFloat(p, lineEnd, m.color.r) || !ParseFloat(p, lineEnd, m.color.g) || !ParseFloat(p, lineEnd, m.color.b) ||
+                    !ParseFloat(p, lineEnd, m.roughness) || (!AtLineEnd(p, lineEnd) && !ParseFloat(p, lineEnd, m.refractionIndex)) ||
+                    !AtLineEnd(p, lineEnd))
+                    problem = "expected: material <type> <r> <g> <b> <roughness> [refractionIndex]";
+                else
+                    *material++ = m;
+            }
+            break;
+        }
+
+        case LineType::Camera:
+        {
+            SceneCamera c;
+            if (!ParseFloat(p, lineEnd, c.position.x) || !ParseFloat(p, lineEnd, c.position.y) || !ParseFloat(p, lineEnd, c.position.z) ||
+                !ParseFloat(p, lineEnd, c.rotationX) || !ParseFloat(p, lineEnd, c.rotationY) || !AtLineEnd(p, lineEnd))
+            {
+                problem = "expected: camera <x> <y> <z> <rotationX> <rotationY>";
+            }
+            else
+            {
+                chunk.hasCamera = true;
+                chunk.camera = c;
+            }
+            break;
+        }
+
+        case LineType::Unknown:
+            problem = "unknown record type";
+            break;
+        }
+
+        if (problem != nullptr)
+        {
+            chunk.error = "line " + std::to_string(line) + ": " + problem;
+            return;
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+SaveTextScene(const char* path, MemoryPool<Sphere>& spheres, MemoryPool<Material>& materials, const SceneCamera* camera)
+{
+    static const char* typeNames[] = { "lambertian", "dielectric", "conductor" };
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    // 9 significant digits round trip every float exactly
+    bool ok = true;
+    if (camera != nullptr)
+        ok = fprintf(file, "camera %.9g %.9g %.9g %.9g %.9g\n", camera->position.x, camera->position.y, camera->position.z, camera->rotationX, camera->rotationY) > 0;
+
+    for (int i = 0; ok && i < materials.Count(); i++)
+    {
+        const Material* m = materials[i];
+        ok = fprintf(file, "material %s %.9g %.9g %.9g %.9g %.9g\n", typeNames[int(m->type)], m->color.r, m->color.g, m->color.b, m->roughness, m->refractionIndex) > 0;
+    }
+
+    for (int i = 0; ok && i < spheres.Count(); i++)
+    {
+        const Sphere* s = spheres[i];
+        int materialIndex = materials.IndexOf(s->material);
+        ok = materialIndex != -1 &&
+            fprintf(file, "sphere %.9g %.9g %.9g %.9g %d\n", s->center.x, s->center.y, s->center.z, s->radius, materialIndex) > 0;
+    }
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadCameraPath(const char* path, std::vector<mat4>& views, std::string& error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = "failed to open '" + std::string(path) + "'";
+        return false;
+    }
+
+    views.clear();
+    const char* p = (const char*)file.Data();
+    const char* end = p + file.Size();
+    for (size_t line = 1; p < end; line++)
+    {
+        const char* lineEnd = FindLineEnd(p, end);
+        const char* token;
+        size_t length;
+        const char* problem = nullptr;
+
+        if (!ParseToken(p, lineEnd, token, length))
+        {
+            // empty or comment only
+        }
+        else if (TokenEquals(token, length, "camera"))
+        {
+            SceneCamera c;
+            if (!ParseFloat(p, lineEnd, c.position.x) || !ParseFloat(p, lineEnd, c.position.y) || !ParseFloat(p, lineEnd, c.position.z) ||
+                !ParseFloat(p, lineEnd, c.rotationX) || !ParseFloat(p, lineEnd, c.rotationY) || !AtLineEnd(p, lineEnd))
+                problem = "expected: camera <x> <y> <z> <rotationX> <rotationY>";
+            else
+                views.push_back(SceneCameraMatrix(c));
+        }
+        else if (TokenEquals(token, length, "matrix"))
+        {
+            mat4 m;
+            int i = 0;
+            while (i < 16 && ParseFloat(p, lineEnd, m[i]))
+                i++;
+            if (i < 16 || !AtLineEnd(p, lineEnd))
+                problem = "expected: matrix followed by 16 values in row order";
+            else
+                views.push_back(m);
+        }
+        else
+        {
+            problem = "unknown record type";
+        }
+
+        if (problem != nullptr)
+        {
+            error = "line " + std::to_string(line) + ": " + problem;
+            return false;
+        }
+
+        p = lineEnd + 1;
+    }
+
+    if (views.empty())
+    {
+        error = "'" + std::string(path) + "' holds no views";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mempool.h"
+#include "sphere.h"
+#include "material.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+//------------------------------------------------------------------------------
+/**
+    Camera stored in a text scene, rotations in degrees like rotationx/rotationy
+*/
+struct SceneCamera
+{
+    vec3 position;
+    float rotationX = 0.f;
+    float rotationY = 0.f;
+};
+
+// view matrix of a camera, rotated around x first and then around y
+mat4 SceneCameraMatrix(const SceneCamera& camera);
+
+//------------------------------------------------------------------------------
+/**
+    Line based text scene:
+
+        # comment
+        camera <x> <y> <z> <rotationX> <rotationY>
+        material <lambertian|dielectric|conductor> <r> <g> <b> <roughness> [refractionIndex]
+        sphere <x> <y> <z> <radius> <materialIndex>
+
+    Materials are referenced by their 0-based order in the file, so every chunk
+    of the file can be parsed without knowing the others. Open maps the file and
+    counts the records of each chunk in parallel, Load then parses all chunks in
+    parallel straight into the sphere and material pools.
+*/
+class TextSceneLoader
+{
+public:
+    // with worker threads of its own
+    TextSceneLoader(size_t threadCount);
+    // with the workers of a pool that isn't busy while loading
+    TextSceneLoader(ThreadPool& threads);
+    ~TextSceneLoader();
+
+    // map the file and count its records
+    bool Open(const char* path);
+    // parse all records into the pools, which need room for SphereCount and MaterialCount elements
+    bool Load(MemoryPool<Sphere>& spheres, MemoryPool<Material>& materials);
+    // unmap the file
+    void Close();
+
+    size_t SphereCount() const;
+    size_t MaterialCount() const;
+    size_t FileSize() const;
+    bool HasCamera() const;
+    const SceneCamera& GetCamera() const;
+
+    // description of the first error, prefixed with its line number
+    const std::string& GetError() const;
+
+private:
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        // filled by the count pass
+        size_t lineCount = 0;
+        size_t sphereCount = 0;
+        size_t materialCount = 0;
+
+        // prefix sums, where this chunk's records start
+        size_t firstLine = 0;
+        size_t firstSphere = 0;
+        size_t firstMaterial = 0;
+
+        bool hasCamera = false;
+        SceneCamera camera;
+        std::string error;
+    };
+
+    struct WorkArgs
+    {
+        TextSceneLoader* self;
+    };
+
+    static void CountWork(const WorkArgs& args);
+    static void ParseWork(const WorkArgs& args);
+
+    // run work on all threads until every chunk has been taken
+    void RunChunks(void(*work)(const WorkArgs&));
+
+    void CountChunk(Chunk& chunk);
+    void ParseChunk(Chunk& chunk);
+
+    std::unique_ptr<ThreadPool> ownThreads;
+    ThreadPool* threads;
+    MappedFile file;
+    std::vector<Chunk> chunks;
+    std::atomic<size_t> nextChunk;
+
+    size_t sphereCount;
+    size_t materialCount;
+    bool hasCamera;
+    SceneCamera camera;
+    std::string error;
+
+    // targets of the parse pass
+    Sphere* sphereBlock;
+    Material* materialBlock;
+};
+
+// write pools as a text scene, every sphere's material must come from materials
+bool SaveTextScene(const char* path, MemoryPool<Sphere>& spheres, MemoryPool<Material>& materials, const SceneCamera* camera);
+
+//------------------------------------------------------------------------------
+/**
+    Camera path for batch renders, one view per line in the text scene syntax:
+
+        # comment
+        camera <x> <y> <z> <rotationX> <rotationY>
+        matrix <m00> <m01> ... <m33>
+
+    error is prefixed with the line number like TextSceneLoader::GetError.
+*/
+bool LoadCameraPath(const char* path, std::vector<mat4>& views, std::string& error);
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline size_t
+TextSceneLoader::SphereCount() const
+{
+    return this->sphereCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline size_t
+TextSceneLoader::MaterialCount() const
+{
+    return this->materialCount;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline size_t
+TextSceneLoader::FileSize() const
+{
+    return this->file.Size();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline bool
+TextSceneLoader::HasCamera() const
+{
+    return this->hasCamera;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline const SceneCamera&
+TextSceneLoader::GetCamera() const
+{
+    return this->camera;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline const std::string&
+TextSceneLoader::GetError() const
+{
+    return this->error;
+}
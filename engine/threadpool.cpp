@@ -1,30 +1,56 @@
 #include "threadpool.h"
 
 ThreadPool::ThreadPool(size_t _size) :
-	completed(0)
+	pool(_size)
 {
 	size = _size;
-	pool.reserve(size);
 	for (size_t i = 0; i < size; i++)
-		pool.push_back({});
+		pool[i].thread = std::thread(&ThreadPool::WorkerLoop, this, i);
 }
 
 ThreadPool::~ThreadPool()
 {
-	run = false;
-	for (size_t i = 0; i < size; i++)
 	{
-		pool[i].thread->join();
-		delete pool[i].thread;
+		std::lock_guard<std::mutex> lock(mutex);
+		run = false;
 	}
+	started.notify_all();
+	for (size_t i = 0; i < size; i++)
+		pool[i].thread.join();
 }
 
-void ThreadPool::ExecuteAndWait()
+void ThreadPool::WorkerLoop(size_t index)
 {
-	for (size_t i = 0; i < size; i++)
-		pool[i].isDone = false;
+	uint64_t done = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		started.wait(lock, [&]() { return !run || generation != done; });
+		if (!run)
+			return;
+		done = generation;
 
-	while (completed.load(std::memory_order_acquire) < size);
+		lock.unlock();
+		if (pool[index].work)
+		{
+			Timeline::SetThreadName("pool worker");
+			TIMELINE_SCOPE("work");
+			pool[index].work();
+		}
+		lock.lock();
 
-	completed.store(0, std::memory_order_release);
-}
\ No newline at end of file
+		if (--running == 0)
+			finished.notify_one();
+	}
+}
+
+void ThreadPool::ExecuteAndWait()
+{
+	// the gaps between the workers' spans inside this one are load imbalance
+	TIMELINE_SCOPE("ExecuteAndWait");
+	std::unique_lock<std::mutex> lock(mutex);
+	running = size;
+	generation++;
+	started.notify_all();
+	finished.wait(lock, [this]() { return running == 0; });
+}
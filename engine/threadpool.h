@@ -1,49 +1,52 @@
 #pragma once
+#include <stdint.h>
 #include <vector>
 #include <thread>
-#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "timeline.h"
 
+//------------------------------------------------------------------------------
+/**
+    Fixed set of worker threads that sleep until ExecuteAndWait. Each worker
+    runs the work last given to it by InitThread, which can be changed between
+    calls, so one pool serves every parallel task of a program instead of
+    each task starting threads of its own.
+*/
 class ThreadPool
 {
 public:
-	struct Worker
-	{
-		std::thread* thread = nullptr;
-		bool isDone = true;
-	};
-
-	std::vector<Worker> pool;
 	size_t size = 0;
-	bool run = true;
-	std::atomic<int> completed;
 
 	ThreadPool(size_t _size);
 	~ThreadPool();
 
+	// set the work of a worker, only between ExecuteAndWait calls
 	template<typename ARGTYPE>
 	void InitThread(void(*work)(const ARGTYPE&), const ARGTYPE& arguments, size_t threadIndex)
 	{
-		void(*wrapper)(ThreadPool*, void(*)(const ARGTYPE&), const ARGTYPE&, size_t) =
-			[](ThreadPool* self, void(*function)(const ARGTYPE&), const ARGTYPE& args, size_t index)
-		{
-			while (self->run)
-			{
-				if (!self->pool[index].isDone)
-				{
-					function(args);
-					self->pool[index].isDone = true;;
-					self->completed++;
-				}
-				else
-				{
-					std::this_thread::yield();
-				}
-			}
-		};
-		
-		pool[threadIndex].thread = new std::thread(wrapper, this, work, arguments, threadIndex);
+		pool[threadIndex].work = [work, arguments]() { work(arguments); };
 	}
 
-
+	// run the work of every worker once and return when all of them are done
 	void ExecuteAndWait();
-};
\ No newline at end of file
+
+private:
+	struct Worker
+	{
+		std::thread thread;
+		std::function<void()> work;
+	};
+
+	void WorkerLoop(size_t index);
+
+	std::vector<Worker> pool;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	// bumped by every ExecuteAndWait, workers run once per value
+	uint64_t generation = 0;
+	size_t running = 0;
+	bool run = true;
+};
@@ -0,0 +1,159 @@
+#include "timeline.h"
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Timeline::enabled(false);
+
+namespace
+{
+
+struct ThreadBuffer
+{
+    Timeline::Event events[TIMELINE_EVENTS_PER_THREAD];
+    // events ever written, only the owning thread writes it
+    std::atomic<uint64_t> count{0};
+    // track of the owning thread
+    int thread = 0;
+    const char* name = nullptr;
+};
+
+std::mutex buffersMutex;
+// every buffer ever handed out, kept so events of exited threads can be saved
+std::vector<ThreadBuffer*> buffers;
+// buffers of exited threads, handed on to new threads so short lived pools don't add up
+std::vector<ThreadBuffer*> freeBuffers;
+// name of every track, indexed by thread - 1
+std::vector<const char*> threadNames;
+std::chrono::steady_clock::time_point epoch;
+
+// gives the buffer back when its thread exits
+struct ThreadBufferOwner
+{
+    ThreadBuffer* buffer = nullptr;
+
+    ~ThreadBufferOwner()
+    {
+        if (buffer == nullptr)
+            return;
+
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        freeBuffers.push_back(buffer);
+    }
+};
+
+thread_local ThreadBufferOwner threadBuffer;
+
+ThreadBuffer*
+GetThreadBuffer()
+{
+    if (threadBuffer.buffer != nullptr)
+        return threadBuffer.buffer;
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    if (!freeBuffers.empty())
+    {
+        threadBuffer.buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    else
+    {
+        threadBuffer.buffer = new ThreadBuffer();
+        buffers.push_back(threadBuffer.buffer);
+    }
+    threadNames.push_back(nullptr);
+    threadBuffer.buffer->thread = int(threadNames.size());
+    threadBuffer.buffer->name = nullptr;
+    return threadBuffer.buffer;
+}
+
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Timeline::Enable(bool enable)
+{
+    if (enable)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (ThreadBuffer* buffer : buffers)
+            buffer->count.store(0, std::memory_order_relaxed);
+        epoch = std::chrono::steady_clock::now();
+    }
+    enabled.store(enable, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Timeline::SetThreadName(const char* name)
+{
+    // don't hand out buffers to threads that never record
+    if (!IsEnabled())
+        return;
+
+    // pool workers name themselves for every task, only a new name takes the lock
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if (buffer->name == name)
+        return;
+
+    buffer->name = name;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    threadNames[buffer->thread - 1] = name;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Timeline::Record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    uint64_t index = buffer->count.load(std::memory_order_relaxed);
+    Event& event = buffer->events[index % TIMELINE_EVENTS_PER_THREAD];
+    event.name = name;
+    event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count();
+    event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    event.thread = buffer->thread;
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Complete ("X") events with microsecond timestamps, plus a metadata event
+    per thread so tracks carry their names
+*/
+bool
+Timeline::Save(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < threadNames.size(); i++)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s %zu\"}}",
+            i == 0 ? "" : ",\n", i + 1, threadNames[i] != nullptr ? threadNames[i] : "thread", i + 1);
+    }
+
+    for (ThreadBuffer* buffer : buffers)
+    {
+        // the oldest events are gone once the ring wrapped
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t begin = count > TIMELINE_EVENTS_PER_THREAD ? count - TIMELINE_EVENTS_PER_THREAD : 0;
+        for (uint64_t i = begin; i < count; i++)
+        {
+            const Event& event = buffer->events[i % TIMELINE_EVENTS_PER_THREAD];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                event.name, event.thread, event.start / 1000.0, event.duration / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
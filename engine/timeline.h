@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+// capacity of each thread's ring buffer, older events are overwritten
+#define TIMELINE_EVENTS_PER_THREAD 8192
+
+//------------------------------------------------------------------------------
+/**
+    Records where threads spend their time as a Chrome trace, viewable in
+    chrome://tracing or Perfetto.
+
+    Every thread writes complete events into its own ring buffer, so
+    recording takes no locks. A thread's buffer is registered the first time
+    it records. When the thread exits the buffer is handed on to the next new
+    thread, which continues it on a track of its own, so temporary pools don't
+    add up. While recording is off a scope costs a single relaxed load.
+*/
+namespace Timeline
+{
+    struct Event
+    {
+        const char* name;
+        // nanoseconds since recording was enabled
+        int64_t start;
+        int64_t duration;
+        // track of the thread that recorded it
+        int thread;
+    };
+
+    // start or stop recording, enabling drops all earlier events
+    void Enable(bool enable);
+    bool IsEnabled();
+
+    // name of the calling thread in the trace, must outlive the Timeline. ignored while not recording
+    void SetThreadName(const char* name);
+
+    // add an event to the calling thread's buffer, name must be a string literal or otherwise outlive the Timeline
+    void Record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    // store all recorded events as Chrome trace json. threads may not record meanwhile
+    bool Save(const char* path);
+
+    extern std::atomic<bool> enabled;
+}
+
+inline bool
+Timeline::IsEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Records its own lifetime as an event
+*/
+class TimelineScope
+{
+public:
+    TimelineScope(const char* name) :
+        name(name),
+        active(Timeline::IsEnabled())
+    {
+        if (active)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~TimelineScope()
+    {
+        if (active)
+            Timeline::Record(name, start, std::chrono::steady_clock::now());
+    }
+
+private:
+    const char* name;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define TIMELINE_CONCAT_(a, b) a##b
+#define TIMELINE_CONCAT(a, b) TIMELINE_CONCAT_(a, b)
+#define TIMELINE_SCOPE(name) TimelineScope TIMELINE_CONCAT(timelineScope, __LINE__)(name)
@@ -1,8 +1,20 @@
 #pragma once
 #include <cmath>
+#include <type_traits>
+#include "float4.h"
 
 #define MPI 3.14159265358979323846
 
+//------------------------------------------------------------------------------
+/**
+    Three scalar floats, deliberately not backed by float4 like mat4 is.
+
+    BoundingSphere::center is written as is into scene files and the
+    bounding sphere cache, padding vec3 to 16 bytes would change both
+    formats. The hot intersection loops already work on bounding spheres
+    split into SoA lanes, code that wants SIMD for a single vector converts
+    with ToFloat4 and ToVec3.
+*/
 class vec3
 {
 public:
@@ -12,17 +24,6 @@ public:
     vec3(float x, float y, float z) : x(x), y(y), z(z)
     {}
 
-    ~vec3()
-    {
-    }
-
-    vec3(vec3 const& rhs)
-    {
-        this->x = rhs.x;
-        this->y = rhs.y;
-        this->z = rhs.z;
-    }
-
     vec3 operator+(vec3 const& rhs) const 
     { 
         return {x + rhs.x, y + rhs.y, z + rhs.z};
@@ -47,6 +48,21 @@ public:
     float x, y, z;
 };
 
+static_assert(std::is_trivially_copyable<vec3>::value && sizeof(vec3) == 12, "vec3 must stay three trivially copyable floats");
+
+// w is 0
+inline float4 ToFloat4(const vec3& v)
+{
+    return Set4(v.x, v.y, v.z, 0.f);
+}
+
+inline vec3 ToVec3(float4 v)
+{
+    float f[4];
+    Store4(f, v);
+    return { f[0], f[1], f[2] };
+}
+
 inline float dot(vec3 a, vec3 b)
 {
 
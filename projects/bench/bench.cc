@@ -0,0 +1,616 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include "random.h"
+#include "raytracer.h"
+#include "material.h"
+#include "pbr.h"
+#include "fastmath.h"
+#include "cpudispatch.h"
+
+// microbenchmarks of the hot paths: intersection, raycasts, BSDFs, random numbers and matrix math
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// results are added here so the compiler can't drop the measured work
+volatile float sink = 0.f;
+
+struct Result
+{
+	std::string name;
+	size_t opsPerRepetition = 0;
+	// nanoseconds per operation of each repetition
+	std::vector<double> samples;
+	double median = 0.0;
+	double minimum = 0.0;
+	double mean = 0.0;
+	double stddev = 0.0;
+};
+
+struct Options
+{
+	size_t repetitions = 15;
+	// length of one repetition, the operation count is calibrated to reach it
+	double repetitionSeconds = 0.02;
+	const char* filter = nullptr;
+};
+
+// time run(count) for count operations, calibrated so a repetition takes repetitionSeconds, then repeated
+template<typename RUN>
+bool Measure(const Options& options, const std::string& name, std::vector<Result>& results, RUN run)
+{
+	if (options.filter != nullptr && name.find(options.filter) == std::string::npos)
+		return false;
+
+	// also warms up caches and branch predictors
+	size_t count = 16;
+	while (true)
+	{
+		auto start = std::chrono::steady_clock::now();
+		run(count);
+		double seconds = Seconds(start);
+		if (seconds >= options.repetitionSeconds || count >= (size_t(1) << 30))
+			break;
+		count = seconds <= 0.0 ? count * 16 : std::max(count * 2, size_t(count * options.repetitionSeconds / seconds * 1.2));
+	}
+
+	Result result;
+	result.name = name;
+	result.opsPerRepetition = count;
+	for (size_t i = 0; i < options.repetitions; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		run(count);
+		result.samples.push_back(Seconds(start) * 1e9 / count);
+	}
+
+	std::vector<double> sorted = result.samples;
+	std::sort(sorted.begin(), sorted.end());
+	size_t n = sorted.size();
+	result.median = n % 2 == 1 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+	result.minimum = sorted[0];
+	for (double sample : sorted)
+		result.mean += sample / n;
+	for (double sample : sorted)
+		result.stddev += (sample - result.mean) * (sample - result.mean) / (n > 1 ? n - 1 : 1);
+	result.stddev = sqrt(result.stddev);
+
+	printf("%-40s %10.2f ns/op %12.2f Mops/s   min %10.2f   stddev %6.2f%%\n",
+		name.c_str(), result.median, 1e3 / result.median, result.minimum, 100.0 * result.stddev / result.mean);
+	results.push_back(result);
+	return true;
+}
+
+struct Quality
+{
+	std::string name;
+	double mean = 0.0;
+	// correlation of consecutive draws, 0 for independent ones
+	double lagCorrelation = 0.0;
+	// chi square over 64 buckets, around 63 for a uniform generator
+	double chiSquare = 0.0;
+};
+
+// cheap statistics of count draws of a generator
+template<typename GENERATOR>
+Quality MeasureQuality(const std::string& name, size_t count, GENERATOR generate)
+{
+	std::vector<float> values(count);
+	generate(values.data(), count);
+
+	Quality quality;
+	quality.name = name;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	double sumProducts = 0.0;
+	size_t buckets[64] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		double v = values[i];
+		sum += v;
+		sumSquares += v * v;
+		if (i > 0)
+			sumProducts += v * values[i - 1];
+		buckets[size_t(v * 64.0) & 63]++;
+	}
+
+	quality.mean = sum / count;
+	double variance = sumSquares / count - quality.mean * quality.mean;
+	quality.lagCorrelation = (sumProducts / (count - 1) - quality.mean * quality.mean) / variance;
+
+	double expected = double(count) / 64.0;
+	for (size_t bucket : buckets)
+		quality.chiSquare += (bucket - expected) * (bucket - expected) / expected;
+
+	printf("%-40s mean %.5f   lag-1 correlation %+.5f   chi2(63) %10.1f\n",
+		name.c_str(), quality.mean, quality.lagCorrelation, quality.chiSquare);
+	return quality;
+}
+
+vec3 RandomDirection(RandomStream& rng)
+{
+	float random[4];
+	rng.Next4(random);
+	vec3 v(random[0] - 0.5f, random[1] - 0.5f, random[2] - 0.5f);
+	return len(v) > 1e-3f ? normalize(v) : vec3(0.f, 1.f, 0.f);
+}
+
+// the tester's generated scene: a floor and count - 1 random spheres in front of the camera
+void CreateScene(Raytracer& rt, int count)
+{
+	RandomStream rng(0, 0, 1);
+	for (int i = 0; i < count; i++)
+	{
+		Material* mat = rt.GetNewMaterial();
+		mat->type = MaterialType(i % 3);
+		mat->color = { rng.Next(), rng.Next(), rng.Next() };
+		mat->roughness = rng.Next();
+
+		if (i == 0)
+		{
+			*rt.GetNewSphere() = Sphere(1000.f, vec3(0.f, -1000.f, 0.f), mat);
+			continue;
+		}
+
+		float radius = rng.Next() * 1.5f + 0.5f;
+		vec3 pos(-50.f + 100.f * rng.Next(), 50.f * rng.Next(), -100.f + 120.f * rng.Next());
+		*rt.GetNewSphere() = Sphere(radius, pos, mat);
+	}
+}
+
+void WriteJson(const char* filename, const std::vector<Result>& results, const std::vector<Quality>& qualities)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+	{
+		std::cout << "failed to store '" << filename << "'" << std::endl;
+		return;
+	}
+
+	fprintf(file, "{\n\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"ns_per_op\": %.4f, \"ops_per_second\": %.1f, \"min_ns_per_op\": %.4f, \"mean_ns_per_op\": %.4f, \"stddev_ns_per_op\": %.4f, \"repetitions\": %zu, \"ops_per_repetition\": %zu, \"samples\": [",
+			r.name.c_str(), r.median, 1e9 / r.median, r.minimum, r.mean, r.stddev, r.samples.size(), r.opsPerRepetition);
+		for (size_t j = 0; j < r.samples.size(); j++)
+			fprintf(file, "%s%.4f", j == 0 ? "" : ", ", r.samples[j]);
+		fprintf(file, "] }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t],\n\t\"rng_quality\": [\n");
+	for (size_t i = 0; i < qualities.size(); i++)
+	{
+		const Quality& q = qualities[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"mean\": %.6f, \"lag1_correlation\": %.6f, \"chi2_63\": %.2f }%s\n",
+			q.name.c_str(), q.mean, q.lagCorrelation, q.chiSquare, i + 1 < qualities.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+}
+
+void PrintUsage()
+{
+	std::cout << "arguments are: [options]" << std::endl;
+	std::cout << "options:" << std::endl;
+	std::cout << "\t-repetitions <count>\ttimed repetitions per benchmark, 15 by default" << std::endl;
+	std::cout << "\t-time <ms>\t\tlength of a repetition, 20 by default" << std::endl;
+	std::cout << "\t-filter <text>\t\tonly run benchmarks whose name contains text" << std::endl;
+	std::cout << "\t-maxspheres <count>\tlargest raycast scene, 65536 by default" << std::endl;
+	std::cout << "\t-cpu <level>\t\tuse the scalar, sse4.1, avx2 or avx512 kernels outside the per level benchmarks" << std::endl;
+	std::cout << "\t-json <file>\t\tstore all results as json" << std::endl;
+}
+
+bool IsUnsignedInt(const char* str)
+{
+	size_t length = std::strlen(str);
+	for (size_t i = 0; i < length; i++)
+		if (str[i] < '0' || str[i] > '9')
+			return false;
+
+	return length > 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	const char* jsonFilename = nullptr;
+	int maxSpheres = 65536;
+	CpuLevel cpuLevel = DetectCpuLevel();
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "-repetitions") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			options.repetitions = size_t(std::stoi(argv[++i]));
+		else if (std::strcmp(argv[i], "-time") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			options.repetitionSeconds = std::stoi(argv[++i]) / 1000.0;
+		else if (std::strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+			options.filter = argv[++i];
+		else if (std::strcmp(argv[i], "-maxspheres") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			maxSpheres = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-cpu") == 0 && i + 1 < argc && CpuLevelFromName(argv[i + 1], cpuLevel))
+			i++;
+		else if (std::strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			jsonFilename = argv[++i];
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (!SetCpuLevel(cpuLevel))
+	{
+		std::cout << "this cpu can't run the " << GetCpuLevelName(cpuLevel) << " kernels, it supports up to " << GetCpuLevelName(DetectCpuLevel()) << std::endl;
+		return 1;
+	}
+	std::cout << "using " << GetCpuLevelName(cpuLevel) << " kernels" << std::endl;
+
+	std::vector<Result> results;
+	std::vector<Quality> qualities;
+
+	// fixed inputs, cycled through by every benchmark so the data stays in cache
+	const size_t inputCount = 4096;
+	const size_t inputMask = inputCount - 1;
+	RandomStream rng(0, 0, 2);
+	std::vector<Ray> rays;
+	std::vector<vec3> normals(inputCount);
+	std::vector<PackedSphere> spheres(inputCount);
+	std::vector<float> uniforms(inputCount * 2);
+	std::vector<mat4> matrices(inputCount);
+	for (size_t i = 0; i < inputCount; i++)
+	{
+		rays.push_back(Ray(vec3(0.f, 10.f, 0.f), RandomDirection(rng)));
+		normals[i] = RandomDirection(rng);
+		// about half of the rays hit
+		vec3 center = rays[i].origin + RandomDirection(rng) * 0.2f * 20.f + rays[i].dir * 20.f;
+		spheres[i] = { center.x, center.y, center.z, 0.5f + 4.f * rng.Next() };
+		uniforms[i * 2] = rng.Next();
+		uniforms[i * 2 + 1] = rng.Next();
+		matrices[i] = multiply(rotationy(360.f * rng.Next()), rotationx(180.f * rng.Next() - 90.f));
+		matrices[i].m30 = rng.Next() * 100.f;
+		matrices[i].m31 = rng.Next() * 100.f;
+		matrices[i].m32 = rng.Next() * 100.f;
+	}
+
+	std::cout << "intersection:" << std::endl;
+	Measure(options, "IntersectSphere", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			HitResult hit;
+			const PackedSphere& s = spheres[i & inputMask];
+			if (IntersectSphere(rays[(i * 7) & inputMask], s.Center(), s.radius, FLT_MAX, hit))
+				sum += hit.t;
+		}
+		sink = sink + sum;
+	});
+
+	// Raycast is called directly on this thread, the Raytracer's render threads sleep until work is dispatched to them
+	for (int sphereCount = 16; sphereCount <= maxSpheres; sphereCount *= 16)
+	{
+		std::vector<Color> frameBuffer(1);
+		std::vector<Color> frameBufferCopy(1);
+		Raytracer rt(1, 1, frameBuffer, frameBufferCopy, 1, 1, sphereCount);
+		CreateScene(rt, sphereCount);
+		rt.CreateBoundingSpheres();
+
+		std::string name = "Raycast " + std::to_string(sphereCount) + " spheres, " + std::to_string(rt.scene.boundingSphereCount) + " bounds";
+		Measure(options, name, results, [&](size_t count)
+		{
+			float sum = 0.f;
+			for (size_t i = 0; i < count; i++)
+			{
+				vec3 hitPoint;
+				vec3 hitNormal;
+				const Material* hitMaterial;
+				float distance;
+				if (rt.Raycast(rays[i & inputMask], hitPoint, hitNormal, hitMaterial, distance))
+					sum += distance;
+			}
+			sink = sink + sum;
+		});
+	}
+
+	// every level the cpu runs, one operation is one sphere or one float
+	std::cout << "kernels:" << std::endl;
+	std::vector<float> boundsX(inputCount), boundsY(inputCount), boundsZ(inputCount), boundsRadius(inputCount);
+	for (size_t i = 0; i < inputCount; i++)
+	{
+		boundsX[i] = spheres[i].x;
+		boundsY[i] = spheres[i].y;
+		boundsZ[i] = spheres[i].z;
+		boundsRadius[i] = spheres[i].radius;
+	}
+	std::vector<uint8_t> quantized(inputCount);
+	for (int level = 0; level <= int(DetectCpuLevel()); level++)
+	{
+		SetCpuLevel(CpuLevel(level));
+		const CpuKernels& kernels = GetCpuKernels();
+		std::string levelName = GetCpuLevelName(CpuLevel(level));
+
+		Measure(options, "cullSpheres " + levelName + ", blocks of " + std::to_string(RAYCAST_CULL_BLOCK), results, [&](size_t count)
+		{
+			uint32_t hits[RAYCAST_CULL_BLOCK];
+			size_t hitCount = 0;
+			for (size_t i = 0; i < count; i += RAYCAST_CULL_BLOCK)
+			{
+				size_t first = i & inputMask & ~size_t(RAYCAST_CULL_BLOCK - 1);
+				const Ray& ray = rays[(i / RAYCAST_CULL_BLOCK) & inputMask];
+				const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+				const float dir[3] = { ray.dir.x, ray.dir.y, ray.dir.z };
+				hitCount += kernels.cullSpheres(boundsX.data() + first, boundsY.data() + first, boundsZ.data() + first, boundsRadius.data() + first,
+					RAYCAST_CULL_BLOCK, origin, dir, dot(ray.dir, ray.dir), FLT_MAX, hits);
+			}
+			sink = sink + float(hitCount);
+		});
+
+		Measure(options, "quantize " + levelName, results, [&](size_t count)
+		{
+			for (size_t i = 0; i < count; i += inputCount)
+				kernels.quantize(uniforms.data(), inputCount, quantized.data());
+			sink = sink + quantized[count & inputMask];
+		});
+	}
+	SetCpuLevel(cpuLevel);
+
+	std::cout << "materials:" << std::endl;
+	static const char* typeNames[] = { "Lambertian", "Dielectric", "Conductor" };
+	for (int type = 0; type < 3; type++)
+	{
+		for (float roughness : { 0.1f, 0.75f })
+		{
+			Material material;
+			material.type = MaterialType(type);
+			material.roughness = roughness;
+
+			char name[64];
+			snprintf(name, sizeof(name), "BSDF_%s roughness %.2f", typeNames[type], roughness);
+			Measure(options, name, results, [&](size_t count)
+			{
+				RandomStream stream(0, 0);
+				float sum = 0.f;
+				for (size_t i = 0; i < count; i++)
+				{
+					// incoming rays from the outside of the surface
+					vec3 normal = normals[i & inputMask];
+					vec3 dir = rays[i & inputMask].dir;
+					Ray ray(vec3(0.f, 0.f, 0.f), dot(dir, normal) < 0.f ? dir : -dir);
+					material.BSDF(ray, vec3(0.f, 0.f, 0.f), normal, stream);
+					sum += ray.dir.x;
+				}
+				sink = sink + sum;
+			});
+		}
+	}
+
+	Measure(options, "ImportanceSampleGGX_VNDF", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t j = i & inputMask;
+			vec3 h = ImportanceSampleGGX_VNDF(uniforms[j * 2], uniforms[j * 2 + 1], 0.5f, rays[j].dir, matrices[j]);
+			sum += h.x;
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "FresnelSchlick", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += FresnelSchlick(uniforms[i & inputMask], 0.04f, uniforms[(i + 1) & inputMask]);
+		sink = sink + sum;
+	});
+
+	// the C library against fastmath.h, inputs in the ranges the BSDFs use
+	std::cout << "math:" << std::endl;
+	Measure(options, "powf(2, x)", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += std::powf(2.f, -12.f * uniforms[i & inputMask]);
+		sink = sink + sum;
+	});
+
+	Measure(options, "ApproxExp2", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += ApproxExp2(-12.f * uniforms[i & inputMask]);
+		sink = sink + sum;
+	});
+
+	Measure(options, "sin and cos", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			float phi = 6.283185f * uniforms[i & inputMask];
+			sum += std::sin(phi) + std::cos(phi);
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "ApproxSinCos", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			float s, c;
+			ApproxSinCos(6.283185f * uniforms[i & inputMask], s, c);
+			sum += s + c;
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "1 / sqrtf", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += 1.f / std::sqrtf(uniforms[i & inputMask] + 0.01f);
+		sink = sink + sum;
+	});
+
+	Measure(options, "ApproxRsqrt", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += ApproxRsqrt(uniforms[i & inputMask] + 0.01f);
+		sink = sink + sum;
+	});
+
+	if (options.filter == nullptr || std::string("accuracy").find(options.filter) != std::string::npos)
+	{
+		// the sweeps behind the errors stated in fastmath.h
+		std::cout << "fast math accuracy against double precision:" << std::endl;
+		double exp2Error = 0.0;
+		for (double x = -126.0; x <= 127.0; x += 1e-4)
+			exp2Error = std::max(exp2Error, fabs(ApproxExp2(float(x)) / exp2(double(float(x))) - 1.0));
+
+		double sinCosError = 0.0;
+		for (double x = -8192.0; x <= 8192.0; x += 1e-3)
+		{
+			float s, c;
+			ApproxSinCos(float(x), s, c);
+			sinCosError = std::max(sinCosError, std::max(fabs(s - sin(double(float(x)))), fabs(c - cos(double(float(x))))));
+		}
+
+		// every 97th float from the smallest normal to the largest
+		double rsqrtError = 0.0;
+		for (uint32_t bits = 0x00800000u; bits < 0x7f800000u; bits += 97)
+		{
+			float x;
+			memcpy(&x, &bits, sizeof(x));
+			rsqrtError = std::max(rsqrtError, fabs(ApproxRsqrt(x) * sqrt(double(x)) - 1.0));
+		}
+		printf("%-40s %12g\n", "ApproxExp2 max relative error", exp2Error);
+		printf("%-40s %12g\n", "ApproxSinCos max absolute error", sinCosError);
+		printf("%-40s %12g\n", "ApproxRsqrt max relative error", rsqrtError);
+	}
+
+	std::cout << "random numbers:" << std::endl;
+	Measure(options, "RandomFloat(++seed)", results, [&](size_t count)
+	{
+		uint32_t seed = 1337420;
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += RandomFloat(++seed);
+		sink = sink + sum;
+	});
+
+	// per bounce usage: a new stream per sample, a handful of floats each
+	Measure(options, "RandomStream::Next, 16 per stream", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count;)
+		{
+			RandomStream stream(uint32_t(i >> 20), uint32_t(i));
+			for (int j = 0; j < 16 && i < count; j++, i++)
+				sum += stream.Next();
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "RandomStream::Next4, per float", results, [&](size_t count)
+	{
+		RandomStream stream(0, 0);
+		float sum = 0.f;
+		float random[4];
+		for (size_t i = 0; i < count; i += 4)
+		{
+			stream.Next4(random);
+			sum += random[0] + random[1] + random[2] + random[3];
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "RandomStream::Next8, per float", results, [&](size_t count)
+	{
+		RandomStream stream(0, 0);
+		float sum = 0.f;
+		float random[8];
+		for (size_t i = 0; i < count; i += 8)
+		{
+			stream.Next8(random);
+			for (int j = 0; j < 8; j++)
+				sum += random[j];
+		}
+		sink = sink + sum;
+	});
+
+	std::cout << "matrices:" << std::endl;
+	Measure(options, "mat4 inverse", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+			sum += inverse(matrices[i & inputMask]).m00;
+		sink = sink + sum;
+	});
+
+	Measure(options, "mat4 transform", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			vec3 v = transform(rays[i & inputMask].dir, matrices[(i * 7) & inputMask]);
+			sum += v.x + v.y + v.z;
+		}
+		sink = sink + sum;
+	});
+
+	Measure(options, "mat4 multiply", results, [&](size_t count)
+	{
+		float sum = 0.f;
+		for (size_t i = 0; i < count; i++)
+		{
+			// one element of every row, so no row can be left out
+			mat4 m = multiply(matrices[i & inputMask], matrices[(i * 7) & inputMask]);
+			sum += m.m00 + m.m11 + m.m22 + m.m33;
+		}
+		sink = sink + sum;
+	});
+
+	if (options.filter == nullptr || std::string("quality").find(options.filter) != std::string::npos)
+	{
+		std::cout << "random number quality, 2^22 draws:" << std::endl;
+		const size_t drawCount = size_t(1) << 22;
+		qualities.push_back(MeasureQuality("RandomFloat(++seed)", drawCount, [](float* out, size_t n)
+		{
+			uint32_t seed = 1337420;
+			for (size_t i = 0; i < n; i++)
+				out[i] = RandomFloat(++seed);
+		}));
+
+		qualities.push_back(MeasureQuality("RandomStream::Next, 16 per stream", drawCount, [](float* out, size_t n)
+		{
+			for (size_t i = 0; i < n;)
+			{
+				RandomStream stream(uint32_t(i >> 20), uint32_t(i));
+				for (int j = 0; j < 16 && i < n; j++)
+					out[i++] = stream.Next();
+			}
+		}));
+
+		qualities.push_back(MeasureQuality("RandomStream::Next4", drawCount, [](float* out, size_t n)
+		{
+			RandomStream stream(0, 0);
+			for (size_t i = 0; i + 4 <= n; i += 4)
+				stream.Next4(out + i);
+		}));
+	}
+
+	if (jsonFilename != nullptr)
+		WriteJson(jsonFilename, results, qualities);
+
+	return 0;
+}
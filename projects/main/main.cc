@@ -31,7 +31,6 @@ int main()
     int maxSpheres = 500;
 
     Raytracer rt = Raytracer(w, h, framebuffer, framebufferCopy, raysPerPixel, maxBounces, maxSpheres);
-    MemoryPool<Material> materials(maxSpheres);
 
     uint32_t seed = 1337420;
 
@@ -39,7 +38,7 @@ int main()
     int matType = 0;
     for (int i = 0; i < maxSpheres; i++)
     {
-        Material* mat = materials.GetNew();
+        Material* mat = rt.GetNewMaterial();
         switch (matType++)
         {
         case 0:
@@ -73,7 +72,8 @@ int main()
         *rt.GetNewSphere() = Sphere(radius, pos, mat);
     }
 
-    rt.CreateBoundingSpheres();
+    if (!rt.CreateBoundingSpheres())
+        return 1;
     
     bool exit = false;
 
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "partial.h"
+#include "imagewriter.h"
+#include "hdrwriter.h"
+#include "accumulation.h"
+
+// combines partial renders of sample slices into the image a single run over all of them produces
+
+void PrintUsage()
+{
+	std::cout << "arguments are: partialFiles... [options]" << std::endl;
+	std::cout << "options:" << std::endl;
+	std::cout << "\t-image <file>\t\tstore the merged image as .png, .qoi or .ppm" << std::endl;
+	std::cout << "\t-hdr <file>\t\tstore the merged image as .exr or .pfm" << std::endl;
+	std::cout << "\t-savepartial <file>\tstore the merged sums, to be merged again later" << std::endl;
+	std::cout << "\t-dumpaccum <file>\tstore the raw accumulation sum and sample count" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<const char*> partialFilenames;
+	const char* imageFilename = nullptr;
+	const char* hdrFilename = nullptr;
+	const char* partialFilename = nullptr;
+	const char* accumulationFilename = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "-image") == 0 && i + 1 < argc)
+			imageFilename = argv[++i];
+		else if (std::strcmp(argv[i], "-hdr") == 0 && i + 1 < argc)
+			hdrFilename = argv[++i];
+		else if (std::strcmp(argv[i], "-savepartial") == 0 && i + 1 < argc)
+			partialFilename = argv[++i];
+		else if (std::strcmp(argv[i], "-dumpaccum") == 0 && i + 1 < argc)
+			accumulationFilename = argv[++i];
+		else if (argv[i][0] != '-')
+			partialFilenames.push_back(argv[i]);
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (partialFilenames.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	PartialRender merged;
+	for (size_t i = 0; i < partialFilenames.size(); i++)
+	{
+		PartialRender partial;
+		if (!partial.Load(partialFilenames[i]))
+		{
+			std::cout << "failed to load partial render '" << partialFilenames[i] << "'" << std::endl;
+			return 1;
+		}
+
+		if (i == 0)
+		{
+			merged = std::move(partial);
+			continue;
+		}
+
+		if (!merged.Merge(partial))
+		{
+			std::cout << "'" << partialFilenames[i] << "' is from a different render, overlaps the samples of an earlier partial or takes the sum past " << PARTIAL_MAX_FRAMES << " frames" << std::endl;
+			return 1;
+		}
+	}
+
+	const CheckpointHeader& settings = merged.header.settings;
+	size_t width = settings.width;
+	size_t height = settings.height;
+
+	std::cout << "merged " << partialFilenames.size() << " partials, " << merged.FrameCount() << " frames of " << settings.raysPerPixel << " samples per pixel covering samples";
+	for (const auto& range : merged.ranges)
+		std::cout << " " << range.first << "-" << range.second;
+	std::cout << std::endl;
+
+	if (!merged.IsContiguous())
+		std::cout << "the samples don't start at 0 or have gaps, the image is not the one a single run produces" << std::endl;
+
+	if (merged.FrameCount() == 0)
+	{
+		std::cout << "the partials hold no samples" << std::endl;
+		return 1;
+	}
+
+	std::vector<Color> sum(width * height);
+	std::vector<Color> image(width * height);
+	merged.Resolve(sum.data(), image.data());
+
+	if (imageFilename != nullptr)
+	{
+		ImageWriter writer(std::thread::hardware_concurrency());
+		if (!writer.Save(imageFilename, image.data(), width, height))
+			std::cout << "failed to store image '" << imageFilename << "'" << std::endl;
+	}
+
+	if (hdrFilename != nullptr)
+	{
+		HdrWriter writer(std::thread::hardware_concurrency());
+		if (!writer.Save(hdrFilename, image.data(), width, height))
+			std::cout << "failed to store hdr image '" << hdrFilename << "'" << std::endl;
+	}
+
+	if (partialFilename != nullptr && !merged.Save(partialFilename))
+		std::cout << "failed to store partial render '" << partialFilename << "'" << std::endl;
+
+	if (accumulationFilename != nullptr)
+	{
+		AccumulationHeader header;
+		header.width = uint32_t(width);
+		header.height = uint32_t(height);
+		header.frameCount = merged.FrameCount();
+		header.raysPerPixel = settings.raysPerPixel;
+		if (!SaveAccumulation(accumulationFilename, header, sum.data()))
+			std::cout << "failed to store accumulation buffer '" << accumulationFilename << "'" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "textscene.h"
+#include "random.h"
+
+// measures text scene parsing throughput, optionally generating a synthetic scene of a given size first
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool GenerateScene(const char* filename, size_t megabytes)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	const size_t targetSize = megabytes * 1024 * 1024;
+	const int materialCount = 1024;
+	static const char* typeNames[] = { "lambertian", "dielectric", "conductor" };
+
+	uint32_t seed = 1337420;
+	size_t written = 0;
+	char line[256];
+
+	fprintf(file, "# synthetic scene for scenebench\ncamera 0 10 0 0 0\n");
+	for (int i = 0; i < materialCount; i++)
+	{
+		// drawn one by one, the order of arguments in a call is up to the compiler
+		float r = RandomFloat(++seed);
+		float g = RandomFloat(++seed);
+		float b = RandomFloat(++seed);
+		float roughness = RandomFloat(++seed);
+		int length = snprintf(line, sizeof(line), "material %s %.6g %.6g %.6g %.6g\n", typeNames[i % 3], r, g, b, roughness);
+		written += fwrite(line, 1, size_t(length), file);
+	}
+
+	// buffer lines so writing doesn't dominate generation of multi-gigabyte files
+	std::string block;
+	block.reserve(1 << 20);
+	while (written < targetSize)
+	{
+		float x = RandomFloatNTP(++seed) * 500.f;
+		float y = RandomFloat(++seed) * 50.f;
+		float z = RandomFloatNTP(++seed) * 500.f;
+		float radius = RandomFloat(++seed) * 1.5f + 0.5f;
+		unsigned material = (++seed * 2654435761u) % materialCount;
+		int length = snprintf(line, sizeof(line), "sphere %.6g %.6g %.6g %.6g %u\n", x, y, z, radius, material);
+		block.append(line, size_t(length));
+		written += size_t(length);
+
+		if (block.size() >= (1 << 20) - 256)
+		{
+			fwrite(block.data(), 1, block.size(), file);
+			block.clear();
+		}
+	}
+	fwrite(block.data(), 1, block.size(), file);
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "arguments are: sceneFile, sizeInMegabytes(optional, generates the scene first), repetitions(optional)" << std::endl;
+		return 1;
+	}
+
+	const char* filename = argv[1];
+	int repetitions = argc > 3 ? std::atoi(argv[3]) : 3;
+
+	if (argc > 2)
+	{
+		size_t megabytes = size_t(std::atoll(argv[2]));
+		std::cout << "generating " << megabytes << " MB scene '" << filename << "'..." << std::endl;
+		auto start = std::chrono::steady_clock::now();
+		if (!GenerateScene(filename, megabytes))
+		{
+			std::cout << "failed to write '" << filename << "'" << std::endl;
+			return 1;
+		}
+		std::cout << "\tdone in " << Seconds(start) << " s" << std::endl;
+	}
+
+	// size the pools once, every run parses into the same storage
+	size_t sphereCount;
+	size_t materialCount;
+	size_t fileSize;
+	{
+		TextSceneLoader loader(1);
+		if (!loader.Open(filename))
+		{
+			std::cout << loader.GetError() << std::endl;
+			return 1;
+		}
+		sphereCount = loader.SphereCount();
+		materialCount = loader.MaterialCount();
+		fileSize = loader.FileSize();
+	}
+
+	std::cout << "scene has " << sphereCount << " spheres and " << materialCount << " materials, " << fileSize / (1024 * 1024) << " MB" << std::endl;
+
+	MemoryPool<Sphere> spheres((int)sphereCount);
+	MemoryPool<Material> materials((int)materialCount);
+
+	// powers of two up to all hardware threads
+	std::vector<size_t> threadCounts;
+	size_t maxThreads = std::thread::hardware_concurrency();
+	for (size_t threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	for (size_t threads : threadCounts)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repetitions; i++)
+		{
+			spheres.Clear();
+			materials.Clear();
+
+			auto start = std::chrono::steady_clock::now();
+			TextSceneLoader loader(threads);
+			if (!loader.Open(filename) || !loader.Load(spheres, materials))
+			{
+				std::cout << loader.GetError() << std::endl;
+				return 1;
+			}
+			double seconds = Seconds(start);
+			best = seconds < best ? seconds : best;
+		}
+
+		std::cout << threads << " threads:\t" << best * 1000.0 << " ms\t"
+			<< (fileSize / (1024.0 * 1024.0)) / best << " MB/s\t"
+			<< (sphereCount / 1000000.0) / best << " Mspheres/s" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,319 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include "raytracer.h"
+#include "random.h"
+#include "textscene.h"
+
+// sweeps the sphere count and distribution of generated scenes and records how bounding sphere
+// grouping, memory and tracing scale, so density cliffs show up before a production scene hits them
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+enum class Distribution
+{
+	// the tester's fixed 100x50x120 box, denser with every step
+	Uniform,
+	// gaussian blobs around a few centers in the same box
+	Clustered,
+	// almost all spheres tiny and packed into a few units, the rest spread over a huge floor
+	Stadium
+};
+
+const char* distributionNames[] = { "uniform", "clustered", "stadium" };
+
+struct SweepResult
+{
+	Distribution distribution;
+	int sphereCount = 0;
+	bool skipped = false;
+
+	size_t boundingSphereCount = 0;
+	double buildMilliseconds = 0.0;
+	// pools sized by the Raytracer for the sphere count, touched or not
+	size_t allocatedBytes = 0;
+	// what the intersection loop walks
+	size_t sceneBytes = 0;
+	double megaRaysPerSecond = 0.0;
+};
+
+struct SweepOptions
+{
+	int minSpheres = 10;
+	int maxSpheres = 10000000;
+	size_t width = 64;
+	size_t height = 48;
+	int frames = 2;
+	int bounces = 5;
+	// larger scenes of a distribution are skipped once a step took longer than this
+	double budgetSeconds = 30.0;
+};
+
+vec3 RandomInBox(RandomStream& rng, const vec3& minPos, const vec3& maxPos)
+{
+	vec3 span = maxPos - minPos;
+	return { minPos.x + span.x * rng.Next(), minPos.y + span.y * rng.Next(), minPos.z + span.z * rng.Next() };
+}
+
+// sum of three uniforms, close enough to a normal distribution with a standard deviation of 1
+float RandomGaussian(RandomStream& rng)
+{
+	// drawn one by one, the operands of + are evaluated in no particular order
+	float a = rng.Next();
+	float b = rng.Next();
+	float c = rng.Next();
+	return (a + b + c - 1.5f) * 2.f;
+}
+
+void CreateSweepScene(Raytracer& rt, Distribution distribution, int sphereCount)
+{
+	const int materialCount = 64;
+	std::vector<Material*> materials;
+	RandomStream rng(0, uint32_t(distribution), 3);
+	for (int i = 0; i < materialCount; i++)
+	{
+		Material* mat = rt.GetNewMaterial();
+		mat->type = MaterialType(i % 3);
+		mat->color = { rng.Next(), rng.Next(), rng.Next() };
+		mat->roughness = rng.Next();
+		materials.push_back(mat);
+	}
+
+	// floor
+	*rt.GetNewSphere() = Sphere(1000.f, vec3(0.f, -1000.f, 0.f), materials[0]);
+
+	const vec3 minPos(-50.f, 0.f, -100.f);
+	const vec3 maxPos(50.f, 50.f, 20.f);
+	const int clusterCount = 32;
+	std::vector<vec3> clusters;
+	for (int i = 0; i < clusterCount; i++)
+		clusters.push_back(RandomInBox(rng, minPos, maxPos));
+
+	for (int i = 1; i < sphereCount; i++)
+	{
+		Material* mat = materials[i % materialCount];
+		float radius = rng.Next() * 1.5f + 0.5f;
+		vec3 pos;
+
+		switch (distribution)
+		{
+		case Distribution::Uniform:
+			pos = RandomInBox(rng, minPos, maxPos);
+			break;
+		case Distribution::Clustered:
+		{
+			const vec3& center = clusters[size_t(rng.Next() * clusterCount) % clusterCount];
+			float x = RandomGaussian(rng);
+			float y = RandomGaussian(rng);
+			float z = RandomGaussian(rng);
+			pos = center + vec3(x, y, z) * 4.f;
+			break;
+		}
+		case Distribution::Stadium:
+			// the teapot sits in front of the camera, every hundredth sphere is out in the stadium
+			if (i % 100 != 0)
+			{
+				radius = rng.Next() * 0.08f + 0.02f;
+				pos = RandomInBox(rng, vec3(-2.f, 8.f, -32.f), vec3(2.f, 12.f, -28.f));
+			}
+			else
+			{
+				pos = RandomInBox(rng, vec3(-1000.f, 0.f, -1000.f), vec3(1000.f, 50.f, 1000.f));
+			}
+			break;
+		}
+
+		*rt.GetNewSphere() = Sphere(radius, pos, mat);
+	}
+}
+
+SweepResult RunSweepStep(const SweepOptions& options, Distribution distribution, int sphereCount)
+{
+	SweepResult result;
+	result.distribution = distribution;
+	result.sphereCount = sphereCount;
+
+	std::vector<Color> frameBuffer(options.width * options.height);
+	std::vector<Color> frameBufferCopy(options.width * options.height);
+	int poolSize = std::max(sphereCount, 64);
+	Raytracer rt(options.width, options.height, frameBuffer, frameBufferCopy, 1, size_t(options.bounces), poolSize);
+	CreateSweepScene(rt, distribution, sphereCount);
+
+	auto buildStart = std::chrono::steady_clock::now();
+	rt.CreateBoundingSpheres();
+	result.buildMilliseconds = Seconds(buildStart) * 1000.0;
+	result.boundingSphereCount = rt.scene.boundingSphereCount;
+
+	result.allocatedBytes = size_t(poolSize) * (sizeof(Sphere) + sizeof(Material) + sizeof(BoundingSphere)) +
+		rt.packedSpheres.capacity() * sizeof(PackedSphere) + rt.sphereMaterialIndices.capacity() * sizeof(uint32_t);
+	result.sceneBytes = rt.scene.sphereCount * (sizeof(PackedSphere) + sizeof(uint32_t)) +
+		rt.scene.boundingSphereCount * sizeof(BoundingSphere) + rt.scene.materialCount * sizeof(Material);
+
+	// the tester's default camera, looking into the box and at the teapot
+	SceneCamera camera;
+	camera.position = { 0.f, 10.f, 0.f };
+	rt.SetViewMatrix(SceneCameraMatrix(camera));
+
+	size_t rayCount = 0;
+	auto traceStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < options.frames; i++)
+	{
+		rt.Raytrace();
+		for (size_t count : rt.rayCounters)
+			rayCount += count;
+	}
+	double traceSeconds = Seconds(traceStart);
+	result.megaRaysPerSecond = traceSeconds > 0.0 ? rayCount / 1e6 / traceSeconds : 0.0;
+
+	return result;
+}
+
+void PrintResult(const SweepResult& r)
+{
+	std::cout << distributionNames[int(r.distribution)] << "\t" << r.sphereCount << "\t";
+	if (r.skipped)
+	{
+		std::cout << "skipped, over budget" << std::endl;
+		return;
+	}
+
+	std::cout << r.boundingSphereCount << " bs (" << double(r.sphereCount) / std::max(r.boundingSphereCount, size_t(1)) << " per bs)\t"
+		<< r.buildMilliseconds << " ms build\t"
+		<< r.sceneBytes / (1024.0 * 1024.0) << " MB scene, " << r.allocatedBytes / (1024.0 * 1024.0) << " MB allocated\t"
+		<< r.megaRaysPerSecond << " MegaRays/s" << std::endl;
+}
+
+void WriteJson(const char* filename, const SweepOptions& options, const std::vector<SweepResult>& results)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+	{
+		std::cout << "failed to store '" << filename << "'" << std::endl;
+		return;
+	}
+
+	fprintf(file, "{\n\t\"width\": %zu,\n\t\"height\": %zu,\n\t\"frames\": %d,\n\t\"bounces\": %d,\n\t\"sweep\": [\n", options.width, options.height, options.frames, options.bounces);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const SweepResult& r = results[i];
+		fprintf(file, "\t\t{ \"distribution\": \"%s\", \"spheres\": %d, \"skipped\": %s", distributionNames[int(r.distribution)], r.sphereCount, r.skipped ? "true" : "false");
+		if (!r.skipped)
+			fprintf(file, ", \"bounding_spheres\": %zu, \"build_ms\": %.3f, \"scene_bytes\": %zu, \"allocated_bytes\": %zu, \"megarays_per_second\": %.4f",
+				r.boundingSphereCount, r.buildMilliseconds, r.sceneBytes, r.allocatedBytes, r.megaRaysPerSecond);
+		fprintf(file, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+}
+
+void PrintUsage()
+{
+	std::cout << "arguments are: [options]" << std::endl;
+	std::cout << "options:" << std::endl;
+	std::cout << "\t-min <count>\t\tsmallest scene, 10 by default" << std::endl;
+	std::cout << "\t-max <count>\t\tlargest scene, 10000000 by default, counts grow tenfold" << std::endl;
+	std::cout << "\t-distribution <name>\tonly sweep uniform, clustered or stadium" << std::endl;
+	std::cout << "\t-size <width> <height>\ttraced image, 64x48 by default" << std::endl;
+	std::cout << "\t-frames <count>\t\tframes traced per scene, 2 by default" << std::endl;
+	std::cout << "\t-bounces <count>\tmax bounces, 5 by default" << std::endl;
+	std::cout << "\t-budget <seconds>\tskip larger scenes once building and tracing one took longer, 30 by default" << std::endl;
+	std::cout << "\t-json <file>\t\tstore all results as json" << std::endl;
+}
+
+bool IsUnsignedInt(const char* str)
+{
+	size_t length = std::strlen(str);
+	for (size_t i = 0; i < length; i++)
+		if (str[i] < '0' || str[i] > '9')
+			return false;
+
+	return length > 0;
+}
+
+int main(int argc, char* argv[])
+{
+	SweepOptions options;
+	const char* jsonFilename = nullptr;
+	std::vector<Distribution> distributions = { Distribution::Uniform, Distribution::Clustered, Distribution::Stadium };
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "-min") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			options.minSpheres = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-max") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			options.maxSpheres = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-distribution") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			distributions.clear();
+			for (int d = 0; d < 3; d++)
+				if (std::strcmp(name, distributionNames[d]) == 0)
+					distributions.push_back(Distribution(d));
+			if (distributions.empty())
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "-size") == 0 && i + 2 < argc && IsUnsignedInt(argv[i + 1]) && IsUnsignedInt(argv[i + 2]) && std::stoi(argv[i + 1]) > 0 && std::stoi(argv[i + 2]) > 0)
+		{
+			options.width = size_t(std::stoi(argv[++i]));
+			options.height = size_t(std::stoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "-frames") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+			options.frames = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-bounces") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+			options.bounces = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-budget") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+			options.budgetSeconds = std::stoi(argv[++i]);
+		else if (std::strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			jsonFilename = argv[++i];
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::vector<int> sphereCounts;
+	for (long long count = options.minSpheres; count <= options.maxSpheres; count *= 10)
+		sphereCounts.push_back(int(count));
+
+	std::vector<SweepResult> results;
+	for (Distribution distribution : distributions)
+	{
+		bool overBudget = false;
+		for (int sphereCount : sphereCounts)
+		{
+			SweepResult result;
+			if (overBudget)
+			{
+				result.distribution = distribution;
+				result.sphereCount = sphereCount;
+				result.skipped = true;
+			}
+			else
+			{
+				auto start = std::chrono::steady_clock::now();
+				result = RunSweepStep(options, distribution, sphereCount);
+				// grouping is quadratic in the worst case, the next step would take far longer still
+				overBudget = Seconds(start) > options.budgetSeconds;
+			}
+
+			PrintResult(result);
+			results.push_back(result);
+		}
+	}
+
+	if (jsonFilename != nullptr)
+		WriteJson(jsonFilename, options, results);
+
+	return 0;
+}
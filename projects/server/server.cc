@@ -0,0 +1,307 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <thread>
+#include <vector>
+#include "renderserver.h"
+#include "imagewriter.h"
+#include "hdrwriter.h"
+
+// keeps scenes resident and renders jobs submitted over a socket, or submits jobs to such a server
+
+void PrintUsage()
+{
+	std::cout << "arguments are: -port <port> [server options] or -submit <host:port> -job <sceneId> <width> <height> <samplesPerPixel> [job options]..." << std::endl;
+	std::cout << "server options:" << std::endl;
+	std::cout << "\t-scene <id> <file>\tserve a binary scene file under id" << std::endl;
+	std::cout << "\t-textscene <id> <file>\tserve a text scene under id" << std::endl;
+	std::cout << "\t-bscache <directory>\treuse bounding spheres built by earlier runs of the same scene" << std::endl;
+	std::cout << "\t-public\t\t\taccept clients from other machines, not only this one" << std::endl;
+	std::cout << "job options, for the preceding -job:" << std::endl;
+	std::cout << "\t-spf <count>\t\tsamples per progressive frame, 1 by default" << std::endl;
+	std::cout << "\t-bounces <count>\tmax bounces, 5 by default" << std::endl;
+	std::cout << "\t-priority <value>\thigher priorities are rendered first, 0 by default" << std::endl;
+	std::cout << "\t-camera <x> <y> <z> <rotationX> <rotationY>\tinstead of the scene's camera" << std::endl;
+	std::cout << "\t-progress <frames>\treceive and store the image every this many frames" << std::endl;
+	std::cout << "\t-image <file>\t\tstore the result as .png, .qoi or .ppm" << std::endl;
+	std::cout << "\t-hdr <file>\t\tstore the result as .exr or .pfm" << std::endl;
+}
+
+bool IsUnsignedInt(const char* str)
+{
+	size_t length = std::strlen(str);
+	for (size_t i = 0; i < length; i++)
+		if (str[i] < '0' || str[i] > '9')
+			return false;
+
+	return length > 0;
+}
+
+bool IsInt(const char* str)
+{
+	return IsUnsignedInt(str[0] == '-' ? str + 1 : str);
+}
+
+// 1 to 65535, checked before conversion so no value wraps or throws
+bool IsPort(const char* str)
+{
+	size_t length = std::strlen(str);
+	return length > 0 && length <= 5 && IsUnsignedInt(str) && std::atoi(str) >= 1 && std::atoi(str) <= 65535;
+}
+
+struct ClientJob
+{
+	RenderJobRequest request;
+	const char* imageFilename = nullptr;
+	const char* hdrFilename = nullptr;
+	uint32_t id = 0;
+	bool done = false;
+};
+
+RenderServer* runningServer = nullptr;
+
+void StopServer(int)
+{
+	if (runningServer != nullptr)
+		runningServer->Stop();
+}
+
+int RunServer(uint16_t port, bool loopbackOnly, const std::vector<const char*>& scenes, const std::vector<const char*>& textScenes, const char* cacheDirectory)
+{
+	RenderServer server(std::thread::hardware_concurrency());
+	if (cacheDirectory != nullptr)
+		server.SetBoundingSphereCache(cacheDirectory);
+
+	for (size_t i = 0; i < scenes.size(); i += 2)
+	{
+		if (!server.AddScene(scenes[i], scenes[i + 1]))
+		{
+			std::cout << server.GetError() << std::endl;
+			return 1;
+		}
+		std::cout << "serving '" << scenes[i + 1] << "' as " << scenes[i] << std::endl;
+	}
+
+	for (size_t i = 0; i < textScenes.size(); i += 2)
+	{
+		if (!server.AddTextScene(textScenes[i], textScenes[i + 1]))
+		{
+			std::cout << server.GetError() << std::endl;
+			return 1;
+		}
+		std::cout << "serving '" << textScenes[i + 1] << "' as " << textScenes[i] << std::endl;
+	}
+
+	if (server.SceneCount() == 0)
+	{
+		std::cout << "no scenes to serve" << std::endl;
+		return 1;
+	}
+
+	runningServer = &server;
+	std::signal(SIGINT, StopServer);
+	std::signal(SIGTERM, StopServer);
+
+	std::cout << "waiting for jobs on port " << port << std::endl;
+	bool ok = server.Run(port, loopbackOnly);
+	runningServer = nullptr;
+
+	std::cout << "rendered " << server.FinishedJobCount() << " jobs" << std::endl;
+	if (!ok)
+		std::cout << "server stopped: " << server.GetError() << std::endl;
+	return ok ? 0 : 1;
+}
+
+int RunClient(const std::string& host, uint16_t port, std::vector<ClientJob>& jobs)
+{
+	RenderClient client;
+	if (!client.Connect(host.c_str(), port))
+	{
+		std::cout << client.GetError() << std::endl;
+		return 1;
+	}
+
+	for (ClientJob& job : jobs)
+	{
+		if (!client.Submit(job.request))
+		{
+			std::cout << client.GetError() << std::endl;
+			return 1;
+		}
+	}
+
+	// submits are answered in order, updates refer to the job ids handed out
+	size_t answered = 0;
+	size_t remaining = jobs.size();
+	bool ok = true;
+	RenderEvent event;
+	while (remaining > 0)
+	{
+		if (!client.Receive(event))
+		{
+			std::cout << client.GetError() << std::endl;
+			return 1;
+		}
+
+		if (event.type == RenderMessage::Accepted || event.type == RenderMessage::Rejected)
+		{
+			ClientJob& job = jobs[answered++];
+			if (event.type == RenderMessage::Accepted)
+			{
+				job.id = event.accepted.jobId;
+				std::cout << "job " << job.id << " on " << job.request.sceneId << " queued at position " << event.accepted.queueLength << std::endl;
+			}
+			else
+			{
+				std::cout << "job on " << job.request.sceneId << " rejected: " << event.reason << std::endl;
+				job.done = true;
+				remaining--;
+				ok = false;
+			}
+			continue;
+		}
+
+		ClientJob* job = nullptr;
+		for (ClientJob& j : jobs)
+			job = j.id == event.update.jobId && !j.done ? &j : job;
+		if (job == nullptr)
+			continue;
+
+		const RenderJobUpdate& update = event.update;
+		bool finished = event.type == RenderMessage::Finished;
+		float megaRays = float(update.rayCount) / 1e6f;
+		std::cout << "job " << update.jobId << (finished ? " finished, " : ": ") << update.frameIndex << "/" << update.frameCount << " frames in "
+			<< update.milliseconds << " ms, " << megaRays / (update.milliseconds / 1000.0) << " MegaRays/s" << std::endl;
+
+		if (job->imageFilename != nullptr)
+		{
+			ImageWriter writer(std::thread::hardware_concurrency());
+			if (!writer.Save(job->imageFilename, event.image.data(), update.width, update.height))
+				std::cout << "failed to store image '" << job->imageFilename << "'" << std::endl;
+		}
+
+		if (job->hdrFilename != nullptr)
+		{
+			HdrWriter writer(std::thread::hardware_concurrency());
+			if (!writer.Save(job->hdrFilename, event.image.data(), update.width, update.height))
+				std::cout << "failed to store hdr image '" << job->hdrFilename << "'" << std::endl;
+		}
+
+		if (finished)
+		{
+			job->done = true;
+			remaining--;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	int port = -1;
+	bool loopbackOnly = true;
+	std::vector<const char*> scenes;
+	std::vector<const char*> textScenes;
+	const char* cacheDirectory = nullptr;
+	std::string submitHost;
+	int submitPort = -1;
+	std::vector<ClientJob> jobs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		ClientJob* job = jobs.empty() ? nullptr : &jobs.back();
+
+		if (std::strcmp(argv[i], "-port") == 0 && i + 1 < argc && IsPort(argv[i + 1]))
+		{
+			port = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-public") == 0)
+		{
+			loopbackOnly = false;
+		}
+		else if (std::strcmp(argv[i], "-scene") == 0 && i + 2 < argc)
+		{
+			scenes.push_back(argv[++i]);
+			scenes.push_back(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-textscene") == 0 && i + 2 < argc)
+		{
+			textScenes.push_back(argv[++i]);
+			textScenes.push_back(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-bscache") == 0 && i + 1 < argc)
+		{
+			cacheDirectory = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-submit") == 0 && i + 1 < argc && std::strrchr(argv[i + 1], ':') != nullptr && IsPort(std::strrchr(argv[i + 1], ':') + 1))
+		{
+			const char* address = argv[++i];
+			const char* colon = std::strrchr(address, ':');
+			submitHost.assign(address, colon);
+			submitPort = std::stoi(colon + 1);
+		}
+		else if (std::strcmp(argv[i], "-job") == 0 && i + 4 < argc && std::strlen(argv[i + 1]) < RENDER_SCENE_ID_SIZE &&
+			IsUnsignedInt(argv[i + 2]) && IsUnsignedInt(argv[i + 3]) && IsUnsignedInt(argv[i + 4]))
+		{
+			ClientJob newJob;
+			std::strcpy(newJob.request.sceneId, argv[++i]);
+			newJob.request.width = uint32_t(std::stoul(argv[++i]));
+			newJob.request.height = uint32_t(std::stoul(argv[++i]));
+			newJob.request.samplesPerPixel = uint32_t(std::stoul(argv[++i]));
+			newJob.request.samplesPerFrame = 1;
+			newJob.request.useSceneCamera = 1;
+			newJob.request.cameraPosition[1] = 10.f;
+			jobs.push_back(newJob);
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-spf") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			job->request.samplesPerFrame = uint32_t(std::stoul(argv[++i]));
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-bounces") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			job->request.bounces = uint32_t(std::stoul(argv[++i]));
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-priority") == 0 && i + 1 < argc && IsInt(argv[i + 1]))
+		{
+			job->request.priority = std::stoi(argv[++i]);
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-camera") == 0 && i + 5 < argc)
+		{
+			job->request.useSceneCamera = 0;
+			job->request.cameraPosition[0] = std::stof(argv[++i]);
+			job->request.cameraPosition[1] = std::stof(argv[++i]);
+			job->request.cameraPosition[2] = std::stof(argv[++i]);
+			job->request.cameraRotationX = std::stof(argv[++i]);
+			job->request.cameraRotationY = std::stof(argv[++i]);
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-progress") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			job->request.progressFrames = uint32_t(std::stoul(argv[++i]));
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-image") == 0 && i + 1 < argc)
+		{
+			job->imageFilename = argv[++i];
+		}
+		else if (job != nullptr && std::strcmp(argv[i], "-hdr") == 0 && i + 1 < argc)
+		{
+			job->hdrFilename = argv[++i];
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (submitPort >= 0 && !jobs.empty())
+		return RunClient(submitHost, uint16_t(submitPort), jobs);
+
+	if (port >= 0 && submitPort < 0 && jobs.empty())
+		return RunServer(uint16_t(port), loopbackOnly, scenes, textScenes, cacheDirectory);
+
+	PrintUsage();
+	return 1;
+}
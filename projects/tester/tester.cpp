@@ -1,9 +1,66 @@
 #include <iostream>
 #include <string>
+#include <cstring>
 #include <chrono>
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
 #include "raytracer.h"
+#include "scenefile.h"
+#include "textscene.h"
+#include "imagewriter.h"
+#include "hdrwriter.h"
+#include "accumulation.h"
+#include "checkpoint.h"
+#include "renderfarm.h"
+#include "partial.h"
+#include "pixelcost.h"
+#include "timeline.h"
+#include "cpudispatch.h"
+
+void PrintUsage()
+{
+	std::cout << "incorrect arguments, arguments are: width, height, raysPerPixel, numberOfSpheres, maxBounces, imageFile(optional, .png, .qoi or .ppm)" << std::endl;
+	std::cout << "options:" << std::endl;
+	std::cout << "\t-scene <file>\t\tmap a binary scene file instead of generating spheres" << std::endl;
+	std::cout << "\t-savescene <file>\tstore the scene and its bounding spheres as a binary scene file" << std::endl;
+	std::cout << "\t-textscene <file>\tparse a text scene instead of generating spheres" << std::endl;
+	std::cout << "\t-savetextscene <file>\tstore the scene and camera as a text scene" << std::endl;
+	std::cout << "\t-bscache <directory>\treuse bounding spheres built by earlier runs of the same scene" << std::endl;
+	std::cout << "\t-hdr <file>\t\tstore the unclamped result as .exr or .pfm" << std::endl;
+	std::cout << "\t-exrfloat\t\twrite 32 bit float exr channels instead of half" << std::endl;
+	std::cout << "\t-exrtile <size>\t\twrite a tiled exr" << std::endl;
+	std::cout << "\t-exrnozip\t\twrite an uncompressed exr" << std::endl;
+	std::cout << "\t-dumpaccum <file>\tstore the raw accumulation sum and sample count" << std::endl;
+	std::cout << "\t-frames <count>\t\tnumber of frames to accumulate, 1 by default" << std::endl;
+	std::cout << "\t-checkpoint <file>\tperiodically store the progressive render so it can be resumed" << std::endl;
+	std::cout << "\t-checkpointinterval <s>\tseconds between checkpoints, 60 by default" << std::endl;
+	std::cout << "\t-resume\t\t\tcontinue from the checkpoint file if it exists" << std::endl;
+	std::cout << "\t-coordinator <port>\thand out tiles to workers started with the same arguments and -worker" << std::endl;
+	std::cout << "\t-public\t\t\taccept workers from other machines, not only this one" << std::endl;
+	std::cout << "\t-worker <host:port>\trender tiles for a coordinator" << std::endl;
+	std::cout << "\t-tilesize <size>\tedge of the coordinator's tiles, 64 by default" << std::endl;
+	std::cout << "\t-passframes <count>\tframes per handed out tile, 4 by default" << std::endl;
+	std::cout << "\t-tasktimeout <s>\tretry tiles held longer than this by a worker" << std::endl;
+	std::cout << "\t-samples <first> <count>\trender only these sample indices, multiples of raysPerPixel" << std::endl;
+	std::cout << "\t-savepartial <file>\tstore the sample sums for the merge tool" << std::endl;
+	std::cout << "\t-cameras <file>\t\trender every view of a camera path, images are numbered" << std::endl;
+	std::cout << "\t-turntable <count> <x> <z>\trender count views orbiting the camera around a vertical axis" << std::endl;
+	std::cout << "\t-viewsperpass <count>\ttrace this many views of a batch together, 1 by default" << std::endl;
+	std::cout << "\t-heatmap <file>\t\tstore a false color map of the work per pixel, and the raw counters as <file>.cost" << std::endl;
+	std::cout << "\t-heatmapmetric <name>\tsteps, entered, spheres or bounces, spheres by default" << std::endl;
+	std::cout << "\t-perfcounters\t\tread cycles, instructions, cache and branch misses of every render thread, linux only" << std::endl;
+	std::cout << "\t-cpu <level>\t\tuse the scalar, sse4.1, avx2 or avx512 kernels instead of the best the cpu runs" << std::endl;
+	std::cout << "\t-pathstats\t\tprint path lengths, why paths ended and what they hit" << std::endl;
+	std::cout << "\t-timeline <file>\t\tstore what every thread did when as a Chrome trace, for chrome://tracing or Perfetto" << std::endl;
+	std::cout << "\t-warmup <frames>\t\tframes traced and thrown away before measuring" << std::endl;
+	std::cout << "\t-report <file>\t\tstore frame times and ray rates as json" << std::endl;
+	std::cout << "\t-compare <file>\t\texit with 2 if the median frame time regressed against a stored report" << std::endl;
+	std::cout << "\t-tolerance <percent>\tallowed regression for -compare, 5 by default" << std::endl;
+}
 
 bool IsDigit(char c)
 {
@@ -20,38 +77,19 @@ bool IsUnsignedInt(const char* str)
 	return true;
 }
 
-float Clamp01(float v)
+// 1 to 65535, checked before conversion so no value wraps or throws
+bool IsPort(const char* str)
 {
-	return (v < 0.f ? 0.f : (v > 1.f ? 1.f : v));
+	size_t length = std::strlen(str);
+	return length > 0 && length <= 5 && IsUnsignedInt(str) && std::atoi(str) >= 1 && std::atoi(str) <= 65535;
 }
 
-void SaveDataToPNG(const char* filename, size_t width, size_t height, float* colorData)
+// the whole string has to be a number, unlike std::stof this never throws
+bool ParseFloat(const char* str, float& value)
 {
-	size_t numberOfChannels = 3;// rgb
-	char* imageData = new char[width * height * numberOfChannels];
-
-	// read colorData and map to char values in range 0-255
-	// the colorData starts in the bottom left corner and is in column major order but
-	// the imageData needs to start in the top left corner and be in row major order
-	int index = 0;
-	for (int y = int(height) - 1; y >= 0; y--)
-	{
-		for (int x = 0; x < int(width); x++)
-		{
-			size_t colorIndex = (y * width + x) * numberOfChannels;
-			float r = Clamp01(colorData[colorIndex]);
-			float g = Clamp01(colorData[colorIndex + 1]);
-			float b = Clamp01(colorData[colorIndex + 2]);
-
-			imageData[index++] = (char)(255.99f * r);
-			imageData[index++] = (char)(255.99f * g);
-			imageData[index++] = (char)(255.99f * b);
-		}
-	}
-
-	stbi_write_png(filename, int(width), int(height), int(numberOfChannels), imageData, int(width * numberOfChannels));
-
-	delete[] imageData;
+	char* end = nullptr;
+	value = std::strtof(str, &end);
+	return end != str && *end == '\0' && std::isfinite(value);
 }
 
 struct Timer
@@ -65,12 +103,12 @@ public:
 
 	void Start()
 	{
-		startTime = std::chrono::high_resolution_clock::now();
+		startTime = std::chrono::steady_clock::now();
 	}
 
 	void Stop()
 	{
-		endTime = std::chrono::high_resolution_clock::now();
+		endTime = std::chrono::steady_clock::now();
 	}
 
 	float GetMillisecondDuration()
@@ -80,44 +118,402 @@ public:
 	}
 };
 
-int main(int argc, char* argv[])
+// per frame measurements of the render loop
+struct FrameStatistics
 {
-	// verify arguments
-	if (argc < 5 || 
-		!IsUnsignedInt(argv[1]) || 
-		!IsUnsignedInt(argv[2]) ||
-		!IsUnsignedInt(argv[3]) ||
-		!IsUnsignedInt(argv[4]) ||
-		!IsUnsignedInt(argv[5]))
+	std::vector<float> milliseconds;
+	std::vector<size_t> rays;
+	// rays traced by each render thread over all measured frames
+	std::vector<size_t> threadRays;
+
+	float median = 0.f;
+	float p95 = 0.f;
+	float mean = 0.f;
+	float stddev = 0.f;
+	float minimum = 0.f;
+	float maximum = 0.f;
+	double megaRaysPerSecond = 0.0;
+	// rates of single threads, they differ when work is split unevenly
+	double threadMinimum = 0.0;
+	double threadMean = 0.0;
+	double threadMaximum = 0.0;
+};
+
+void ComputeStatistics(FrameStatistics& stats)
+{
+	std::vector<float> sorted = stats.milliseconds;
+	std::sort(sorted.begin(), sorted.end());
+	size_t n = sorted.size();
+	if (n == 0)
+		return;
+
+	stats.median = n % 2 == 1 ? sorted[n / 2] : 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+	// nearest rank
+	stats.p95 = sorted[std::min(n - 1, size_t(std::ceil(0.95 * n)) - 1)];
+	stats.minimum = sorted.front();
+	stats.maximum = sorted.back();
+
+	double total = 0.0;
+	for (float ms : sorted)
+		total += ms;
+	stats.mean = float(total / n);
+	double variance = 0.0;
+	for (float ms : sorted)
+		variance += (ms - stats.mean) * (ms - stats.mean);
+	stats.stddev = n > 1 ? float(std::sqrt(variance / (n - 1))) : 0.f;
+
+	size_t rays = 0;
+	for (size_t count : stats.rays)
+		rays += count;
+	double seconds = total / 1000.0;
+	stats.megaRaysPerSecond = rays / 1e6 / seconds;
+
+	stats.threadMinimum = 1e30;
+	stats.threadMaximum = 0.0;
+	stats.threadMean = 0.0;
+	for (size_t count : stats.threadRays)
 	{
-		std::cout << "incorrect arguments, arguments are: width, height, raysPerPixel, numberOfSpheres, maxBounces, imageFile(optional)" << std::endl;
-		return 1;
+		double rate = count / 1e6 / seconds;
+		stats.threadMinimum = std::min(stats.threadMinimum, rate);
+		stats.threadMaximum = std::max(stats.threadMaximum, rate);
+		stats.threadMean += rate / stats.threadRays.size();
 	}
+}
 
-	// parse arguments
-	size_t width = (size_t)std::stoi(argv[1]);
-	size_t height = (size_t)std::stoi(argv[2]);
-	int raysPerPixel = std::stoi(argv[3]);
-	int numberOfSpheres = std::stoi(argv[4]);
-	int maxBounces = std::stoi(argv[5]);
-	const char* imageFilename = (argc == 7 ? argv[6] : nullptr);
+// settings that have to match for two reports to be comparable
+std::string ReportConfiguration(size_t width, size_t height, int raysPerPixel, int numberOfSpheres, int maxBounces, size_t threadCount, const char* scene)
+{
+	return std::to_string(width) + "x" + std::to_string(height) + " rpp " + std::to_string(raysPerPixel) + " spheres " + std::to_string(numberOfSpheres) +
+		" bounces " + std::to_string(maxBounces) + " threads " + std::to_string(threadCount) + " cpu " + GetCpuLevelName(GetCpuKernels().level) + " scene " + (scene != nullptr ? scene : "generated");
+}
 
-	// setup-code for raytracer
-	std::vector<Color> framebuffer;
-	framebuffer.resize(width * height);
+// text as the inside of a JSON string, scene paths can hold backslashes and quotes
+std::string EscapeJson(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", unsigned(c));
+			escaped += code;
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
 
-	std::vector<Color> framebufferCopy;
-	framebufferCopy.resize(width * height);
+bool WriteReport(const char* filename, const std::string& configuration, int warmupFrames, const FrameStatistics& stats)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
 
-	Raytracer rt = Raytracer(width, height, framebuffer, framebufferCopy, raysPerPixel, maxBounces, numberOfSpheres);
-	MemoryPool<Material> materials(numberOfSpheres);
+	fprintf(file, "{\n\t\"configuration\": \"%s\",\n\t\"warmup_frames\": %d,\n\t\"frames\": %zu,\n", EscapeJson(configuration).c_str(), warmupFrames, stats.milliseconds.size());
+	fprintf(file, "\t\"median_ms\": %.4f,\n\t\"p95_ms\": %.4f,\n\t\"mean_ms\": %.4f,\n\t\"stddev_ms\": %.4f,\n\t\"min_ms\": %.4f,\n\t\"max_ms\": %.4f,\n",
+		stats.median, stats.p95, stats.mean, stats.stddev, stats.minimum, stats.maximum);
+	fprintf(file, "\t\"megarays_per_second\": %.4f,\n\t\"thread_megarays_per_second\": { \"min\": %.4f, \"mean\": %.4f, \"max\": %.4f },\n",
+		stats.megaRaysPerSecond, stats.threadMinimum, stats.threadMean, stats.threadMaximum);
+
+	fprintf(file, "\t\"frame_ms\": [");
+	for (size_t i = 0; i < stats.milliseconds.size(); i++)
+		fprintf(file, "%s%.4f", i == 0 ? "" : ", ", stats.milliseconds[i]);
+	fprintf(file, "],\n\t\"frame_rays\": [");
+	for (size_t i = 0; i < stats.rays.size(); i++)
+		fprintf(file, "%s%zu", i == 0 ? "" : ", ", stats.rays[i]);
+	fprintf(file, "]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+// value of a top level number or string in a report written by WriteReport
+bool ReadReportValue(const std::string& report, const char* key, std::string& value)
+{
+	std::string pattern = std::string("\"") + key + "\": ";
+	size_t start = report.find(pattern);
+	if (start == std::string::npos)
+		return false;
+
+	start += pattern.size();
+	if (report[start] == '"')
+	{
+		// undoes EscapeJson, other escapes aren't written
+		value.clear();
+		for (size_t i = start + 1; i < report.size() && report[i] != '"'; i++)
+		{
+			if (report[i] == '\\' && i + 1 < report.size() && report[i + 1] == 'u')
+			{
+				value += char(strtol(report.substr(i + 2, 4).c_str(), nullptr, 16));
+				i += 5;
+			}
+			else
+			{
+				if (report[i] == '\\')
+					i++;
+				if (i < report.size())
+					value += report[i];
+			}
+		}
+	}
+	else
+	{
+		size_t end = report.find_first_of(",\n}", start);
+		value = report.substr(start, end - start);
+	}
+	return true;
+}
+
+// false if the median frame time is more than tolerance percent above the baseline's
+bool CompareReport(const char* filename, const std::string& configuration, const FrameStatistics& stats, float tolerance)
+{
+	std::string report;
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+	{
+		std::cout << "failed to open baseline '" << filename << "'" << std::endl;
+		return false;
+	}
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		report.append(buffer, read);
+	fclose(file);
+
+	std::string baselineConfiguration;
+	std::string median;
+	std::string megaRays;
+	if (!ReadReportValue(report, "median_ms", median) || !ReadReportValue(report, "megarays_per_second", megaRays))
+	{
+		std::cout << "'" << filename << "' is not a tester report" << std::endl;
+		return false;
+	}
+
+	// a truncated or edited baseline can hold anything, and the median is divided by
+	float baselineMedian;
+	float baselineMegaRays;
+	if (!ParseFloat(median.c_str(), baselineMedian) || !ParseFloat(megaRays.c_str(), baselineMegaRays) || baselineMedian <= 0.f)
+	{
+		std::cout << "bad baseline '" << filename << "', median_ms and megarays_per_second have to be numbers" << std::endl;
+		return false;
+	}
+	if (ReadReportValue(report, "configuration", baselineConfiguration) && baselineConfiguration != configuration)
+		std::cout << "warning: the baseline was measured with " << baselineConfiguration << std::endl;
+
+	float change = 100.f * (stats.median - baselineMedian) / baselineMedian;
+	bool regressed = change > tolerance;
+	std::cout << "compared to '" << filename << "':" << std::endl;
+	std::cout << "\tmedian frame time: " << baselineMedian << " ms -> " << stats.median << " ms (" << (change >= 0.f ? "+" : "") << change << "%)" << std::endl;
+	std::cout << "\tMegaRays/s: " << baselineMegaRays << " -> " << stats.megaRaysPerSecond << std::endl;
+	std::cout << "\t" << (regressed ? "REGRESSION, more than " : "ok, within ") << tolerance << "% of the baseline" << std::endl;
+	return !regressed;
+}
+
+// counts of one frame or thread, with IPC and events per traced ray
+void PrintPerfCounters(const char* label, const PerfCounterValues& values, size_t rays)
+{
+	if (!values.Has(PerfCounter::Cycles) && !values.Has(PerfCounter::Instructions))
+		return;
+
+	std::cout << label << ":";
+	if (values.Has(PerfCounter::Cycles) && values.Has(PerfCounter::Instructions) && values[PerfCounter::Cycles] > 0)
+		std::cout << " IPC " << double(values[PerfCounter::Instructions]) / double(values[PerfCounter::Cycles]) << ",";
+
+	double perRay = 1.0 / double(std::max<size_t>(rays, 1));
+	for (int i = 0; i < int(PerfCounter::Count); i++)
+	{
+		PerfCounter counter = PerfCounter(i);
+		if (values.Has(counter))
+			std::cout << " " << values[counter] * perRay << " " << PerfCounters::GetName(counter) << "/ray";
+		else
+			std::cout << " no " << PerfCounters::GetName(counter);
+		std::cout << (i + 1 < int(PerfCounter::Count) ? "," : "");
+	}
+	std::cout << std::endl;
+}
+
+void PrintPathStatistics(const PathStatistics& stats)
+{
+	double toPercent = 100.0 / double(std::max<uint64_t>(stats.paths, 1));
+	uint64_t rays = 0;
+	for (int i = 0; i <= PATH_STATS_MAX_DEPTH; i++)
+		rays += stats.depth[i] * i;
+
+	std::cout << "path statistics over " << stats.paths << " paths, " << double(rays) / std::max<uint64_t>(stats.paths, 1) << " rays per path:" << std::endl;
+	std::cout << "\tended by sky miss: " << stats.ends[int(PathEnd::SkyMiss)] * toPercent << "%, bounce limit: " << stats.ends[int(PathEnd::BounceLimit)] * toPercent << "%" << std::endl;
+	std::cout << "\tpath length:" << std::endl;
+	for (int i = 0; i <= PATH_STATS_MAX_DEPTH; i++)
+	{
+		if (stats.depth[i] == 0)
+			continue;
+		double percent = stats.depth[i] * toPercent;
+		std::cout << "\t\t" << (i == PATH_STATS_MAX_DEPTH ? ">=" : "") << i << " rays: " << percent << "%\t" << std::string(size_t(percent / 2.0), '#') << std::endl;
+	}
+
+	uint64_t hits = stats.materialHits[0] + stats.materialHits[1] + stats.materialHits[2];
+	double hitPercent = 100.0 / double(std::max<uint64_t>(hits, 1));
+	std::cout << "\thits: " << hits << ", lambertian " << stats.materialHits[int(MaterialType::Lambertian)] * hitPercent
+		<< "%, dielectric " << stats.materialHits[int(MaterialType::Dielectric)] * hitPercent
+		<< "%, conductor " << stats.materialHits[int(MaterialType::Conductor)] * hitPercent << "%" << std::endl;
+	std::cout << "\ttotal internal reflections: " << stats.totalInternalReflections << " ("
+		<< 100.0 * stats.totalInternalReflections / std::max<uint64_t>(stats.materialHits[int(MaterialType::Conductor)], 1) << "% of refracting hits)" << std::endl;
+}
 
-	// create some spheres
+void SaveTimeline(const char* filename)
+{
+	if (filename == nullptr)
+		return;
+
+	Timeline::Enable(false);
+	std::cout << "storing timeline to '" << filename << "'" << std::endl;
+	if (!Timeline::Save(filename))
+		std::cout << "failed to store timeline" << std::endl;
+}
+
+// insert a frame number in front of the extension, out.png becomes out_0007.png
+std::string NumberedFilename(const char* filename, size_t number)
+{
+	std::string name = filename;
+	size_t dot = name.find_last_of('.');
+	size_t slash = name.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		dot = name.size();
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "_%04zu", number);
+	return name.substr(0, dot) + suffix + name.substr(dot);
+}
+
+// views orbiting the start view around a vertical axis, the camera keeps its distance, height and relative orientation
+std::vector<mat4> TurntableViews(const mat4& start, size_t count, float centerX, float centerZ)
+{
+	std::vector<mat4> views;
+	vec3 center(centerX, 0.f, centerZ);
+	vec3 offset = get_position(start) - center;
+	for (size_t i = 0; i < count; i++)
+	{
+		mat4 rotation = rotationy(360.f * float(i) / float(count));
+		mat4 view = multiply(rotation, start);
+		vec3 position = transform(offset, rotation) + center;
+		view.m30 = position.x;
+		view.m31 = position.y;
+		view.m32 = position.z;
+		views.push_back(view);
+	}
+	return views;
+}
+
+// trace every view with the same Raytracer, viewsPerPass views together, storing pass N on a background thread while N+1 is traced
+void RenderBatch(Raytracer& rt, const std::vector<mat4>& views, size_t viewsPerPass, int numberOfFrames, const char* imageFilename, const char* hdrFilename, const ExrOptions& exrOptions)
+{
+	size_t pixelCount = rt.width * rt.height;
+	viewsPerPass = std::min(std::max(viewsPerPass, size_t(1)), views.size());
+
+	// buffers being traced and buffers being stored, swapped every pass
+	std::vector<std::vector<Color>> sums(viewsPerPass, std::vector<Color>(pixelCount));
+	std::vector<std::vector<Color>> images(viewsPerPass, std::vector<Color>(pixelCount));
+	std::vector<std::vector<Color>> storedSums(viewsPerPass, std::vector<Color>(pixelCount));
+	std::vector<std::vector<Color>> storedImages(viewsPerPass, std::vector<Color>(pixelCount));
+	std::vector<RaytraceView> pass(viewsPerPass);
+
+	std::thread encoder;
+	float encodeMilliseconds = 0.f;
+	float traceMilliseconds = 0.f;
+	size_t rayCount = 0;
+
+	Timer batchTimer;
+	batchTimer.Start();
+	for (size_t first = 0; first < views.size(); first += viewsPerPass)
+	{
+		size_t count = std::min(viewsPerPass, views.size() - first);
+		for (size_t i = 0; i < count; i++)
+		{
+			std::fill(sums[i].begin(), sums[i].end(), Color());
+			pass[i].view = views[first + i];
+			pass[i].frameBuffer = sums[i].data();
+			pass[i].frameBufferCopy = images[i].data();
+			pass[i].frameIndex = 0;
+		}
+
+		Timer traceTimer;
+		traceTimer.Start();
+		for (int frame = 0; frame < numberOfFrames; frame++)
+		{
+			rt.RaytraceViews(pass.data(), count);
+			for (size_t rays : rt.rayCounters)
+				rayCount += rays;
+		}
+		traceTimer.Stop();
+		traceMilliseconds += traceTimer.GetMillisecondDuration();
+		std::cout << "views " << first + 1 << "-" << first + count << "/" << views.size() << " traced in " << traceTimer.GetMillisecondDuration() << " ms" << std::endl;
+
+		// the previous pass has to be stored before its buffers are reused
+		if (encoder.joinable())
+			encoder.join();
+
+		if (imageFilename == nullptr && hdrFilename == nullptr)
+			continue;
+
+		std::swap(sums, storedSums);
+		std::swap(images, storedImages);
+
+		// a single encoding thread with writers of its own, the render threads keep the cores
+		float scale = 1.f / numberOfFrames;
+		encoder = std::thread([&, first, count, scale]()
+		{
+			Timeline::SetThreadName("encoder");
+			Timer encodeTimer;
+			encodeTimer.Start();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (imageFilename != nullptr)
+				{
+					std::string filename = NumberedFilename(imageFilename, first + i);
+					ImageWriter writer(1);
+					if (!writer.Save(filename.c_str(), storedImages[i].data(), rt.width, rt.height))
+						std::cout << "failed to store image '" << filename << "'" << std::endl;
+				}
+				if (hdrFilename != nullptr)
+				{
+					std::string filename = NumberedFilename(hdrFilename, first + i);
+					HdrWriter writer(1);
+					if (!writer.Save(filename.c_str(), storedSums[i].data(), rt.width, rt.height, scale, HdrFormatFromFilename(hdrFilename), exrOptions))
+						std::cout << "failed to store hdr image '" << filename << "'" << std::endl;
+				}
+			}
+			encodeTimer.Stop();
+			encodeMilliseconds += encodeTimer.GetMillisecondDuration();
+		});
+	}
+
+	if (encoder.joinable())
+		encoder.join();
+	batchTimer.Stop();
+
+	float total = batchTimer.GetMillisecondDuration();
+	std::cout << "batch completed:" << std::endl;
+	std::cout << "\tviews: " << views.size() << ", " << viewsPerPass << " per pass, " << numberOfFrames << " frames each" << std::endl;
+	std::cout << "\ttotal time: " << total << " ms, " << total / views.size() << " ms per view" << std::endl;
+	std::cout << "\ttracing: " << traceMilliseconds << " ms, storing: " << encodeMilliseconds << " ms, "
+		<< std::max(traceMilliseconds + encodeMilliseconds - total, 0.f) << " ms of it overlapped" << std::endl;
+	std::cout << "\taverage MegaRays/s: " << (float(rayCount) / 1000000.f) / (traceMilliseconds / 1000.f) << std::endl;
+}
+
+void CreateTestScene(Raytracer& rt, int numberOfSpheres)
+{
 	uint32_t seed = 1337420;
 
 	// floor
 	{
-		Material* mat = materials.GetNew();
+		Material* mat = rt.GetNewMaterial();
 		mat->type = MaterialType::Lambertian;
 		float r = RandomFloat(++seed);
 		float g = RandomFloat(++seed);
@@ -136,7 +532,7 @@ int main(int argc, char* argv[])
 
 	for (int i = 0; i < numberOfSpheres-1; i++)
 	{
-		Material* mat = materials.GetNew();
+		Material* mat = rt.GetNewMaterial();
 		switch (matType++)
 		{
 		case 0:
@@ -169,54 +565,695 @@ int main(int argc, char* argv[])
 
 		*rt.GetNewSphere() = Sphere(radius, pos, mat);
 	}
+}
 
-	rt.CreateBoundingSpheres();
-	std::cout << "number of bounding spheres: " << rt.boundingSpheres.Count() << std::endl;
+int main(int argc, char* argv[])
+{
+	// verify arguments
+	if (argc < 6 || 
+		!IsUnsignedInt(argv[1]) || 
+		!IsUnsignedInt(argv[2]) ||
+		!IsUnsignedInt(argv[3]) ||
+		!IsUnsignedInt(argv[4]) ||
+		!IsUnsignedInt(argv[5]))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// parse arguments
+	size_t width = (size_t)std::stoi(argv[1]);
+	size_t height = (size_t)std::stoi(argv[2]);
+	int raysPerPixel = std::stoi(argv[3]);
+	int numberOfSpheres = std::stoi(argv[4]);
+	int maxBounces = std::stoi(argv[5]);
+
+	// optional arguments
+	const char* imageFilename = nullptr;
+	const char* sceneFilename = nullptr;
+	const char* saveSceneFilename = nullptr;
+	const char* cacheDirectory = nullptr;
+	const char* textSceneFilename = nullptr;
+	const char* saveTextSceneFilename = nullptr;
+	const char* hdrFilename = nullptr;
+	const char* accumulationFilename = nullptr;
+	ExrOptions exrOptions;
+	int numberOfFrames = 1;
+	const char* checkpointFilename = nullptr;
+	float checkpointInterval = 60.f;
+	bool resume = false;
+	int coordinatorPort = -1;
+	bool loopbackOnly = true;
+	std::string workerHost;
+	int workerPort = -1;
+	size_t tileSize = 64;
+	int passFrames = 4;
+	float taskTimeout = 0.f;
+	int firstSample = -1;
+	int sampleCount = 0;
+	const char* partialFilename = nullptr;
+	const char* camerasFilename = nullptr;
+	size_t turntableCount = 0;
+	float turntableX = 0.f;
+	float turntableZ = 0.f;
+	size_t viewsPerPass = 1;
+	int warmupFrames = 0;
+	const char* heatmapFilename = nullptr;
+	const char* timelineFilename = nullptr;
+	bool usePerfCounters = false;
+	bool usePathStatistics = false;
+	CpuLevel cpuLevel = DetectCpuLevel();
+	CostMetric heatmapMetric = CostMetric::SpheresTested;
+	const char* reportFilename = nullptr;
+	const char* compareFilename = nullptr;
+	float tolerance = 5.f;
+
+	for (int i = 6; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+		{
+			sceneFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-savescene") == 0 && i + 1 < argc)
+		{
+			saveSceneFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-textscene") == 0 && i + 1 < argc)
+		{
+			textSceneFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-savetextscene") == 0 && i + 1 < argc)
+		{
+			saveTextSceneFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-bscache") == 0 && i + 1 < argc)
+		{
+			cacheDirectory = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-hdr") == 0 && i + 1 < argc)
+		{
+			hdrFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-exrfloat") == 0)
+		{
+			exrOptions.halfFloat = false;
+		}
+		else if (std::strcmp(argv[i], "-exrtile") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+		{
+			exrOptions.tileSize = (size_t)std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-exrnozip") == 0)
+		{
+			exrOptions.compress = false;
+		}
+		else if (std::strcmp(argv[i], "-dumpaccum") == 0 && i + 1 < argc)
+		{
+			accumulationFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-frames") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+		{
+			numberOfFrames = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc)
+		{
+			checkpointFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-checkpointinterval") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			checkpointInterval = float(std::stoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "-resume") == 0)
+		{
+			resume = true;
+		}
+		else if (std::strcmp(argv[i], "-coordinator") == 0 && i + 1 < argc && IsPort(argv[i + 1]))
+		{
+			coordinatorPort = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-public") == 0)
+		{
+			loopbackOnly = false;
+		}
+		else if (std::strcmp(argv[i], "-worker") == 0 && i + 1 < argc && std::strrchr(argv[i + 1], ':') != nullptr && IsPort(std::strrchr(argv[i + 1], ':') + 1))
+		{
+			const char* address = argv[++i];
+			const char* colon = std::strrchr(address, ':');
+			workerHost.assign(address, colon);
+			workerPort = std::stoi(colon + 1);
+		}
+		else if (std::strcmp(argv[i], "-tilesize") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+		{
+			tileSize = (size_t)std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-passframes") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+		{
+			passFrames = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-tasktimeout") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			taskTimeout = float(std::stoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "-samples") == 0 && i + 2 < argc && IsUnsignedInt(argv[i + 1]) && IsUnsignedInt(argv[i + 2]))
+		{
+			firstSample = std::stoi(argv[++i]);
+			sampleCount = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-savepartial") == 0 && i + 1 < argc)
+		{
+			partialFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-cameras") == 0 && i + 1 < argc)
+		{
+			camerasFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-turntable") == 0 && i + 3 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0 &&
+			ParseFloat(argv[i + 2], turntableX) && ParseFloat(argv[i + 3], turntableZ))
+		{
+			turntableCount = (size_t)std::stoi(argv[++i]);
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-viewsperpass") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]) && std::stoi(argv[i + 1]) > 0)
+		{
+			viewsPerPass = (size_t)std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-cpu") == 0 && i + 1 < argc && CpuLevelFromName(argv[i + 1], cpuLevel))
+		{
+			i++;
+		}
+		else if (std::strcmp(argv[i], "-pathstats") == 0)
+		{
+			usePathStatistics = true;
+		}
+		else if (std::strcmp(argv[i], "-perfcounters") == 0)
+		{
+			usePerfCounters = true;
+		}
+		else if (std::strcmp(argv[i], "-timeline") == 0 && i + 1 < argc)
+		{
+			timelineFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-heatmap") == 0 && i + 1 < argc)
+		{
+			heatmapFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-heatmapmetric") == 0 && i + 1 < argc && CostMetricFromName(argv[i + 1], heatmapMetric))
+		{
+			i++;
+		}
+		else if (std::strcmp(argv[i], "-warmup") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			warmupFrames = std::stoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "-report") == 0 && i + 1 < argc)
+		{
+			reportFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-compare") == 0 && i + 1 < argc)
+		{
+			compareFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc && IsUnsignedInt(argv[i + 1]))
+		{
+			tolerance = float(std::stoi(argv[++i]));
+		}
+		else if (argv[i][0] != '-' && imageFilename == nullptr)
+		{
+			imageFilename = argv[i];
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	// sample slices are made of whole frames
+	if (firstSample >= 0 && (sampleCount == 0 || firstSample % raysPerPixel != 0 || sampleCount % raysPerPixel != 0))
+	{
+		std::cout << "the sample range has to be a non empty multiple of raysPerPixel" << std::endl;
+		return 1;
+	}
+
+	// the fixed point sums of a partial would overflow beyond this
+	int partialFrames = firstSample >= 0 ? sampleCount / raysPerPixel : numberOfFrames;
+	if ((firstSample >= 0 || partialFilename != nullptr) && partialFrames > PARTIAL_MAX_FRAMES)
+	{
+		std::cout << "a sample slice holds at most " << PARTIAL_MAX_FRAMES << " frames" << std::endl;
+		return 1;
+	}
+
+	// a batch renders whole views, it can't be split or resumed
+	bool batch = camerasFilename != nullptr || turntableCount > 0;
+	if (batch && (firstSample >= 0 || partialFilename != nullptr || checkpointFilename != nullptr || coordinatorPort >= 0 || workerPort >= 0 || accumulationFilename != nullptr))
+	{
+		std::cout << "camera paths and turntables can't be combined with sample slices, checkpoints, distributed or accumulation dumps" << std::endl;
+		return 1;
+	}
+
+	// costs, counters and statistics are gathered by the Raytracer's own frames only
+	if ((heatmapFilename != nullptr || usePerfCounters || usePathStatistics) && (batch || firstSample >= 0 || partialFilename != nullptr || coordinatorPort >= 0 || workerPort >= 0))
+	{
+		std::cout << "heatmaps, performance counters and path statistics can't be combined with camera paths, turntables, sample slices or distributed rendering" << std::endl;
+		return 1;
+	}
+
+	if (!SetCpuLevel(cpuLevel))
+	{
+		std::cout << "this cpu can't run the " << GetCpuLevelName(cpuLevel) << " kernels, it supports up to " << GetCpuLevelName(DetectCpuLevel()) << std::endl;
+		return 1;
+	}
+	std::cout << "using " << GetCpuLevelName(cpuLevel) << " kernels" << std::endl;
+
+	std::vector<mat4> views;
+	if (camerasFilename != nullptr)
+	{
+		std::string error;
+		if (!LoadCameraPath(camerasFilename, views, error))
+		{
+			std::cout << "failed to load camera path: " << error << std::endl;
+			return 1;
+		}
+	}
+
+	// recorded from scene setup to the last file written
+	if (timelineFilename != nullptr)
+	{
+		Timeline::Enable(true);
+		Timeline::SetThreadName("main");
+	}
+
+	// map a prebuilt scene instead of generating one
+	SceneFile sceneFile;
+	if (sceneFilename != nullptr)
+	{
+		Timer loadTimer;
+		loadTimer.Start();
+		if (!sceneFile.Open(sceneFilename))
+		{
+			std::cout << "failed to open scene file '" << sceneFilename << "'" << std::endl;
+			return 1;
+		}
+		loadTimer.Stop();
+
+		std::cout << "mapped scene '" << sceneFilename << "' with " << sceneFile.GetView().sphereCount << " spheres in " << loadTimer.GetMillisecondDuration() << " ms" << std::endl;
+
+		// the pools are only needed if the bounding spheres have to be built
+		numberOfSpheres = sceneFile.HasBoundingSpheres() ? 0 : int(sceneFile.GetView().sphereCount);
+	}
+
+	// count the records of a text scene so the pools can be sized before parsing
+	TextSceneLoader textScene(std::thread::hardware_concurrency());
+	bool useTextScene = textSceneFilename != nullptr && !sceneFile.IsOpen();
+	if (useTextScene)
+	{
+		if (!textScene.Open(textSceneFilename))
+		{
+			std::cout << "failed to open text scene: " << textScene.GetError() << std::endl;
+			return 1;
+		}
+
+		numberOfSpheres = int(std::max(textScene.SphereCount(), textScene.MaterialCount()));
+	}
+
+	SceneCamera camera;
+	camera.position = { 0.f, 10.0f, 0.f };
+
+	// setup-code for raytracer
+	std::vector<Color> framebuffer;
+	framebuffer.resize(width * height);
+
+	std::vector<Color> framebufferCopy;
+	framebufferCopy.resize(width * height);
+
+	Raytracer rt = Raytracer(width, height, framebuffer, framebufferCopy, raysPerPixel, maxBounces, numberOfSpheres);
+
+	if (cacheDirectory != nullptr)
+		rt.SetBoundingSphereCache(cacheDirectory);
+
+	std::vector<PerfCounters> perfCounters(usePerfCounters ? rt.rayCounters.size() : 0);
+	std::vector<PerfCounterValues> threadPerfTotals(perfCounters.size());
+	std::vector<size_t> threadRayTotals(perfCounters.size());
+	if (usePerfCounters)
+		rt.perfCounters = perfCounters.data();
+
+	std::vector<PathStatistics> pathStatistics(usePathStatistics ? rt.rayCounters.size() : 0);
+	if (usePathStatistics)
+		rt.pathStatistics = pathStatistics.data();
+
+	std::vector<PixelCost> costs;
+	if (heatmapFilename != nullptr)
+	{
+		costs.resize(width * height);
+		rt.costBuffer = costs.data();
+	}
+
+	if (useTextScene)
+	{
+		Timer parseTimer;
+		parseTimer.Start();
+		if (!textScene.Load(rt.spheres, rt.materials))
+		{
+			std::cout << "failed to parse text scene: " << textScene.GetError() << std::endl;
+			return 1;
+		}
+		parseTimer.Stop();
+
+		float seconds = parseTimer.GetMillisecondDuration() / 1000.f;
+		std::cout << "parsed " << textScene.SphereCount() << " spheres and " << textScene.MaterialCount() << " materials in " << seconds * 1000.f << " ms ("
+			<< (textScene.FileSize() / (1024.f * 1024.f)) / seconds << " MB/s)" << std::endl;
+
+		if (textScene.HasCamera())
+			camera = textScene.GetCamera();
+		textScene.Close();
+	}
+	else if (!sceneFile.IsOpen())
+	{
+		CreateTestScene(rt, numberOfSpheres);
+	}
+
+	if (saveTextSceneFilename != nullptr && !sceneFile.IsOpen())
+	{
+		std::cout << "storing text scene to '" << saveTextSceneFilename << "'" << std::endl;
+		if (!SaveTextScene(saveTextSceneFilename, rt.spheres, rt.materials, &camera))
+			std::cout << "failed to store text scene" << std::endl;
+	}
+
+	Timer buildTimer;
+	buildTimer.Start();
+	if (sceneFile.IsOpen())
+	{
+		rt.SetScene(sceneFile.GetView());
+	}
+	else if (!rt.CreateBoundingSpheres())
+	{
+		std::cout << "a sphere has no material or the material table is full" << std::endl;
+		return 1;
+	}
+	buildTimer.Stop();
+
+	std::cout << "number of bounding spheres: " << rt.scene.boundingSphereCount << " (" << buildTimer.GetMillisecondDuration() << " ms)" << std::endl;
+
+	if (saveSceneFilename != nullptr)
+	{
+		std::cout << "storing scene to '" << saveSceneFilename << "'" << std::endl;
+		if (!SceneFile::Save(saveSceneFilename, rt.scene))
+			std::cout << "failed to store scene" << std::endl;
+	}
 	
-	vec3 camPos = { 0.f, 10.0f, 0.f };
-	float rotx = 0.f;
-	float roty = 0.f;
+	rt.SetViewMatrix(SceneCameraMatrix(camera));
 
-	mat4 xMat = rotationx(rotx);
-	mat4 yMat = rotationy(roty);
-	mat4 cameraTransform = multiply(yMat, xMat);
+	// one scene build for every view of the batch
+	if (batch)
+	{
+		if (turntableCount > 0)
+			views = TurntableViews(rt.view, turntableCount, turntableX, turntableZ);
 
-	cameraTransform.m30 = camPos.x;
-	cameraTransform.m31 = camPos.y;
-	cameraTransform.m32 = camPos.z;
+		std::cout << "rendering " << views.size() << " views" << std::endl;
+		RenderBatch(rt, views, viewsPerPass, numberOfFrames, imageFilename, hdrFilename, exrOptions);
+		SaveTimeline(timelineFilename);
+		return 0;
+	}
 
-	rt.SetViewMatrix(cameraTransform);
+	// continue an interrupted render
+	if (resume && checkpointFilename != nullptr)
+	{
+		CheckpointHeader header;
+		std::vector<Color> sum;
+		if (!LoadCheckpoint(checkpointFilename, header, sum))
+		{
+			std::cout << "no checkpoint to resume from in '" << checkpointFilename << "', starting over" << std::endl;
+		}
+		else if (!CheckpointMatches(header, rt))
+		{
+			std::cout << "checkpoint '" << checkpointFilename << "' was taken from a different render" << std::endl;
+			return 1;
+		}
+		else
+		{
+			rt.Resume(sum.data(), int(header.frameIndex));
+			std::cout << "resumed from frame " << header.frameIndex << std::endl;
+		}
+	}
+
+	// render tiles for a coordinator instead of a frame of our own
+	if (workerPort >= 0)
+	{
+		std::cout << "rendering tiles for " << workerHost << ":" << workerPort << std::endl;
+		FarmWorker worker(rt);
+		bool ok = worker.Run(workerHost.c_str(), uint16_t(workerPort));
+		std::cout << "rendered " << worker.TaskCount() << " tiles" << std::endl;
+		if (!ok)
+			std::cout << "worker stopped: " << worker.GetError() << std::endl;
+		return ok ? 0 : 1;
+	}
+
+	// warm caches, page in the scene and let the clock settle, the image starts over afterwards
+	if (warmupFrames > 0 && rt.frameIndex == 0)
+	{
+		std::cout << "warming up for " << warmupFrames << " frames..." << std::endl;
+		for (int i = 0; i < warmupFrames; i++)
+			rt.Raytrace();
+		rt.Clear();
+	}
+	else if (warmupFrames > 0)
+	{
+		std::cout << "skipping warmup, the render is resumed" << std::endl;
+		warmupFrames = 0;
+	}
 
 	std::cout << "starting performance test..." << std::endl;
+	int firstFrame = rt.frameIndex;
+	FrameStatistics frameStats;
+	frameStats.threadRays.resize(rt.rayCounters.size());
 	Timer timer;
 	timer.Start();
 
-	// render "loop"
-	const int numberOfIterations = 1;
+	// traced by the workers of a distributed render, the Raytracer's counters stay empty then
+	uint64_t farmRayCount = 0;
+	if (coordinatorPort >= 0)
+	{
+		std::cout << "waiting for workers on port " << coordinatorPort << std::endl;
+		FarmCoordinator coordinator(rt, tileSize);
+		coordinator.SetTaskTimeout(taskTimeout);
+		if (!coordinator.Run(uint16_t(coordinatorPort), numberOfFrames, passFrames, loopbackOnly))
+		{
+			std::cout << "distributed render failed: " << coordinator.GetError() << std::endl;
+			return 1;
+		}
+		std::cout << coordinator.WorkerCount() << " workers rendered " << coordinator.TaskCount() << " tiles, " << coordinator.RetryCount() << " retried" << std::endl;
+		farmRayCount = coordinator.RayCount();
+	}
+	else if (firstSample >= 0 || partialFilename != nullptr)
+	{
+		// render a slice of the samples, frame by frame so each frame's means can be added exactly
+		int sliceFirstFrame = firstSample >= 0 ? firstSample / raysPerPixel : 0;
+		int sliceLastFrame = firstSample >= 0 ? (firstSample + sampleCount) / raysPerPixel : numberOfFrames;
+
+		PartialRender partial;
+		partial.Reset(MakeCheckpointHeader(rt), uint64_t(sliceFirstFrame));
+		for (int frame = sliceFirstFrame; frame < sliceLastFrame; frame++)
+		{
+			std::fill(framebuffer.begin(), framebuffer.end(), Color());
+			rt.frameIndex = frame;
+			rt.Raytrace();
+			partial.AddFrame(framebuffer.data());
+		}
+
+		std::vector<Color> sum(width * height);
+		partial.Resolve(sum.data(), framebufferCopy.data());
+		rt.Resume(sum.data(), int(partial.FrameCount()));
 
-	for (int i = 0; i < numberOfIterations; i++)
+		if (partialFilename != nullptr)
+		{
+			std::cout << "storing samples " << sliceFirstFrame * raysPerPixel << " to " << sliceLastFrame * raysPerPixel << " to '" << partialFilename << "'" << std::endl;
+			if (!partial.Save(partialFilename))
+				std::cout << "failed to store partial render" << std::endl;
+		}
+	}
+	else
 	{
-		rt.Raytrace();
+		// render loop, checkpoints are stored in the background while tracing continues
+		std::unique_ptr<CheckpointWriter> checkpointWriter;
+		if (checkpointFilename != nullptr)
+			checkpointWriter = std::make_unique<CheckpointWriter>(checkpointFilename);
+
+		Timer checkpointTimer;
+		checkpointTimer.Start();
+
+		while (rt.frameIndex < numberOfFrames)
+		{
+			Timer frameTimer;
+			frameTimer.Start();
+			rt.Raytrace();
+			frameTimer.Stop();
+
+			size_t frameRays = 0;
+			for (size_t i = 0; i < rt.rayCounters.size(); i++)
+			{
+				frameRays += rt.rayCounters[i];
+				frameStats.threadRays[i] += rt.rayCounters[i];
+			}
+			frameStats.milliseconds.push_back(frameTimer.GetMillisecondDuration());
+			frameStats.rays.push_back(frameRays);
+
+			if (usePerfCounters)
+			{
+				PerfCounterValues frameCounters;
+				for (size_t i = 0; i < perfCounters.size(); i++)
+				{
+					frameCounters += perfCounters[i].GetLast();
+					threadPerfTotals[i] += perfCounters[i].GetLast();
+					threadRayTotals[i] += rt.rayCounters[i];
+				}
+				PrintPerfCounters(("frame " + std::to_string(rt.frameIndex)).c_str(), frameCounters, frameRays);
+			}
+
+			checkpointTimer.Stop();
+			bool lastFrame = rt.frameIndex == numberOfFrames;
+			if (checkpointWriter && (lastFrame || checkpointTimer.GetMillisecondDuration() >= checkpointInterval * 1000.f))
+			{
+				checkpointWriter->Submit(MakeCheckpointHeader(rt), framebuffer.data());
+				checkpointTimer.Start();
+			}
+		}
+
+		if (checkpointWriter)
+		{
+			checkpointWriter->Flush();
+			if (checkpointWriter->FailedCount() > 0)
+				std::cout << "failed to store " << checkpointWriter->FailedCount() << " checkpoints to '" << checkpointFilename << "'" << std::endl;
+		}
 	}
 
 	timer.Stop();
+	int numberOfIterations = std::max(rt.frameIndex - firstFrame, 1);
 	float duration = timer.GetMillisecondDuration() / numberOfIterations;
 	size_t rayCount = 0;
-	for (int i = 0; i < rt.rayCounters.size(); i++)
+	for (size_t i = 0; i < rt.rayCounters.size(); i++)
 	{
 		rayCount += rt.rayCounters[i];
 	}
+	if (coordinatorPort >= 0)
+	{
+		// the workers only report their sum over all frames, the average stands in for the last frame
+		rayCount = size_t(farmRayCount / uint64_t(numberOfIterations));
+	}
 	std::cout << "test completed:" << std::endl;
 	std::cout << "\taverage time per frame: " << duration << " ms" << std::endl;
 	std::cout << "\tnumber of rays spawned last frame: " << rayCount << std::endl;
 	std::cout << "\taverage MegaRays/s: " << (((float)rayCount / 1000000.f) / (duration / 1000.f)) << std::endl;
 
+	// only the plain render loop times single frames
+	bool regressed = false;
+	if (!frameStats.milliseconds.empty())
+	{
+		ComputeStatistics(frameStats);
+		std::cout << "frame times over " << frameStats.milliseconds.size() << " frames after " << warmupFrames << " warmup frames:" << std::endl;
+		std::cout << "\tmedian: " << frameStats.median << " ms, p95: " << frameStats.p95 << " ms, mean: " << frameStats.mean << " ms, stddev: " << frameStats.stddev << " ms" << std::endl;
+		std::cout << "\tmin: " << frameStats.minimum << " ms, max: " << frameStats.maximum << " ms" << std::endl;
+		std::cout << "\tMegaRays/s: " << frameStats.megaRaysPerSecond << ", per thread min " << frameStats.threadMinimum << " mean " << frameStats.threadMean << " max " << frameStats.threadMaximum << std::endl;
+
+		std::string configuration = ReportConfiguration(width, height, raysPerPixel, numberOfSpheres, maxBounces, rt.rayCounters.size(),
+			sceneFilename != nullptr ? sceneFilename : textSceneFilename);
+		if (reportFilename != nullptr && !WriteReport(reportFilename, configuration, warmupFrames, frameStats))
+			std::cout << "failed to store report '" << reportFilename << "'" << std::endl;
+		if (compareFilename != nullptr)
+			regressed = !CompareReport(compareFilename, configuration, frameStats, tolerance);
+	}
+	else if (reportFilename != nullptr || compareFilename != nullptr)
+	{
+		std::cout << "reports and comparisons need the plain render loop, no frame times were measured" << std::endl;
+	}
+
+	if (usePerfCounters)
+	{
+		bool anyOpen = false;
+		for (size_t i = 0; i < perfCounters.size(); i++)
+		{
+			anyOpen = anyOpen || perfCounters[i].IsOpen();
+			if (perfCounters[i].IsOpen())
+				PrintPerfCounters(("thread " + std::to_string(i)).c_str(), threadPerfTotals[i], threadRayTotals[i]);
+		}
+		if (!anyOpen && !perfCounters.empty())
+			std::cout << "no performance counters: " << perfCounters[0].GetError() << std::endl;
+	}
+
+	if (usePathStatistics)
+	{
+		PathStatistics total;
+		for (const PathStatistics& stats : pathStatistics)
+			total += stats;
+		PrintPathStatistics(total);
+	}
+
+	// where the acceleration structure fails shows up as hot spots
+	if (heatmapFilename != nullptr)
+	{
+		uint64_t samples = uint64_t(rt.frameIndex - firstFrame) * uint64_t(raysPerPixel);
+		PixelCost total;
+		for (const PixelCost& cost : costs)
+			total += cost;
+		double totalSamples = double(samples) * costs.size();
+		std::cout << "work per sample: " << total.traversalSteps / totalSamples << " bounding spheres tested, " << total.boundingSpheresEntered / totalSamples << " entered, "
+			<< total.spheresTested / totalSamples << " spheres tested, " << total.bounces / totalSamples << " bounces" << std::endl;
+
+		std::vector<Color> heatmap(width * height);
+		float scale = CostHeatmap(costs.data(), costs.size(), samples, heatmapMetric, heatmap.data());
+		std::cout << "storing heatmap to '" << heatmapFilename << "', red is " << scale << " per sample" << std::endl;
+		ImageWriter writer(rt.renderThreads);
+		if (!writer.Save(heatmapFilename, heatmap.data(), width, height))
+			std::cout << "failed to store heatmap" << std::endl;
+
+		PixelCostHeader header;
+		header.width = uint32_t(width);
+		header.height = uint32_t(height);
+		header.frameCount = uint64_t(rt.frameIndex - firstFrame);
+		header.raysPerPixel = uint32_t(raysPerPixel);
+		std::string costFilename = std::string(heatmapFilename) + ".cost";
+		if (!SavePixelCosts(costFilename.c_str(), header, costs.data()))
+			std::cout << "failed to store cost counters '" << costFilename << "'" << std::endl;
+	}
+
 	// save result image
 	if (imageFilename != nullptr)
 	{
 		std::cout << "storing image result to '" << imageFilename << "'" << std::endl;;
-		SaveDataToPNG(imageFilename, width, height, &framebufferCopy[0].r);
+		Timer saveTimer;
+		saveTimer.Start();
+		ImageWriter writer(rt.renderThreads);
+		if (!writer.Save(imageFilename, framebufferCopy.data(), width, height))
+			std::cout << "failed to store image" << std::endl;
+		saveTimer.Stop();
+		std::cout << "\tstored in " << saveTimer.GetMillisecondDuration() << " ms" << std::endl;
 	}
 
-	return 0;
+	// hdr result straight from the accumulation buffer
+	if (hdrFilename != nullptr)
+	{
+		std::cout << "storing hdr result to '" << hdrFilename << "'" << std::endl;
+		Timer saveTimer;
+		saveTimer.Start();
+		HdrWriter writer(rt.renderThreads);
+		if (!writer.Save(hdrFilename, framebuffer.data(), width, height, 1.f / rt.frameIndex, HdrFormatFromFilename(hdrFilename), exrOptions))
+			std::cout << "failed to store hdr image" << std::endl;
+		saveTimer.Stop();
+		std::cout << "\tstored in " << saveTimer.GetMillisecondDuration() << " ms" << std::endl;
+	}
+
+	if (accumulationFilename != nullptr)
+	{
+		std::cout << "storing accumulation buffer to '" << accumulationFilename << "'" << std::endl;
+		AccumulationHeader header;
+		header.width = uint32_t(width);
+		header.height = uint32_t(height);
+		header.frameCount = uint64_t(rt.frameIndex);
+		header.raysPerPixel = uint32_t(raysPerPixel);
+		if (!SaveAccumulation(accumulationFilename, header, framebuffer.data()))
+			std::cout << "failed to store accumulation buffer" << std::endl;
+	}
+
+	SaveTimeline(timelineFilename);
+
+	// a distinct exit code lets scripts tell regressions from failed runs
+	return regressed ? 2 : 0;
 }
\ No newline at end of file